@@ -25,6 +25,7 @@
 #include "src/wifi.h"
 #include "src/gifs.h"
 #include "src/lms.h"
+#include "src/cache.h"
 
 /* ********************************************************************************************** */
 
@@ -67,6 +68,7 @@ void setup()
 #endif
 
     gifsInit();
+    cacheInit(sizeof(leddisplay_frame_t));
 
 #if 0
     while (true)
@@ -122,15 +124,17 @@ void loop()
         return;
     }
 
-    static String coverArtPlayerId;
+    static LMS_COVERART_t coverArt;
+    static LMS_COVERART_t nextCoverArt;
     LMS_STATE_t state = LMS_STATE_STOPPED;
     uint32_t lastGifChange;
+    uint32_t gifPlayTime = 60000;
     bool doGetCoverArt = false;
     bool doChangeGif = false;
     while (state != LMS_STATE_FAIL)
     {
         // Changes in LMS state can change the display
-        const LMS_STATE_t newState = lmsLoop(coverArtPlayerId);
+        const LMS_STATE_t newState = lmsLoop(coverArt, nextCoverArt);
         if (state != newState)
         {
             DEBUG("State change: %d -> %d", state, newState);
@@ -151,7 +155,7 @@ void loop()
                 {
                     PRINT("Now playing");
                 }
-                if (coverArtPlayerId.length() > 0)
+                if (coverArt.url.length() > 0)
                 {
                     doGetCoverArt = true;
                 }
@@ -183,7 +187,7 @@ void loop()
         switch (loopMode)
         {
             case LOOP_GIF:
-                if ( (millis() - lastGifChange) > 60000 )
+                if ( (millis() - lastGifChange) > gifPlayTime )
                 {
                     doChangeGif = true;
                 }
@@ -197,8 +201,10 @@ void loop()
         // Change display
         if (doChangeGif)
         {
+            displayCoverArt(NULL); // cancel pending cover art
             const int r = random(10);
             PRINT("New gif (%d)", r);
+            gifPlayTime = 60000;
             if (r < 1)
             {
                 displayRGBerset(true);
@@ -209,7 +215,15 @@ void loop()
             }
             else
             {
-                displayGif(gifsGetRandom());
+                // Play whole loops (about a minute's worth) if we know the duration from the catalogue
+                const char *gif = gifsGetRandom();
+                GIFS_INFO_t info;
+                if (gifsGetInfo(gif, &info) && (info.duration > 0))
+                {
+                    const uint32_t nLoops = (gifPlayTime + (info.duration / 2)) / info.duration;
+                    gifPlayTime = MIN(MAX(nLoops, 1) * info.duration, 2 * gifPlayTime);
+                }
+                displayGif(gif);
             }
             doChangeGif = false;
             lastGifChange = millis();
@@ -218,20 +232,42 @@ void loop()
         if (doGetCoverArt)
         {
             PRINT("new coverart");
-            if (!displayCoverArt(coverArtPlayerId.c_str()))
+            if (!displayCoverArt(coverArt.url.c_str(), coverArt.key.c_str()))
             {
                 statusNoise(STATUS_NOISE_FAIL);
             }
             doGetCoverArt = false;
-            loopMode = LOOP_COVER;
+        }
+        // Prefetch next track's cover art (once the worker is free)
+        static LMS_COVERART_t prefetchCoverArt;
+        if (nextCoverArt.url.length() > 0)
+        {
+            prefetchCoverArt = nextCoverArt;
+        }
+        if ( (prefetchCoverArt.url.length() > 0) &&
+             displayCoverArtPrefetch(prefetchCoverArt.url.c_str(), prefetchCoverArt.key.c_str()) )
+        {
+            prefetchCoverArt.url = "";
+        }
+        switch (displayCoverArtPoll())
+        {
+            case DISPLAY_COVERART_OK:
+                loopMode = LOOP_COVER;
+                break;
+            case DISPLAY_COVERART_FAIL:
+                statusNoise(STATUS_NOISE_FAIL);
+                break;
+            case DISPLAY_COVERART_NONE:
+                break;
         }
 
-        // Wait a bit...
-        delay(99);
+        // Wait a bit, or until the LMS tells us something
+        lmsWait(99);
 
     } // while connected to LMS CLI...
 
     ERROR("No longer connected...");
+    displayCoverArt(NULL); // cancel pending cover art
     displayNoise(true);
     statusLed(STATUS_LED_FAIL);
     statusNoise(STATUS_NOISE_ERROR);
@@ -0,0 +1,270 @@
+/*!
+    \file
+    \brief flipflip's Album Art Display: cover art cache (see \ref FF_CACHE)
+
+    - Copyright (c) 2020 Philippe Kehl (flipflip at oinkzwurgl dot org),
+      https://oinkzwurgl.org/projaeggd/album-art-display
+*/
+
+#include <FS.h>
+#include <SPIFFS.h>
+
+#include "stuff.h"
+#include "debug.h"
+
+#include "cache.h"
+
+/* ****************************************************************************************************************** */
+
+#define CACHE_PSRAM_ENTRIES          32 // number of entries in PSRAM
+#define CACHE_FS_ENTRIES             16 // number of entries in the filesystem
+#define CACHE_FS_RESERVE    (64 * 1024) // [bytes] min. filesystem space to leave free
+#define CACHE_FS_DIR              "/c/" // prefix for cache files
+#define CACHE_KEY_SIZE               24 // max. key length + 1
+
+typedef enum CACHE_STORE_e
+{
+    CACHE_STORE_NONE, CACHE_STORE_PSRAM, CACHE_STORE_FS
+
+} CACHE_STORE_t;
+
+typedef struct CACHE_ENTRY_s
+{
+    char     key[CACHE_KEY_SIZE]; // empty for unused entries
+    uint32_t lastUsed;            // "time" of last use (sCache.tick)
+} CACHE_ENTRY_t;
+
+typedef struct CACHE_s
+{
+    CACHE_STORE_t store;
+    int           entrySize;
+    int           nEntries;
+    uint8_t      *mem;        // CACHE_STORE_PSRAM: entry data
+    uint32_t      tick;
+    uint32_t      nHit;
+    uint32_t      nMiss;
+    uint32_t      nPut;
+    uint32_t      nEvict;
+    CACHE_ENTRY_t entries[MAX(CACHE_PSRAM_ENTRIES, CACHE_FS_ENTRIES)];
+} CACHE_t;
+
+static CACHE_t sCache;
+
+static void sCacheMon(void);
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+static void sCacheFileName(const CACHE_ENTRY_t *entry, char *name, const int size)
+{
+    snprintf(name, size, CACHE_FS_DIR "%s", entry->key);
+}
+
+void cacheInit(const int entrySize)
+{
+    sCache.entrySize = entrySize;
+
+    // Use PSRAM if we have it...
+    if (psramFound())
+    {
+        sCache.mem = (uint8_t *)heap_caps_malloc(CACHE_PSRAM_ENTRIES * entrySize, MALLOC_CAP_SPIRAM);
+        if (sCache.mem != NULL)
+        {
+            sCache.store = CACHE_STORE_PSRAM;
+            sCache.nEntries = CACHE_PSRAM_ENTRIES;
+        }
+    }
+
+    // ...or else the filesystem, if there is one, and pick up the entries from before
+    else if (SPIFFS.begin(false))
+    {
+        sCache.store = CACHE_STORE_FS;
+        sCache.nEntries = CACHE_FS_ENTRIES;
+        int ix = 0;
+        File root = SPIFFS.open("/");
+        File file = root.openNextFile();
+        while (file)
+        {
+            const char *name = file.name();
+            if (strncmp(name, CACHE_FS_DIR, sizeof(CACHE_FS_DIR) - 1) == 0)
+            {
+                const char *key = &name[sizeof(CACHE_FS_DIR) - 1];
+                if ( (ix < sCache.nEntries) && ((int)file.size() == entrySize) && (strlen(key) < CACHE_KEY_SIZE) )
+                {
+                    strcpy(sCache.entries[ix].key, key);
+                    ix++;
+                }
+                else
+                {
+                    file.close();
+                    SPIFFS.remove(name);
+                }
+            }
+            file = root.openNextFile();
+        }
+    }
+
+    DEBUG("cache: init (%s, %d entries of %d bytes)",
+        sCache.store == CACHE_STORE_PSRAM ? "psram" : (sCache.store == CACHE_STORE_FS ? "fs" : "none"),
+        sCache.nEntries, entrySize);
+
+    debugRegisterMon(sCacheMon);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+static CACHE_ENTRY_t *sCacheFind(const char *key)
+{
+    for (int ix = 0; ix < sCache.nEntries; ix++)
+    {
+        if ( (sCache.entries[ix].key[0] != '\0') && (strcmp(sCache.entries[ix].key, key) == 0) )
+        {
+            return &sCache.entries[ix];
+        }
+    }
+    return NULL;
+}
+
+bool cacheEnabled(void)
+{
+    return sCache.store != CACHE_STORE_NONE;
+}
+
+bool cacheHas(const char *key)
+{
+    return (key != NULL) && (key[0] != '\0') && (sCacheFind(key) != NULL);
+}
+
+bool cacheGet(const char *key, void *data)
+{
+    if ( (key == NULL) || (key[0] == '\0') )
+    {
+        return false;
+    }
+
+    CACHE_ENTRY_t *entry = sCacheFind(key);
+    bool ok = false;
+    if (entry != NULL)
+    {
+        switch (sCache.store)
+        {
+            case CACHE_STORE_PSRAM:
+                memcpy(data, &sCache.mem[(entry - sCache.entries) * sCache.entrySize], sCache.entrySize);
+                ok = true;
+                break;
+            case CACHE_STORE_FS:
+            {
+                char name[40];
+                sCacheFileName(entry, name, sizeof(name));
+                File file = SPIFFS.open(name, "r");
+                ok = file && ((int)file.read((uint8_t *)data, sCache.entrySize) == sCache.entrySize);
+                file.close();
+                if (!ok)
+                {
+                    WARNING("cache: read fail %s", name);
+                    SPIFFS.remove(name);
+                    entry->key[0] = '\0';
+                }
+                break;
+            }
+            case CACHE_STORE_NONE:
+                break;
+        }
+    }
+
+    if (ok)
+    {
+        entry->lastUsed = ++sCache.tick;
+        sCache.nHit++;
+    }
+    else
+    {
+        sCache.nMiss++;
+    }
+    DEBUG("cache: %s %s", key, ok ? "hit" : "miss");
+    return ok;
+}
+
+void cachePut(const char *key, const void *data)
+{
+    if ( (sCache.store == CACHE_STORE_NONE) || (key == NULL) || (key[0] == '\0') || (strlen(key) >= CACHE_KEY_SIZE) )
+    {
+        return;
+    }
+
+    // Replace existing entry, or use a free entry, or evict the least recently used one
+    CACHE_ENTRY_t *entry = sCacheFind(key);
+    if (entry == NULL)
+    {
+        entry = &sCache.entries[0];
+        for (int ix = 0; (ix < sCache.nEntries) && (entry->key[0] != '\0'); ix++)
+        {
+            if ( (sCache.entries[ix].key[0] == '\0') || (sCache.entries[ix].lastUsed < entry->lastUsed) )
+            {
+                entry = &sCache.entries[ix];
+            }
+        }
+        if (entry->key[0] != '\0')
+        {
+            DEBUG("cache: evict %s", entry->key);
+            if (sCache.store == CACHE_STORE_FS)
+            {
+                char name[40];
+                sCacheFileName(entry, name, sizeof(name));
+                SPIFFS.remove(name);
+            }
+            sCache.nEvict++;
+        }
+        strcpy(entry->key, key);
+    }
+    entry->lastUsed = ++sCache.tick;
+
+    switch (sCache.store)
+    {
+        case CACHE_STORE_PSRAM:
+            memcpy(&sCache.mem[(entry - sCache.entries) * sCache.entrySize], data, sCache.entrySize);
+            break;
+        case CACHE_STORE_FS:
+        {
+            char name[40];
+            sCacheFileName(entry, name, sizeof(name));
+            bool ok = false;
+            if ((int)(SPIFFS.totalBytes() - SPIFFS.usedBytes()) >= (sCache.entrySize + CACHE_FS_RESERVE))
+            {
+                File file = SPIFFS.open(name, "w");
+                ok = file && ((int)file.write((const uint8_t *)data, sCache.entrySize) == sCache.entrySize);
+                file.close();
+            }
+            if (!ok)
+            {
+                WARNING("cache: write fail %s", name);
+                SPIFFS.remove(name);
+                entry->key[0] = '\0';
+                return;
+            }
+            break;
+        }
+        case CACHE_STORE_NONE:
+            break;
+    }
+    sCache.nPut++;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+static void sCacheMon(void)
+{
+    int nUsed = 0;
+    for (int ix = 0; ix < sCache.nEntries; ix++)
+    {
+        if (sCache.entries[ix].key[0] != '\0')
+        {
+            nUsed++;
+        }
+    }
+    const uint32_t nGet = sCache.nHit + sCache.nMiss;
+    DEBUG("mon: cache: used=%d/%d hit=%u miss=%u (%.0f%%) put=%u evict=%u", nUsed, sCache.nEntries,
+        sCache.nHit, sCache.nMiss, nGet > 0 ? (double)sCache.nHit * 1e2 / (double)nGet : 0.0, sCache.nPut, sCache.nEvict);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+// eof
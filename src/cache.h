@@ -0,0 +1,57 @@
+/*!
+    \file
+    \brief flipflip's Album Art Display: cover art cache (see \ref FF_CACHE)
+
+    - Copyright (c) 2020 Philippe Kehl (flipflip at oinkzwurgl dot org),
+      https://oinkzwurgl.org/projaeggd/album-art-display
+
+    \defgroup FF_CACHE CACHE
+    \ingroup FF
+
+    Least recently used cache of fixed size entries (decoded cover art frames), keyed by a short string (the LMS
+    coverid). The entries are stored in PSRAM if available, or else as files in the filesystem (if there is one, i.e.
+    if the GIFs are not in an asset pack).
+
+    @{
+*/
+#ifndef __CACHE_H__
+#define __CACHE_H__
+
+#include <Arduino.h>
+
+//! initialise
+/*!
+    \param[in]  entrySize  size of the entries [bytes]
+*/
+void cacheInit(const int entrySize);
+
+//! check if the cache can store entries (i.e. if there is PSRAM or a filesystem)
+bool cacheEnabled(void);
+
+//! check if entry is in the cache (without counting it as a use)
+/*!
+    \param[in]  key   key (the coverid)
+
+    \returns true if the entry is in the cache
+*/
+bool cacheHas(const char *key);
+
+//! get entry from cache
+/*!
+    \param[in]  key   key (the coverid)
+    \param[out] data  buffer for the entry (entrySize bytes)
+
+    \returns true if the entry was found (and data filled in), false otherwise
+*/
+bool cacheGet(const char *key, void *data);
+
+//! add (or replace) entry in cache, evicting the least recently used entry if necessary
+/*!
+    \param[in]  key   key (the coverid)
+    \param[in]  data  the entry data (entrySize bytes)
+*/
+void cachePut(const char *key, const void *data);
+
+#endif // __CACHE_H__
+//@}
+// eof
@@ -17,11 +17,20 @@
 #  include <WiFiClient.h>
 #endif
 #include <HTTPClient.h>
+#include <esp_timer.h>
+#include <rom/tjpgd.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#include <freertos/queue.h>
 
 #include "stuff.h"
 #include "debug.h"
 #include "display.h"
 #include "wifi.h"
+#include "gifs.h"
+#include "cache.h"
+#include "config.h"
 #include "secrets.h"
 extern "C" {
 #include "nyan_64x32.h"
@@ -36,6 +45,12 @@ static Ticker             sDisplayTicker;
 static AnimatedGIF        sAniGif;
 static bool               sGifOk;
 
+static void sDisplayMon(void);
+static void sGifInit(void);
+static void sGifStop(void);
+static void sCoverArtInit(void);
+static void sCoverArtTaskInit(void);
+
 // ---------------------------------------------------------------------------------------------------------------------
 
 void displayInit(void)
@@ -56,11 +71,16 @@ void displayInit(void)
     leddisplay_frame_update(&sFrame);
 
     sAniGif.begin(LITTLE_ENDIAN_PIXELS);
+    sGifInit();
+    sCoverArtInit();
+
+    debugRegisterMon(sDisplayMon);
 }
 
 static void sDisplayStop(void)
 {
     sDisplayTicker.detach();
+    sGifStop();
     leddisplay_frame_clear(&sFrame);
     leddisplay_frame_update(&sFrame);
 }
@@ -133,157 +153,1168 @@ void displayNyan(const bool enable)
     sDisplayStop();
     if (enable)
     {
-        DEBUG("display: nyan");
-        leddisplay_set_brightness(35);
-        sDisplayTicker.attach_ms(125, sDisplayNyan);
+        DEBUG("display: nyan");
+        leddisplay_set_brightness(35);
+        sDisplayTicker.attach_ms(125, sDisplayNyan);
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+// Long-lived HTTP client for getting the cover art, the connection is kept open between requests so that we don't
+// have to connect (and do the TLS handshake) for every cover art
+#define COVER_ART_DRAIN_MAX 4096 // [bytes] max. unused response data to read to keep the connection
+
+static HTTPClient sCoverArtHttp;
+#if COVER_ART_URL_IS_HTTPS
+static WiFiClientSecure sCoverArtClient; // https://
+#else
+static WiFiClient sCoverArtClient; // http://
+#endif
+static char sCoverArtHost[64];
+static uint16_t sCoverArtPort;
+
+typedef struct COVER_ART_STATS_s
+{
+    uint32_t nGet;
+    uint32_t nReused;     // connection reused
+    uint32_t nFail;
+    uint32_t nNotMod;     // 304 not modified
+    uint32_t connectSum;  // [ms] connect time (incl. TLS handshake) of new connections
+    uint32_t connectMax;  // [ms]
+    uint32_t transferSum; // [ms] request, response and decoding time
+    uint32_t transferMax; // [ms]
+} COVER_ART_STATS_t;
+
+static COVER_ART_STATS_t sCoverArtStats;
+
+static void sCoverArtHttpInit(void)
+{
+    // Host and port from the URL ("http[s]://host[:port]/path")
+    const char *host = strstr(COVER_ART_URL, "://");
+    host = host != NULL ? &host[3] : COVER_ART_URL;
+    const int hostLen = MIN(strcspn(host, ":/"), sizeof(sCoverArtHost) - 1);
+    memcpy(sCoverArtHost, host, hostLen);
+    sCoverArtHost[hostLen] = '\0';
+#if COVER_ART_URL_IS_HTTPS
+    sCoverArtPort = host[hostLen] == ':' ? atoi(&host[hostLen + 1]) : 443;
+#else
+    sCoverArtPort = host[hostLen] == ':' ? atoi(&host[hostLen + 1]) : 80;
+#endif
+
+    sCoverArtHttp.setReuse(true);
+    sCoverArtHttp.setTimeout(5000); // [ms]
+    //sCoverArtHttp.setFollowRedirects(true);
+    //sCoverArtHttp.setRedirectLimit(5);
+
+    DEBUG("display: cover art from %s:%u", sCoverArtHost, sCoverArtPort);
+}
+
+static void sCoverArtStatsPrint(const char *what)
+{
+    const COVER_ART_STATS_t *st = &sCoverArtStats;
+    const uint32_t nNew = st->nGet - st->nReused;
+    if (st->nGet > 0)
+    {
+        DEBUG("%s: coverart: get=%u reused=%u fail=%u notmod=%u connect=%u/%ums transfer=%u/%ums", what,
+            st->nGet, st->nReused, st->nFail, st->nNotMod, nNew > 0 ? st->connectSum / nNew : 0, st->connectMax,
+            st->transferSum / st->nGet, st->transferMax);
+    }
+}
+
+// Cover art images larger than the panel are downscaled while decoding, up to this size
+#define COVER_ART_MAX_WIDTH  1024 // [px]
+#define COVER_ART_MAX_HEIGHT 1024 // [px]
+
+// Cover art is downloaded and decoded by a separate task (see sCoverArtTask()) into its own frame buffer, so that the
+// current display (and loop()) can carry on meanwhile
+static leddisplay_frame_t sCoverArtFrame;
+
+// Scratch memory for the PNG decoder, allocated once for the largest image we can show (RGBA8 at max. size), so that
+// decoding a cover art does not need any malloc()
+static uint8_t *sCoverArtArena;
+static unsigned long sCoverArtArenaSize;
+
+static void sCoverArtInit(void)
+{
+    sCoverArtArenaSize = upng_get_arena_size(COVER_ART_MAX_WIDTH, COVER_ART_MAX_HEIGHT, 32);
+    sCoverArtArena = (uint8_t *)malloc(sCoverArtArenaSize);
+    if (sCoverArtArena == NULL)
+    {
+        ERROR("display: png arena malloc (%lu)", sCoverArtArenaSize);
+    }
+    sCoverArtHttpInit();
+    sCoverArtTaskInit();
+}
+
+// Read function for the PNG decoder, feeding it the HTTP response as it arrives
+typedef struct COVER_ART_READ_s
+{
+    HTTPClient *http;
+    WiFiClient *client;
+    int         remSize;  // remaining bytes (-1 = unknown)
+    int         resSize;  // bytes received so far
+    uint32_t    t0;
+    uint8_t     head[2];  // bytes read ahead to detect the image type
+    int         headSize; // number of bytes in head[]
+    int         headPos;  // next byte in head[] to return
+    uint32_t    gen;      // request generation (see COVER_ART_TASK_t)
+} COVER_ART_READ_t;
+
+static bool sCoverArtSuperseded(const uint32_t gen);
+
+static unsigned long sCoverArtRead(void *user, unsigned char *buffer, unsigned long size)
+{
+    COVER_ART_READ_t *rd = (COVER_ART_READ_t *)user;
+    if (rd->headPos < rd->headSize)
+    {
+        const int n = MIN(rd->headSize - rd->headPos, (int)size);
+        memcpy(buffer, &rd->head[rd->headPos], n);
+        rd->headPos += n;
+        return n;
+    }
+    const uint32_t tStart = millis();
+    while ( rd->http->connected() && (rd->remSize != 0) && ((millis() - tStart) < 5000) )
+    {
+        if (sCoverArtSuperseded(rd->gen))
+        {
+            WARNING("display: GET superseded (%d bytes received, dt=%u)", rd->resSize, millis() - rd->t0);
+            return 0;
+        }
+        const int sizeAvail = rd->client->available();
+        if (sizeAvail > 0)
+        {
+            int sizeRead = MIN(sizeAvail, (int)size);
+            if (rd->remSize > 0)
+            {
+                sizeRead = MIN(sizeRead, rd->remSize);
+            }
+            const int dataSize = rd->client->readBytes(buffer, sizeRead);
+            rd->resSize += dataSize;
+            if (rd->remSize > 0)
+            {
+                rd->remSize -= dataSize;
+            }
+            //DEBUG("display: GET received %d/%d bytes, have now %d, remaining %d (dt=%u)",
+            //    sizeRead, sizeAvail, rd->resSize, rd->remSize, millis() - rd->t0);
+            return dataSize;
+        }
+        else
+        {
+            // Short waits so that we notice when we're superseded
+            wifiWaitAvailable(*rd->client, 100);
+        }
+    }
+    WARNING("display: GET no more data (%d bytes received, dt=%u)", rd->resSize, millis() - rd->t0);
+    return 0;
+}
+
+// PNG scanline conversion and downscaling state
+typedef struct COVER_ART_ROW_s
+{
+    upng_format    format;
+    const uint8_t *palette;   // 256 RGB entries (for UPNG_INDEXEDn)
+    int            depth;     // bits per sample
+    int            nComp;     // samples per pixel
+    int            width;     // source image size
+    int            height;
+    int            outWidth;  // size on the panel (aspect ratio kept, at most the panel size)
+    int            outHeight;
+    int            outX;      // position on the panel (centred)
+    int            outY;
+    int            nRows;     // number of source rows in the accumulator
+} COVER_ART_ROW_t;
+
+// Size and position of the image on the panel. Images that are not square (e.g. from LMS' "_o" resize, which keeps
+// the aspect ratio) or smaller than the panel are letterboxed, i.e. centred on a black frame.
+static void sCoverArtRowInit(COVER_ART_ROW_t *conv, upng_format format, const uint8_t *palette, int depth, int nComp,
+    int width, int height)
+{
+    conv->format = format;
+    conv->palette = palette;
+    conv->depth = depth;
+    conv->nComp = nComp;
+    conv->width = width;
+    conv->height = height;
+    if ((width * LEDDISPLAY_HEIGHT) >= (height * LEDDISPLAY_WIDTH))
+    {
+        conv->outWidth = MIN(width, LEDDISPLAY_WIDTH);
+        conv->outHeight = MAX(1, ((height * conv->outWidth) + (width / 2)) / width);
+    }
+    else
+    {
+        conv->outHeight = MIN(height, LEDDISPLAY_HEIGHT);
+        conv->outWidth = MAX(1, ((width * conv->outHeight) + (height / 2)) / height);
+    }
+    conv->outX = (LEDDISPLAY_WIDTH - conv->outWidth) / 2;
+    conv->outY = (LEDDISPLAY_HEIGHT - conv->outHeight) / 2;
+    conv->nRows = 0;
+    if ( (conv->outWidth != LEDDISPLAY_WIDTH) || (conv->outHeight != LEDDISPLAY_HEIGHT) )
+    {
+        leddisplay_frame_clear(&sCoverArtFrame);
+    }
+}
+
+// Convert n pixels starting at pixel x0 of a PNG scanline to RGB888. Alpha is ignored, 16-bit samples are truncated to
+// 8 bits, sub-byte samples are scaled (luminance) or looked up (palette).
+static void sCoverArtConvert(const COVER_ART_ROW_t *conv, const uint8_t *row, int x0, int n, uint8_t *out)
+{
+    switch (conv->format)
+    {
+        case UPNG_RGB8:
+            memcpy(out, &row[x0 * 3], n * 3);
+            break;
+        case UPNG_RGBA8:
+        case UPNG_RGB16:
+        case UPNG_RGBA16:
+        {
+            const int step = conv->nComp * conv->depth / 8;
+            const int offs = conv->depth / 8; // 16-bit: use the MSB
+            const uint8_t *in = &row[x0 * step];
+            for (int x = 0; x < n; x++)
+            {
+                out[0] = in[0];        // R
+                out[1] = in[offs];     // G
+                out[2] = in[2 * offs]; // B
+                out += 3;
+                in += step;
+            }
+            break;
+        }
+        case UPNG_LUMINANCE8:
+        case UPNG_LUMINANCE16:
+        case UPNG_LUMINANCE_ALPHA8:
+        case UPNG_LUMINANCE_ALPHA16:
+        {
+            const int step = conv->nComp * conv->depth / 8;
+            const uint8_t *in = &row[x0 * step];
+            for (int x = 0; x < n; x++)
+            {
+                out[0] = out[1] = out[2] = in[0];
+                out += 3;
+                in += step;
+            }
+            break;
+        }
+        case UPNG_INDEXED8:
+        {
+            const uint8_t *in = &row[x0];
+            for (int x = 0; x < n; x++)
+            {
+                const uint8_t *rgb = &conv->palette[3 * in[x]];
+                out[0] = rgb[0];
+                out[1] = rgb[1];
+                out[2] = rgb[2];
+                out += 3;
+            }
+            break;
+        }
+        case UPNG_INDEXED1:
+        case UPNG_INDEXED2:
+        case UPNG_INDEXED4:
+        case UPNG_LUMINANCE1:
+        case UPNG_LUMINANCE2:
+        case UPNG_LUMINANCE4:
+        case UPNG_LUMINANCE_ALPHA1:
+        case UPNG_LUMINANCE_ALPHA2:
+        case UPNG_LUMINANCE_ALPHA4:
+        {
+            // samples are packed MSB first, pixels do not straddle bytes
+            const int depth = conv->depth;
+            const int step = conv->nComp * depth;
+            const uint8_t mask = (1 << depth) - 1;
+            const uint8_t scale = 255 / mask;
+            int bit = x0 * step;
+            for (int x = 0; x < n; x++)
+            {
+                const uint8_t val = (row[bit >> 3] >> (8 - depth - (bit & 7))) & mask;
+                if (conv->palette != NULL)
+                {
+                    const uint8_t *rgb = &conv->palette[3 * val];
+                    out[0] = rgb[0];
+                    out[1] = rgb[1];
+                    out[2] = rgb[2];
+                }
+                else
+                {
+                    out[0] = out[1] = out[2] = val * scale;
+                }
+                out += 3;
+                bit += step;
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+// Accumulator for downscaling: sums of the source pixels falling into each panel pixel of the current panel row
+static uint32_t sCoverArtAcc[LEDDISPLAY_WIDTH][3];
+
+// Row function for the PNG decoder, putting the pixels into sCoverArtFrame. Images larger than their size on the
+// panel are downscaled with a box filter: each source pixel is added to the panel pixel it falls into, and once all
+// source rows for a panel row have been added the sums are divided by the number of source pixels.
+static void sCoverArtRow(void *user, unsigned y, const unsigned char *row, unsigned long size)
+{
+    COVER_ART_ROW_t *conv = (COVER_ART_ROW_t *)user;
+    const int srcWidth = conv->width;
+    const int srcHeight = conv->height;
+    const int outWidth = conv->outWidth;
+    const int outHeight = conv->outHeight;
+
+    // Same size, convert directly into the frame
+    if ( (srcWidth == outWidth) && (srcHeight == outHeight) )
+    {
+        sCoverArtConvert(conv, row, 0, outWidth, sCoverArtFrame.yx[conv->outY + y][conv->outX]);
+        return;
+    }
+
+    // Add the row to the accumulator, converting it in chunks through a small buffer
+    if (conv->nRows == 0)
+    {
+        memset(sCoverArtAcc, 0, sizeof(sCoverArtAcc));
+    }
+    uint8_t rgb[LEDDISPLAY_WIDTH][3];
+    int dx = 0;
+    int xEnd = (srcWidth + outWidth - 1) / outWidth; // first source column of the next panel column
+    for (int x0 = 0; x0 < srcWidth; x0 += LEDDISPLAY_WIDTH)
+    {
+        const int n = MIN(LEDDISPLAY_WIDTH, srcWidth - x0);
+        sCoverArtConvert(conv, row, x0, n, rgb[0]);
+        for (int ix = 0; ix < n; ix++)
+        {
+            if ((x0 + ix) >= xEnd)
+            {
+                dx++;
+                xEnd = (((dx + 1) * srcWidth) + outWidth - 1) / outWidth;
+            }
+            sCoverArtAcc[dx][0] += rgb[ix][0];
+            sCoverArtAcc[dx][1] += rgb[ix][1];
+            sCoverArtAcc[dx][2] += rgb[ix][2];
+        }
+    }
+    conv->nRows++;
+
+    // Last source row for this panel row? Output averages.
+    const int dy = (y * outHeight) / srcHeight;
+    if ( ((int)y == (srcHeight - 1)) || ((int)(((y + 1) * outHeight) / srcHeight) != dy) )
+    {
+        uint8_t *out = sCoverArtFrame.yx[conv->outY + dy][conv->outX];
+        int xStart = 0;
+        for (dx = 0; dx < outWidth; dx++)
+        {
+            xEnd = (((dx + 1) * srcWidth) + outWidth - 1) / outWidth;
+            const uint32_t num = (xEnd - xStart) * conv->nRows;
+            const uint32_t half = num / 2;
+            out[0] = (sCoverArtAcc[dx][0] + half) / num;
+            out[1] = (sCoverArtAcc[dx][1] + half) / num;
+            out[2] = (sCoverArtAcc[dx][2] + half) / num;
+            out += 3;
+            xStart = xEnd;
+        }
+        conv->nRows = 0;
+    }
+}
+
+// Detect the image type from the Content-Type header, or from the first bytes of the data
+typedef enum COVER_ART_TYPE_e
+{
+    COVER_ART_UNKNOWN, COVER_ART_PNG, COVER_ART_JPEG, COVER_ART_AADC
+} COVER_ART_TYPE_t;
+
+static COVER_ART_TYPE_t sCoverArtType(COVER_ART_READ_t *rd, const String &contentType)
+{
+    if (contentType.startsWith("image/png"))
+    {
+        return COVER_ART_PNG;
+    }
+    else if (contentType.startsWith("image/jpeg"))
+    {
+        return COVER_ART_JPEG;
+    }
+    else if (contentType.startsWith("image/x-aadc"))
+    {
+        return COVER_ART_AADC;
+    }
+
+    while (rd->headSize < (int)sizeof(rd->head))
+    {
+        const unsigned long n = sCoverArtRead(rd, &rd->head[rd->headSize], sizeof(rd->head) - rd->headSize);
+        if (n == 0)
+        {
+            break;
+        }
+        rd->headSize += n;
+        rd->headPos += n;
+    }
+    rd->headPos = 0;
+    if (rd->headSize == (int)sizeof(rd->head))
+    {
+        if ( (rd->head[0] == 0x89) && (rd->head[1] == 'P') )
+        {
+            return COVER_ART_PNG;
+        }
+        else if ( (rd->head[0] == 0xff) && (rd->head[1] == 0xd8) )
+        {
+            return COVER_ART_JPEG;
+        }
+        else if ( (rd->head[0] == 'A') && (rd->head[1] == 'A') )
+        {
+            return COVER_ART_AADC;
+        }
+    }
+    return COVER_ART_UNKNOWN;
+}
+
+// Decode PNG while receiving it, scanline by scanline into sCoverArtFrame
+static bool sCoverArtPng(COVER_ART_READ_t *rd)
+{
+    upng_t *png = upng_new_from_stream_arena(sCoverArtRead, rd, sCoverArtArena, sCoverArtArenaSize);
+    if (png == NULL)
+    {
+        ERROR("display: png malloc");
+        return false;
+    }
+
+    upng_error err = upng_header(png);
+    if (err == UPNG_EOK)
+    {
+        const unsigned int width = upng_get_width(png);
+        const unsigned int height = upng_get_height(png);
+        const enum upng_format format = upng_get_format(png);
+        DEBUG("display: GET: png: %ux%u format=%u (dt=%u)", width, height, format, millis() - rd->t0);
+        if ( (width > COVER_ART_MAX_WIDTH) || (height > COVER_ART_MAX_HEIGHT) ||
+             (upng_get_arena_size(width, height, upng_get_bpp(png)) > sCoverArtArenaSize) )
+        {
+            WARNING("display: png size not supported");
+            err = UPNG_EUNFORMAT;
+        }
+        else
+        {
+            const bool indexed = (format == UPNG_INDEXED1) || (format == UPNG_INDEXED2) ||
+                (format == UPNG_INDEXED4) || (format == UPNG_INDEXED8);
+            COVER_ART_ROW_t conv;
+            sCoverArtRowInit(&conv, format, indexed ? upng_get_palette(png, NULL) : NULL,
+                (int)upng_get_bitdepth(png), (int)upng_get_components(png), (int)width, (int)height);
+            err = upng_decode_rows(png, sCoverArtRow, &conv);
+        }
+    }
+    DEBUG("display: png arena %lu/%lu", upng_get_arena_peak(png), sCoverArtArenaSize);
+    upng_free(png);
+
+    if (err == UPNG_ENOMEM)
+    {
+        ERROR("display: png malloc");
+        return false;
+    }
+    else if (err != UPNG_EOK)
+    {
+        ERROR("display: Bad png?! %d", err);
+        return false;
+    }
+    return true;
+}
+
+#if CONFIG_COVER_ART_JPEG
+// Decode JPEG while receiving it using the TJpgDec in the ESP32 ROM. It can scale down by 1/2, 1/4 and 1/8 in the
+// IDCT, so we choose the largest such scale that still fills the panel (on the longer side, see sCoverArtRowInit())
+// and let the box filter do the rest. The decoder outputs blocks (MCUs), which we collect into a row of MCUs for the box filter. The decoder work
+// area and the MCU row buffer are taken from the PNG arena.
+#define COVER_ART_JPEG_POOL 3100 // [bytes] TJpgDec work area
+
+typedef struct COVER_ART_JPEG_s
+{
+    COVER_ART_READ_t *rd;
+    COVER_ART_ROW_t   conv;   // scaled image size, RGB888
+    uint8_t          *mcuRow; // one row of MCUs (scaled)
+} COVER_ART_JPEG_t;
+
+static UINT sCoverArtJpegIn(JDEC *jdec, BYTE *buf, UINT size)
+{
+    COVER_ART_JPEG_t *jpeg = (COVER_ART_JPEG_t *)jdec->device;
+    UINT total = 0;
+    while (total < size)
+    {
+        uint8_t skip[64];
+        const unsigned long n = buf != NULL ?
+            sCoverArtRead(jpeg->rd, &buf[total], size - total) :
+            sCoverArtRead(jpeg->rd, skip, MIN(sizeof(skip), size - total)); // skip data
+        if (n == 0)
+        {
+            break;
+        }
+        total += n;
+    }
+    return total;
+}
+
+static UINT sCoverArtJpegOut(JDEC *jdec, void *bitmap, JRECT *rect)
+{
+    COVER_ART_JPEG_t *jpeg = (COVER_ART_JPEG_t *)jdec->device;
+    const int width = jpeg->conv.width;
+    const int blockSize = (rect->right - rect->left + 1) * 3;
+    const uint8_t *in = (const uint8_t *)bitmap;
+    for (int y = rect->top; y <= rect->bottom; y++)
+    {
+        memcpy(&jpeg->mcuRow[(((y - rect->top) * width) + rect->left) * 3], in, blockSize);
+        in += blockSize;
+    }
+
+    // Row of MCUs complete, pass it on scanline by scanline
+    if (rect->right == (width - 1))
+    {
+        for (int y = rect->top; y <= rect->bottom; y++)
+        {
+            sCoverArtRow(&jpeg->conv, y, &jpeg->mcuRow[(y - rect->top) * width * 3], width * 3);
+        }
+    }
+    return 1;
+}
+
+// Output size of the decoder for the given scale (partial MCUs at the right and bottom are scaled separately)
+static int sCoverArtJpegSize(int size, int mcuSize, int scale)
+{
+    return ((size / mcuSize) * (mcuSize >> scale)) + ((size % mcuSize) >> scale);
+}
+
+static bool sCoverArtJpeg(COVER_ART_READ_t *rd)
+{
+    if (sCoverArtArena == NULL)
+    {
+        ERROR("display: jpeg malloc");
+        return false;
+    }
+
+    JDEC jdec;
+    COVER_ART_JPEG_t jpeg;
+    jpeg.rd = rd;
+    JRESULT res = jd_prepare(&jdec, sCoverArtJpegIn, sCoverArtArena, COVER_ART_JPEG_POOL, &jpeg);
+    if (res != JDR_OK)
+    {
+        WARNING("display: Bad jpeg?! %d", res);
+        return false;
+    }
+
+    const int mcuWidth = jdec.msx * 8;
+    const int mcuHeight = jdec.msy * 8;
+    int scale = 3;
+    while ( (scale > 0) && ( (sCoverArtJpegSize(jdec.width, mcuWidth, scale) < LEDDISPLAY_WIDTH) &&
+                             (sCoverArtJpegSize(jdec.height, mcuHeight, scale) < LEDDISPLAY_HEIGHT) ) )
+    {
+        scale--;
+    }
+    const int width = sCoverArtJpegSize(jdec.width, mcuWidth, scale);
+    const int height = sCoverArtJpegSize(jdec.height, mcuHeight, scale);
+    const int mcuRowSize = width * (mcuHeight >> scale) * 3;
+    DEBUG("display: GET: jpeg: %ux%u scale=1/%d %dx%d (dt=%u)", jdec.width, jdec.height, 1 << scale,
+        width, height, millis() - rd->t0);
+    if ((COVER_ART_JPEG_POOL + mcuRowSize) > (int)sCoverArtArenaSize)
+    {
+        WARNING("display: jpeg size not supported");
+        return false;
+    }
+
+    sCoverArtRowInit(&jpeg.conv, UPNG_RGB8, NULL, 8, 3, width, height);
+    jpeg.mcuRow = &sCoverArtArena[COVER_ART_JPEG_POOL];
+    res = jd_decomp(&jdec, sCoverArtJpegOut, scale);
+    if (res != JDR_OK)
+    {
+        WARNING("display: Bad jpeg?! %d", res);
+        return false;
+    }
+    return true;
+}
+#endif // CONFIG_COVER_ART_JPEG
+
+// Pre-encoded cover art ("AADC", from tools/aadcd.pl, see tools/Ffi/Aadc.pm for the format): header, and the pixels
+// in RGB565 or RGB888, LZ4 compressed. That we can decompress straight into sCoverArtFrame while receiving it.
+#define COVER_ART_AADC_HEAD_SIZE 16
+#define COVER_ART_AADC_VERSION    1
+#define COVER_ART_AADC_RGB565     1
+#define COVER_ART_AADC_RGB888     2
+
+typedef struct COVER_ART_AADC_s
+{
+    COVER_ART_READ_t *rd;
+    uint8_t           buf[128];
+    int               size;
+    int               pos;
+} COVER_ART_AADC_t;
+
+// Get next byte, -1 if there is no more data
+static int sCoverArtAadcByte(COVER_ART_AADC_t *aadc)
+{
+    if (aadc->pos >= aadc->size)
+    {
+        aadc->size = sCoverArtRead(aadc->rd, aadc->buf, sizeof(aadc->buf));
+        aadc->pos = 0;
+        if (aadc->size <= 0)
+        {
+            aadc->size = 0;
+            return -1;
+        }
+    }
+    return aadc->buf[aadc->pos++];
+}
+
+// Get LZ4 length extension bytes and add them to len, -1 on error
+static int sCoverArtAadcLen(COVER_ART_AADC_t *aadc, int len)
+{
+    int b;
+    do
+    {
+        b = sCoverArtAadcByte(aadc);
+        if (b < 0)
+        {
+            return -1;
+        }
+        len += b;
+    }
+    while (b == 255);
+    return len;
+}
+
+static bool sCoverArtAadc(COVER_ART_READ_t *rd)
+{
+    COVER_ART_AADC_t aadc;
+    aadc.rd = rd;
+    aadc.size = 0;
+    aadc.pos = 0;
+
+    uint8_t head[COVER_ART_AADC_HEAD_SIZE];
+    for (int ix = 0; ix < (int)sizeof(head); ix++)
+    {
+        const int b = sCoverArtAadcByte(&aadc);
+        if (b < 0)
+        {
+            WARNING("display: Bad aadc?!");
+            return false;
+        }
+        head[ix] = b;
+    }
+    const int format = head[5];
+    const int width = head[6] | (head[7] << 8);
+    const int height = head[8] | (head[9] << 8);
+    const int rawSize = head[10] | (head[11] << 8) | (head[12] << 16) | (head[13] << 24);
+    const int bpp = format == COVER_ART_AADC_RGB565 ? 2 : (format == COVER_ART_AADC_RGB888 ? 3 : 0);
+    DEBUG("display: GET: aadc: %dx%d format=%d size=%d (dt=%u)", width, height, format, rawSize, millis() - rd->t0);
+    if ( (memcmp(head, "AADC", 4) != 0) || (head[4] != COVER_ART_AADC_VERSION) || (bpp == 0) ||
+         (width != LEDDISPLAY_WIDTH) || (height != LEDDISPLAY_HEIGHT) || (rawSize != (width * height * bpp)) )
+    {
+        WARNING("display: aadc not supported");
+        return false;
+    }
+
+    // RGB888 is the frame format. RGB565 goes to the end of the frame and is expanded in place below.
+    uint8_t *out = &sCoverArtFrame.raw[sizeof(sCoverArtFrame.raw) - rawSize];
+    int outPos = 0;
+    while (outPos < rawSize)
+    {
+        // Token: literals length (4 bits), match length (4 bits)
+        const int token = sCoverArtAadcByte(&aadc);
+        if (token < 0)
+        {
+            break;
+        }
+
+        // Literals
+        int len = token >> 4;
+        if (len == 15)
+        {
+            len = sCoverArtAadcLen(&aadc, len);
+        }
+        if ( (len < 0) || ((outPos + len) > rawSize) )
+        {
+            break;
+        }
+        while (len > 0)
+        {
+            const int b = sCoverArtAadcByte(&aadc);
+            if (b < 0)
+            {
+                break;
+            }
+            out[outPos++] = b;
+            len--;
+        }
+        if ( (len > 0) || (outPos >= rawSize) )
+        {
+            break;
+        }
+
+        // Match: offset (u16), length
+        const int offs0 = sCoverArtAadcByte(&aadc);
+        const int offs1 = sCoverArtAadcByte(&aadc);
+        const int offs = offs0 | (offs1 << 8);
+        len = token & 0x0f;
+        if (len == 15)
+        {
+            len = sCoverArtAadcLen(&aadc, len);
+        }
+        len += 4;
+        if ( (offs0 < 0) || (offs1 < 0) || (offs == 0) || (offs > outPos) || (len < 4) || ((outPos + len) > rawSize) )
+        {
+            break;
+        }
+        while (len > 0)
+        {
+            out[outPos] = out[outPos - offs];
+            outPos++;
+            len--;
+        }
+    }
+    if (outPos != rawSize)
+    {
+        WARNING("display: Bad aadc?! (%d/%d)", outPos, rawSize);
+        return false;
+    }
+
+    // Expand RGB565 to RGB888. Writing pixel ix ends at 3 * (ix + 1), reading the next pixel starts at
+    // (width * height) + (2 * (ix + 1)), which is never before that.
+    if (format == COVER_ART_AADC_RGB565)
+    {
+        uint8_t *rgb = sCoverArtFrame.raw;
+        for (int ix = 0; ix < (width * height); ix++)
+        {
+            const uint16_t v = out[2 * ix] | (out[(2 * ix) + 1] << 8);
+            const uint8_t r = (v >> 11) & 0x1f;
+            const uint8_t g = (v >> 5) & 0x3f;
+            const uint8_t b = v & 0x1f;
+            rgb[0] = (r << 3) | (r >> 2);
+            rgb[1] = (g << 2) | (g >> 4);
+            rgb[2] = (b << 3) | (b >> 2);
+            rgb += 3;
+        }
+    }
+    return true;
+}
+
+// Validators (ETag, Last-Modified) of previous responses, for conditional requests
+#define COVER_ART_URL_SIZE  256
+#define COVER_ART_VALID_NUM 4
+
+typedef struct COVER_ART_VALID_s
+{
+    char     url[COVER_ART_URL_SIZE]; // empty for unused entries
+    char     key[24];                 // cache key of the image, if known
+    char     etag[64];
+    char     lastModified[32];
+    uint32_t lastUsed;
+} COVER_ART_VALID_t;
+
+static COVER_ART_VALID_t sCoverArtValid[COVER_ART_VALID_NUM];
+static char sCoverArtFrameUrl[COVER_ART_URL_SIZE]; // image that is in sCoverArtFrame (empty if none or incomplete)
+
+static COVER_ART_VALID_t *sCoverArtValidFind(const char *url)
+{
+    for (int ix = 0; ix < COVER_ART_VALID_NUM; ix++)
+    {
+        if ( (sCoverArtValid[ix].url[0] != '\0') && (strcmp(sCoverArtValid[ix].url, url) == 0) )
+        {
+            return &sCoverArtValid[ix];
+        }
+    }
+    return NULL;
+}
+
+static void sCoverArtValidStore(const char *url, const char *key, const String &etag, const String &lastModified)
+{
+    COVER_ART_VALID_t *valid = sCoverArtValidFind(url);
+
+    // Forget about it if there are no (usable) validators
+    if ( ((etag.length() == 0) && (lastModified.length() == 0)) ||
+         ((int)etag.length() >= (int)sizeof(valid->etag)) ||
+         ((int)lastModified.length() >= (int)sizeof(valid->lastModified)) )
+    {
+        if (valid != NULL)
+        {
+            valid->url[0] = '\0';
+        }
+        return;
+    }
+
+    // Replace existing entry, or use a free entry, or the least recently used one
+    if (valid == NULL)
+    {
+        valid = &sCoverArtValid[0];
+        for (int ix = 0; (ix < COVER_ART_VALID_NUM) && (valid->url[0] != '\0'); ix++)
+        {
+            if ( (sCoverArtValid[ix].url[0] == '\0') || (sCoverArtValid[ix].lastUsed < valid->lastUsed) )
+            {
+                valid = &sCoverArtValid[ix];
+            }
+        }
+    }
+    snprintf(valid->url, sizeof(valid->url), "%s", url);
+    snprintf(valid->key, sizeof(valid->key), "%s", key != NULL ? key : "");
+    snprintf(valid->etag, sizeof(valid->etag), "%s", etag.c_str());
+    snprintf(valid->lastModified, sizeof(valid->lastModified), "%s", lastModified.c_str());
+    valid->lastUsed = millis();
+}
+
+// Download and decode cover art into sCoverArtFrame. The request is conditional if we have the image from a previous
+// request at hand.
+static bool sCoverArtGet(const char *coverArtUrl, const char *key, const uint32_t gen)
+{
+    const uint32_t t0 = millis();
+    COVER_ART_STATS_t *st = &sCoverArtStats;
+    st->nGet++;
+
+    // Connect, unless the connection from the previous request is still open
+    DEBUG("display: get %s", coverArtUrl);
+    const bool reused = sCoverArtClient.connected();
+    if (!reused && !sCoverArtClient.connect(sCoverArtHost, sCoverArtPort))
+    {
+        WARNING("display: failed to connect!");
+        sCoverArtClient.stop();
+        st->nFail++;
+        return false;
+    }
+    const uint32_t t1 = millis();
+
+    sCoverArtHttp.setUserAgent(wifiUserAgentStr());
+    if (!sCoverArtHttp.begin(sCoverArtClient, coverArtUrl))
+    {
+        WARNING("display: failed to connect!");
+        sCoverArtHttp.end();
+        sCoverArtClient.stop();
+        st->nFail++;
+        return false;
+    }
+
+    static const char *headerKeys[] = { "Content-Type", "ETag", "Last-Modified" };
+    sCoverArtHttp.collectHeaders(headerKeys, NUMOF(headerKeys));
+#if CONFIG_COVER_ART_JPEG
+    sCoverArtHttp.addHeader("Accept", "image/x-aadc, image/png, image/jpeg");
+#else
+    sCoverArtHttp.addHeader("Accept", "image/x-aadc, image/png");
+#endif
+
+    // We can make the request conditional if the image is still in sCoverArtFrame, or in the cache
+    COVER_ART_VALID_t *valid = sCoverArtValidFind(coverArtUrl);
+    if ( (valid != NULL) && ((strcmp(sCoverArtFrameUrl, coverArtUrl) == 0) || cacheHas(valid->key)) )
+    {
+        valid->lastUsed = millis();
+        if (valid->etag[0] != '\0')
+        {
+            sCoverArtHttp.addHeader("If-None-Match", valid->etag);
+        }
+        if (valid->lastModified[0] != '\0')
+        {
+            sCoverArtHttp.addHeader("If-Modified-Since", valid->lastModified);
+        }
+    }
+    else
+    {
+        valid = NULL;
     }
-}
 
-// ---------------------------------------------------------------------------------------------------------------------
+    DEBUG("display: GET start (dt=%u)", millis() - t0);
+    const int respStatus = sCoverArtHttp.GET();
+    const int respSize = sCoverArtHttp.getSize();
 
-bool displayCoverArt(const char *playerId)
-{
-    if (playerId == NULL)
+    // Not modified, reuse the image we have
+    if ( (valid != NULL) && (respStatus == HTTP_CODE_NOT_MODIFIED) )
     {
-        sDisplayStop();
-        return false;
+        sCoverArtHttp.end();
+        const bool ok = (strcmp(sCoverArtFrameUrl, coverArtUrl) == 0) || cacheGet(valid->key, sCoverArtFrame.raw);
+        DEBUG("display: GET not modified, %s (dt=%u)", ok ? "reuse" : "gone", millis() - t0);
+        if (ok)
+        {
+            snprintf(sCoverArtFrameUrl, sizeof(sCoverArtFrameUrl), "%s", coverArtUrl);
+            st->nNotMod++;
+        }
+        else
+        {
+            valid->url[0] = '\0';
+            st->nFail++;
+        }
+        return ok;
     }
 
-    // Switch to noise display, so that sFrame becomes free to use here
-    displayNoise(true);
+    if ( (respStatus < 0) || (respStatus != HTTP_CODE_OK) )
+    {
+        WARNING("display: GET fail (status=%d, size=%d) %s (dt=%u)", respStatus, respSize,
+            respStatus < 0 ? sCoverArtHttp.errorToString(respStatus).c_str() : PSTR("unexpected response status"),
+            millis() - t0);
+        sCoverArtHttp.end();
+        sCoverArtClient.stop();
+        st->nFail++;
+        return false;
+    }
 
-    DEBUG("display: coverart (%s)", playerId);
+    const String contentType = sCoverArtHttp.header("Content-Type");
+    DEBUG("display: GET okay (status=%d, size=%d, type=%s) (dt=%u)", respStatus, respSize,
+        contentType.c_str(), millis() - t0);
 
-    const int rgbSize = sizeof(sFrame.raw);
+    // Decode the image while receiving it
+    sCoverArtFrameUrl[0] = '\0';
+    COVER_ART_READ_t rd = { &sCoverArtHttp, &sCoverArtClient, respSize > 0 ? respSize : -1, 0, t0, { 0 }, 0, 0, gen };
+    bool ok = false;
+    switch (sCoverArtType(&rd, contentType))
+    {
+        case COVER_ART_PNG:
+            ok = sCoverArtPng(&rd);
+            break;
+        case COVER_ART_JPEG:
+#if CONFIG_COVER_ART_JPEG
+            ok = sCoverArtJpeg(&rd);
+#else
+            WARNING("display: jpeg not enabled (CONFIG_COVER_ART_JPEG)");
+#endif
+            break;
+        case COVER_ART_AADC:
+            ok = sCoverArtAadc(&rd);
+            break;
+        case COVER_ART_UNKNOWN:
+            WARNING("display: unknown image type");
+            break;
+    }
 
-    char coverArtUrl[sizeof(COVER_ART_URL) + 50];
-    snprintf(coverArtUrl, sizeof(coverArtUrl), "%s?player=%s", COVER_ART_URL, playerId);
-    const uint32_t t0 = millis();
+    // Read the rest of the response (the decoders stop at the end of the image data), so that the connection can be
+    // reused. Drop the connection if that's not possible.
+    if (ok && (rd.remSize > 0) && (rd.remSize <= COVER_ART_DRAIN_MAX))
+    {
+        uint8_t drain[64];
+        while ( (rd.remSize > 0) && (sCoverArtRead(&rd, drain, sizeof(drain)) > 0) )
+        {
+        }
+    }
+    if (ok)
+    {
+        snprintf(sCoverArtFrameUrl, sizeof(sCoverArtFrameUrl), "%s", coverArtUrl);
+        sCoverArtValidStore(coverArtUrl, key, sCoverArtHttp.header("ETag"), sCoverArtHttp.header("Last-Modified"));
+    }
+    sCoverArtHttp.end();
+    if (!ok || (rd.remSize != 0))
+    {
+        sCoverArtClient.stop();
+    }
 
-    DEBUG("display: get %s", coverArtUrl);
-    int resSize = 0;
+    // Statistics
+    const uint32_t t2 = millis();
+    const uint32_t dtConnect = t1 - t0;
+    const uint32_t dtTransfer = t2 - t1;
+    if (reused)
     {
-        HTTPClient http;
+        st->nReused++;
+    }
+    else
+    {
+        st->connectSum += dtConnect;
+        st->connectMax = MAX(st->connectMax, dtConnect);
+    }
+    st->transferSum += dtTransfer;
+    st->transferMax = MAX(st->transferMax, dtTransfer);
+    if (!ok)
+    {
+        st->nFail++;
+    }
+    DEBUG("display: GET done, %d bytes (connect=%u%s, transfer=%u, keep=%s)", rd.resSize, dtConnect,
+        reused ? " reused" : "", dtTransfer, sCoverArtClient.connected() ? "yes" : "no");
+
+    return ok;
+}
+
+// Cover art worker task: requests go through a queue of length one, so that a new request replaces a pending one. Each
+// request gets a new generation number, an ongoing download is aborted if a newer request comes in. The result is
+// picked up by displayCoverArtPoll(). Prefetch requests go through the same queue, but do not get a new generation
+// number (so that they do not abort an ongoing download), and they only fill the cache.
+#define COVER_ART_TASK_CORE    0 // the network stack runs on this core, too
+#define COVER_ART_TASK_PRIO    1
 #if COVER_ART_URL_IS_HTTPS
-        WiFiClientSecure client; // https://
+#  define COVER_ART_TASK_STACK 10240 // the TLS handshake (mbedTLS) alone needs 6-7 kB, see sDisplayMon()
 #else
-        WiFiClient client; // http://
+#  define COVER_ART_TASK_STACK  6144
 #endif
 
-        http.setUserAgent(wifiUserAgentStr());
-        http.setTimeout(5000); // [ms]
-        //http.setFollowRedirects(true);
-        //http.setRedirectLimit(5);
-        // #if defined(ESP8266)
-        //     client.setInsecure();
-        //     client.setBufferSizes(4096, 2048); // FIXME: good? seems to work fine...
-        //     client.setTimeout(10000); // [ms]
-        // #endif
-
-        if (!http.begin(client, coverArtUrl))
-        {
-            WARNING("display: failed to connect!");
-            http.end();
-            client.stop();
-            return false;
-        }
+typedef struct COVER_ART_REQ_s
+{
+    char     url[COVER_ART_URL_SIZE];
+    char     key[24];   // cache key
+    uint32_t gen;
+    uint32_t t0;        // time of request [ms]
+    bool     prefetch;  // only put the cover art into the cache
+} COVER_ART_REQ_t;
+
+typedef struct COVER_ART_TASK_s
+{
+    TaskHandle_t      task;
+    QueueHandle_t     queue;
+    SemaphoreHandle_t mutex;      // protects the generation and the result fields
+    SemaphoreHandle_t showMutex;  // held while the cover art is put on display
+    volatile uint32_t gen;        // generation of the latest request
+    uint32_t          doneGen;    // generation of the finished request
+    bool              done;       // result available
+    bool              ok;         // result, cover art is in sCoverArtFrame
+} COVER_ART_TASK_t;
+
+static COVER_ART_TASK_t sCoverArtTask;
+
+static bool sCoverArtSuperseded(const uint32_t gen)
+{
+    return gen != sCoverArtTask.gen;
+}
+
+static void sCoverArtShow(void)
+{
+    // Stop whatever is playing, wait until leddisplay frame buffer becomes available
+    sDisplayStop();
+    delay((NOISE_INT * 3) / 2);
+
+    // Put cover art on display
+    memcpy(&sFrame, &sCoverArtFrame, sizeof(sFrame));
+    leddisplay_set_brightness(50);
+    leddisplay_frame_update(&sFrame);
+}
 
-        DEBUG("display: GET start (dt=%u)", millis() - t0);
-        const int respStatus = http.GET();
-        const int respSize = http.getSize();
-        
-        if ( (respStatus < 0) || (respStatus != HTTP_CODE_OK) )
+static void sCoverArtTaskFunc(void *pArg)
+{
+    UNUSED(pArg);
+    while (ENDLESS)
+    {
+        COVER_ART_REQ_t req;
+        if (xQueueReceive(sCoverArtTask.queue, &req, portMAX_DELAY) != pdTRUE)
         {
-            WARNING("display: GET fail (status=%d, size=%d) %s (dt=%u)", respStatus, respSize,
-                respStatus < 0 ? http.errorToString(respStatus).c_str() : PSTR("unexpected response status"),
-                millis() - t0);
-            http.end();
-            client.stop();
-            return false;
+            continue;
         }
+        if (sCoverArtSuperseded(req.gen))
+        {
+            continue;
+        }
+        DEBUG("display: coverart (%s, %s, gen %u%s)", req.key, req.url, req.gen,
+            req.prefetch ? ", prefetch" : "");
 
-        DEBUG("display: GET okay (status=%d, size=%d) (dt=%u)", respStatus, respSize, millis() - t0);
-
-        // Get data, into sFrame.raw buffer, assuming PNG is smaller than unpacked image...
-        int remSize = MIN(respSize, rgbSize);
-        while ( http.connected() && (remSize > 0) )
+        // Download cover art into the cache
+        if (req.prefetch)
         {
-            const int sizeAvail = client.available();
-            if (sizeAvail > 0)
+            if (!cacheHas(req.key) && sCoverArtGet(req.url, req.key, req.gen))
             {
-                const int sizeRead = sizeAvail > remSize ? remSize : sizeAvail;
-                const int dataSize = client.readBytes(&sFrame.raw[resSize], sizeRead);
-                resSize += dataSize;
-                remSize -= dataSize;
-                DEBUG("display: GET received %d/%d bytes, have now %d, remaining %d (dt=%u)",
-                    sizeRead, sizeAvail, resSize, remSize, millis() - t0);
+                cachePut(req.key, sCoverArtFrame.raw);
             }
-            else
+            continue;
+        }
+
+        // Use cached cover art, or download it (and cache it)
+        bool ok = cacheGet(req.key, sCoverArtFrame.raw);
+        if (!ok)
+        {
+            ok = sCoverArtGet(req.url, req.key, req.gen);
+            if (ok)
             {
-                delay(111);
+                cachePut(req.key, sCoverArtFrame.raw);
             }
         }
 
-        DEBUG("display: GET done (dt=%u)", millis() - t0);
-        http.end();
-        client.stop();
+        // Put cover art on display right away, unless superseded meanwhile. Only the check (and claiming the display)
+        // is done with the mutex held, so that displayCoverArt() and displayCoverArtPoll() (i.e. loop()) don't block
+        // while we wait for the display to stop.
+        xSemaphoreTake(sCoverArtTask.mutex, portMAX_DELAY);
+        const bool show = ok && !sCoverArtSuperseded(req.gen);
+        if (show)
+        {
+            xSemaphoreTake(sCoverArtTask.showMutex, portMAX_DELAY);
+        }
+        xSemaphoreGive(sCoverArtTask.mutex);
+        if (show)
+        {
+            sCoverArtShow();
+            xSemaphoreGive(sCoverArtTask.showMutex);
+            DEBUG("display: coverart on display (latency %u)", millis() - req.t0);
+        }
+
+        xSemaphoreTake(sCoverArtTask.mutex, portMAX_DELAY);
+        if (!sCoverArtSuperseded(req.gen))
+        {
+            sCoverArtTask.doneGen = req.gen;
+            sCoverArtTask.ok = ok;
+            sCoverArtTask.done = true;
+        }
+        xSemaphoreGive(sCoverArtTask.mutex);
     }
+}
 
-    bool pngOk = true;
-    upng_t *png = upng_new_from_bytes(sFrame.raw, resSize);
-    if (png == NULL)
+static void sCoverArtTaskInit(void)
+{
+    sCoverArtTask.queue = xQueueCreate(1, sizeof(COVER_ART_REQ_t));
+    sCoverArtTask.mutex = xSemaphoreCreateMutex();
+    sCoverArtTask.showMutex = xSemaphoreCreateMutex();
+    if ( (sCoverArtTask.queue == NULL) || (sCoverArtTask.mutex == NULL) || (sCoverArtTask.showMutex == NULL) ||
+         (xTaskCreatePinnedToCore(sCoverArtTaskFunc, "cover", COVER_ART_TASK_STACK, NULL,
+            COVER_ART_TASK_PRIO, &sCoverArtTask.task, COVER_ART_TASK_CORE) != pdPASS) )
     {
-        ERROR("display: png malloc (1)");
-        return false;
+        ERROR("display: cover task");
     }
+}
 
-    const upng_error err = upng_decode(png);
-
-    if (err == UPNG_EOK)
+bool displayCoverArt(const char *url, const char *key)
+{
+    if (sCoverArtTask.queue == NULL)
     {
-        const unsigned int width = upng_get_width(png);
-        const unsigned int height = upng_get_height(png);
-        const enum upng_format format = upng_get_format(png);
-        DEBUG("display: GET: png: %ux%u format=%u", width, height, format);
-        if ( (format == UPNG_RGBA8) && ( (width * height * 3) == rgbSize) )
-        {
-            const uint8_t *in = upng_get_buffer(png);
-            uint8_t *out = sFrame.raw;
-            resSize = 0;
-            while (resSize < rgbSize)
-            {
-                *out = *in; in++; out++; // copy R
-                *out = *in; in++; out++; // copy G
-                *out = *in; in++; out++; // copy B
-                in++; // skip A
-                resSize += 3; // RGB
-            }
-        }
-        upng_free(png);
+        return false;
     }
-    else if (err == UPNG_ENOMEM)
+
+    xSemaphoreTake(sCoverArtTask.mutex, portMAX_DELAY);
+    sCoverArtTask.gen++;
+    sCoverArtTask.done = false;
+    xSemaphoreGive(sCoverArtTask.mutex);
+
+    // Wait until a cover art that is being put on display right now is done (this only blocks if the previous request
+    // has just finished), so that the caller can put something else on display
+    xSemaphoreTake(sCoverArtTask.showMutex, portMAX_DELAY);
+    xSemaphoreGive(sCoverArtTask.showMutex);
+
+    // Cancel only
+    if ( (url == NULL) || (strlen(url) >= COVER_ART_URL_SIZE) )
     {
-        ERROR("display: png malloc (2)");
-        upng_free(png);
         return false;
     }
-    else
+
+    COVER_ART_REQ_t req;
+    snprintf(req.url, sizeof(req.url), "%s", url);
+    snprintf(req.key, sizeof(req.key), "%s", key != NULL ? key : "");
+    req.gen = sCoverArtTask.gen;
+    req.t0 = millis();
+    req.prefetch = false;
+    xQueueOverwrite(sCoverArtTask.queue, &req);
+    return true;
+}
+
+bool displayCoverArtPrefetch(const char *url, const char *key)
+{
+    if ( (sCoverArtTask.queue == NULL) || (url == NULL) || (strlen(url) >= COVER_ART_URL_SIZE) ||
+         (key == NULL) || (key[0] == '\0') || !cacheEnabled() )
     {
-        ERROR("display: Bad png?! %d", err);
-        upng_free(png);
         return false;
     }
 
-    DEBUG("display: cover art ok, %d/%d bytes (dt=%u)", resSize, rgbSize, millis() - t0);
+    COVER_ART_REQ_t req;
+    snprintf(req.url, sizeof(req.url), "%s", url);
+    snprintf(req.key, sizeof(req.key), "%s", key);
+    req.gen = sCoverArtTask.gen;
+    req.t0 = millis();
+    req.prefetch = true;
+    // Don't replace a pending (non-prefetch) request
+    return xQueueSend(sCoverArtTask.queue, &req, 0) == pdTRUE;
+}
 
-    // Stop noise, wait until leddisplay frame buffer becomes available
-    sDisplayTicker.detach();
-    delay((NOISE_INT * 3) / 2);
-    
-    // Put cover art on display
-    leddisplay_set_brightness(50);
-    leddisplay_frame_update(&sFrame);
-    return true;
+DISPLAY_COVERART_t displayCoverArtPoll(void)
+{
+    if (sCoverArtTask.mutex == NULL)
+    {
+        return DISPLAY_COVERART_NONE;
+    }
+
+    xSemaphoreTake(sCoverArtTask.mutex, portMAX_DELAY);
+    DISPLAY_COVERART_t res = DISPLAY_COVERART_NONE;
+    if (sCoverArtTask.done && (sCoverArtTask.doneGen == sCoverArtTask.gen))
+    {
+        res = sCoverArtTask.ok ? DISPLAY_COVERART_OK : DISPLAY_COVERART_FAIL;
+        sCoverArtTask.done = false;
+    }
+    xSemaphoreGive(sCoverArtTask.mutex);
+    return res;
 }
 
 // ---------------------------------------------------------------------------------------------------------------------
@@ -494,155 +1525,407 @@ static int32_t sGifSeek(GIFFILE *pFile, int32_t iPosition)
     return pFile->iPos;
 }
 
-static void sGifDrawPixel(const uint16_t x, const uint16_t y, const uint16_t rgb585)
+// Memory-resident playback: GIFs that fit are loaded into RAM (PSRAM if available) once, so that decoding and looping
+// (rewinding) does not cause any filesystem I/O. Larger files are streamed from the filesystem (see above).
+#define GIF_MEM_MAX_SIZE_RAM      (48 * 1024) // [bytes] max. size to load into internal RAM
+#define GIF_MEM_MAX_SIZE_PSRAM  (1024 * 1024) // [bytes] max. size to load into PSRAM
+#define GIF_MEM_RAM_RESERVE       (40 * 1024) // [bytes] min. internal RAM to leave free
+
+static uint8_t *sGifMem;
+
+static uint8_t *sGifLoad(const char *file, int32_t *pSize)
 {
-    const uint16_t r5 = (rgb585 & 0xf800) >> 11;
-    const uint16_t g6 = (rgb585 & 0x07e0) >>  5;
-    const uint16_t b5 = (rgb585 & 0x001f);
-    const uint8_t r8 = ((r5 * 527) + 23 ) >> 6;
-    const uint8_t g8 = ((g6 * 259) + 33 ) >> 6;
-    const uint8_t b8 = ((b5 * 527) + 23 ) >> 6;
-    sFrame.yx[y][x][0] = r8;
-    sFrame.yx[y][x][1] = g8;
-    sFrame.yx[y][x][2] = b8;
+    File f = SPIFFS.open(file);
+    if (!f)
+    {
+        return NULL;
+    }
+    const int32_t size = f.size();
+    uint8_t *mem = NULL;
+    if (psramFound() && (size <= GIF_MEM_MAX_SIZE_PSRAM))
+    {
+        mem = (uint8_t *)heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+    }
+    else if ( (size <= GIF_MEM_MAX_SIZE_RAM) &&
+              (heap_caps_get_largest_free_block(MALLOC_CAP_8BIT) >= (size_t)size) &&
+              (heap_caps_get_free_size(MALLOC_CAP_8BIT) >= (size_t)(size + GIF_MEM_RAM_RESERVE)) )
+    {
+        mem = (uint8_t *)heap_caps_malloc(size, MALLOC_CAP_8BIT);
+    }
+    if ( (mem != NULL) && ((int32_t)f.read(mem, size) != size) )
+    {
+        WARNING("display: gif %s read fail", file);
+        heap_caps_free(mem);
+        mem = NULL;
+    }
+    f.close();
+    *pSize = size;
+    return mem;
 }
 
-static void sGifDraw(GIFDRAW *pDraw)
+static void sGifUnload(void)
+{
+    sAniGif.close();
+    if (sGifMem != NULL)
+    {
+        heap_caps_free(sGifMem);
+        sGifMem = NULL;
+    }
+}
+
+// Double-buffered decoding: a task on the other core decodes frame N+1 into the back buffer while the ticker encodes
+// (leddisplay_frame_update()) frame N from the front buffer. The back buffer is prepared from the front buffer (the
+// canvas after frame N) taking the disposal method of frame N into account. If the ticker finds the decoder still busy
+// it waits for the decoder to wake it up (sGifDec.wake) rather than polling.
+#define GIF_DECODE_CORE       1 // Arduino loop() runs on this core, too, the ticker runs on the other one
+#define GIF_DECODE_PRIO       2
+#define GIF_DECODE_STACK   4096
+
+static leddisplay_frame_t sGifFrame;                           // second buffer (sFrame is the first)
+static leddisplay_frame_t * const skGifBufs[2] = { &sFrame, &sGifFrame };
+
+typedef struct GIF_RECT_s
+{
+    int      x0, y0, x1, y1;    // region drawn by the frame (x1, y1 exclusive)
+    int      disposal;          // disposal method
+    uint8_t  bg[3];             // background colour
+} GIF_RECT_t;
+
+typedef struct GIF_DEC_s
 {
-    // The following "code" is from https://github.com/bitbank2/AnimatedGIF/blob/master/examples/
+    TaskHandle_t       task;
+    SemaphoreHandle_t  mutex;       // held by the decoder while decoding, and by whoever opens/closes the GIF
+    volatile bool      active;      // decoder may decode
+    volatile bool      ready;       // frame in back buffer is ready
+    volatile bool      waiting;     // sDisplayGif() waits for the frame to become ready
+    esp_timer_handle_t wake;        // one-shot timer to run sDisplayGif() once the frame is ready
+    int                front;       // index of buffer with the current frame (canvas)
+    int                res;         // playFrame() result for the ready frame
+    int                frameDur;    // [ms] duration of the ready frame
+    int32_t            decTime;     // [us] time it took to decode the ready frame
+    GIF_RECT_t         prev;        // region and disposal of the frame in the front buffer
+    GIF_RECT_t         curr;        // region and disposal of the frame being drawn
+} GIF_DEC_t;
+
+static GIF_DEC_t sGifDec;
+static leddisplay_frame_t *sGifDrawFrame; // buffer sGifDraw() draws into
+static leddisplay_frame_t sGifRestore;    // canvas under frames with disposal method "restore to previous"
+
+static uint8_t sGifPalette[256][3]; // RGB888 palette of the current frame
 
+static void sGifDraw(GIFDRAW *pDraw)
+{
     // DEBUG("sGifDraw() iX=%d iY=%d y=%d iW=%d tr=%d %d disp=%d bg=%u", pDraw->iX, pDraw->iY, pDraw->y, pDraw->iWidth,
     //     pDraw->ucTransparent, pDraw->ucHasTransparency, pDraw->ucDisposalMethod, pDraw->ucBackground);
 
-    const uint16_t *usPalette = pDraw->pPalette;
     const int y = pDraw->iY + pDraw->y; // current line
-    
-    uint8_t *pixels = pDraw->pPixels;
-    if (pDraw->ucDisposalMethod == 2) // restore to background color
+
+    // Remember the region this frame draws to, and how it wants to be disposed, and expand the (global or local)
+    // RGB565 palette to RGB888 once for the whole frame
+    GIF_RECT_t *curr = &sGifDec.curr;
+    if (pDraw->y == 0)
     {
-        for (int ix = 0; ix < pDraw->iWidth; ix++)
+        const uint16_t *usPalette = pDraw->pPalette;
+        for (int ix = 0; ix < 256; ix++)
         {
-            if (pixels[ix] == pDraw->ucTransparent)
-            {
-                pixels[ix] = pDraw->ucBackground;
-            }
+            const uint16_t rgb565 = usPalette[ix];
+            sGifPalette[ix][0] = (((rgb565 & 0xf800) >> 11) * 527 + 23) >> 6;
+            sGifPalette[ix][1] = (((rgb565 & 0x07e0) >>  5) * 259 + 33) >> 6;
+            sGifPalette[ix][2] = (( rgb565 & 0x001f       ) * 527 + 23) >> 6;
+        }
+
+        curr->x0 = pDraw->iX;
+        curr->x1 = pDraw->iX + pDraw->iWidth;
+        curr->y0 = y;
+        curr->disposal = pDraw->ucDisposalMethod;
+        if (pDraw->ucHasTransparency && (pDraw->ucBackground == pDraw->ucTransparent))
+        {
+            curr->bg[0] = curr->bg[1] = curr->bg[2] = 0;
+        }
+        else
+        {
+            memcpy(curr->bg, sGifPalette[pDraw->ucBackground], sizeof(curr->bg));
         }
-        pDraw->ucHasTransparency = 0;
     }
+    curr->y1 = y + 1;
 
-    // Apply the new pixels to the main image
-    if (pDraw->ucHasTransparency) // if transparency used
+    // Clip line to the canvas
+    if ( (y < 0) || (y >= LEDDISPLAY_HEIGHT) || (pDraw->iX >= LEDDISPLAY_WIDTH) )
     {
-        const uint8_t ucTransparent = pDraw->ucTransparent;
-        const uint8_t *pEnd = pixels + pDraw->iWidth;
-        int x = 0;
-        int iCount = 0; // count non-transparent pixels
-        uint8_t c;
-        while(x < pDraw->iWidth)
+        return;
+    }
+    const int x0 = MAX(pDraw->iX, 0);
+    const int x1 = MIN(pDraw->iX + pDraw->iWidth, LEDDISPLAY_WIDTH);
+    const uint8_t *pixels = &pDraw->pPixels[x0 - pDraw->iX];
+    uint8_t *dst = sGifDrawFrame->yx[y][x0];
+    const int n = x1 - x0;
+
+    // Keep what's underneath for sGifPrepare() if the frame is to be disposed by restoring it
+    if (curr->disposal == 3)
+    {
+        memcpy(sGifRestore.yx[y][x0], dst, n * 3);
+    }
+
+    // Translate the 8-bit pixels through the palette, skipping transparent pixels
+    if (pDraw->ucHasTransparency)
+    {
+        const uint8_t transparent = pDraw->ucTransparent;
+        for (int ix = 0; ix < n; ix++, dst += 3)
         {
-            c = ucTransparent-1;
-            static uint16_t usTemp[320]; // too much stack!
-            uint16_t *d = usTemp;
-            while (c != ucTransparent && pixels < pEnd)
-            {
-                c = *pixels++;
-                if (c == ucTransparent) // done, stop
-                {
-                    pixels--; // back up to treat it like transparent
-                }
-                else // opaque
-                {
-                    *d++ = usPalette[c];
-                    iCount++;
-                }
-            } // while looking for opaque pixels
-            if (iCount) // any opaque pixels?
+            const uint8_t c = pixels[ix];
+            if (c != transparent)
             {
-                for (int xOffset = 0; xOffset < iCount; xOffset++ )
-                {
-                    sGifDrawPixel(pDraw->iX + x + xOffset, y, usTemp[xOffset]);
-                }
-                x += iCount;
-                iCount = 0;
+                const uint8_t *rgb = sGifPalette[c];
+                dst[0] = rgb[0];
+                dst[1] = rgb[1];
+                dst[2] = rgb[2];
             }
-            // no, look for a run of transparent pixels
-            c = ucTransparent;
-            while (c == ucTransparent && pixels < pEnd)
+        }
+    }
+    else
+    {
+        for (int ix = 0; ix < n; ix++, dst += 3)
+        {
+            const uint8_t *rgb = sGifPalette[pixels[ix]];
+            dst[0] = rgb[0];
+            dst[1] = rgb[1];
+            dst[2] = rgb[2];
+        }
+    }
+}
+
+// Prepare canvas for the next frame from the canvas after the previous frame (src), applying the disposal method of
+// the previous frame. For "restore to previous" the region of the previous frame comes from sGifRestore, which
+// sGifDraw() filled with the canvas under the frame before drawing it.
+static void sGifPrepare(leddisplay_frame_t *dst, const leddisplay_frame_t *src, const GIF_RECT_t *prev)
+{
+    const int x0 = CLIP(prev->x0, 0, LEDDISPLAY_WIDTH);
+    const int x1 = CLIP(prev->x1, 0, LEDDISPLAY_WIDTH);
+    const int y0 = CLIP(prev->y0, 0, LEDDISPLAY_HEIGHT);
+    const int y1 = CLIP(prev->y1, 0, LEDDISPLAY_HEIGHT);
+    switch (prev->disposal)
+    {
+        case 2: // restore to background colour
+            memcpy(dst, src, sizeof(*dst));
+            for (int y = y0; y < y1; y++)
             {
-                c = *pixels++;
-                if (c == ucTransparent)
+                for (int x = x0; x < x1; x++)
                 {
-                    iCount++;
-                }
-                else
-                {
-                    pixels--; 
+                    dst->yx[y][x][0] = prev->bg[0];
+                    dst->yx[y][x][1] = prev->bg[1];
+                    dst->yx[y][x][2] = prev->bg[2];
                 }
             }
-            if (iCount)
+            break;
+        case 3: // restore to previous
+            memcpy(dst, src, sizeof(*dst));
+            for (int y = y0; (y < y1) && (x1 > x0); y++)
             {
-                x += iCount; // skip these
-                iCount = 0;
+                memcpy(dst->yx[y][x0], sGifRestore.yx[y][x0], (x1 - x0) * 3);
             }
-        }
+            break;
+        default: // leave in place
+            memcpy(dst, src, sizeof(*dst));
+            break;
     }
-    else
+}
+
+static void sGifDecodeTask(void *pArg)
+{
+    UNUSED(pArg);
+    while (ENDLESS)
     {
-        pixels = pDraw->pPixels;
-        // Translate the 8-bit pixels through the RGB565 palette (already byte reversed)
-        // for (x = 0; x < pDraw->iWidth; x++)
-        // {
-        //     sGifDrawPixel(pDraw->iX + x, y, usPalette[*pixels++]);
-        // }
-        uint16_t x = pDraw->iX;
-        for (int ix = 0; ix < pDraw->iWidth; ix++, x++)
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        xSemaphoreTake(sGifDec.mutex, portMAX_DELAY);
+        if (sGifDec.active && !sGifDec.ready)
         {
-            sGifDrawPixel(x, y, usPalette[pixels[ix]]);
+            const int64_t t0 = esp_timer_get_time();
+            leddisplay_frame_t *back = skGifBufs[1 - sGifDec.front];
+            sGifPrepare(back, skGifBufs[sGifDec.front], &sGifDec.prev);
+            sGifDrawFrame = back;
+            memset(&sGifDec.curr, 0, sizeof(sGifDec.curr));
+            int frameDur = 0;
+            const int res = sAniGif.playFrame(false, &frameDur);
+            // Rewind at the end of the animation
+            if (res == 0)
+            {
+                sAniGif.reset();
+            }
+            sGifDec.res = res;
+            sGifDec.frameDur = frameDur;
+            sGifDec.decTime = (int32_t)(esp_timer_get_time() - t0);
+            sGifDec.ready = true;
+        }
+        xSemaphoreGive(sGifDec.mutex);
+
+        // sDisplayGif() was too early, let it know that the frame is ready now
+        if (sGifDec.waiting)
+        {
+            sGifDec.waiting = false;
+            esp_timer_start_once(sGifDec.wake, 0);
         }
     }
 }
 
+static void sGifDecodeNext(void)
+{
+    xTaskNotifyGive(sGifDec.task);
+}
+
+// Make sure the decoder has stopped using the frame buffers
+static void sGifStop(void)
+{
+    if (sGifDec.mutex != NULL)
+    {
+        xSemaphoreTake(sGifDec.mutex, portMAX_DELAY);
+        sGifDec.active = false;
+        xSemaphoreGive(sGifDec.mutex);
+    }
+}
+
+static void sDisplayGif(void);
+
+static void sGifWake(void *pArg)
+{
+    UNUSED(pArg);
+    sDisplayGif();
+}
+
+static void sGifInit(void)
+{
+    sGifDec.mutex = xSemaphoreCreateMutex();
+    const esp_timer_create_args_t wakeArgs = { sGifWake, NULL, ESP_TIMER_TASK, "gif" };
+    if ( (sGifDec.mutex == NULL) || (esp_timer_create(&wakeArgs, &sGifDec.wake) != ESP_OK) ||
+         (xTaskCreatePinnedToCore(sGifDecodeTask, "gif", GIF_DECODE_STACK, NULL,
+            GIF_DECODE_PRIO, &sGifDec.task, GIF_DECODE_CORE) != pdPASS) )
+    {
+        ERROR("display: gif task");
+    }
+}
+
+// Frame pacing: frames are scheduled against absolute deadlines (esp_timer, [us]) so that the time it takes to decode
+// and encode a frame does not add up to the authored frame delays. Frames whose display slot has already passed when
+// they are ready are dropped (they still have to be decoded as GIF frames build upon each other).
+#define GIF_MIN_FRAME_DUR       5 // [ms]
+#define GIF_MAX_FRAME_DUR    1000 // [ms]
+#define GIF_MAX_DROP            5 // max. number of consecutive frames dropped
+#define GIF_RESYNC_LATE   1000000 // [us] give up catching up if this late
+
+typedef struct GIF_PACE_s
+{
+    char     name[32];  // GIF name
+    int64_t  deadline;  // [us] time the next frame is due
+    uint32_t nFrames;   // number of frames decoded
+    uint32_t nShown;    // number of frames shown
+    uint32_t nDropped;  // number of frames dropped
+    uint32_t nResync;   // number of times we gave up catching up
+    uint32_t nWait;     // number of times the decoder wasn't ready at the deadline
+    int      nDrop;     // consecutive frames dropped
+    int64_t  lateSum;   // [us] sum of lateness of shown frames
+    int32_t  lateMax;   // [us] max. lateness of a shown frame
+    int64_t  procSum;   // [us] sum of decode+encode times
+    int32_t  procMax;   // [us] max. decode+encode time
+} GIF_PACE_t;
+
+static GIF_PACE_t sGifPace;
+
+static void sDisplayGifStats(const char *what)
+{
+    const GIF_PACE_t *p = &sGifPace;
+    if (p->nFrames > 0)
+    {
+        DEBUG("%s: gif %s: frames=%u shown=%u dropped=%u resync=%u wait=%u late=%.1f/%.1fms proc=%.1f/%.1fms", what,
+            p->name, p->nFrames, p->nShown, p->nDropped, p->nResync, p->nWait,
+            p->nShown > 0 ? (double)p->lateSum * 1e-3 / (double)p->nShown : 0.0, (double)p->lateMax * 1e-3,
+            (double)p->procSum * 1e-3 / (double)p->nFrames, (double)p->procMax * 1e-3);
+    }
+}
+
 static void sDisplayGif(void)
 {
-    static int frameDur;
-    const int res = sAniGif.playFrame(false, &frameDur);
-    if (res < 0)
+    GIF_PACE_t *p = &sGifPace;
+    const int64_t t0 = esp_timer_get_time();
+
+    // Woken up by the decoder although we weren't waiting for it (the ticker is armed for the deadline), or by a wake
+    // up meant for a GIF that has been stopped meanwhile
+    if (t0 < (p->deadline - 1000))
+    {
+        return;
+    }
+
+    // Decoder not done yet, it wakes us up when it is (see sGifDecodeTask())
+    sGifDec.waiting = true;
+    if (xSemaphoreTake(sGifDec.mutex, 0) != pdTRUE)
+    {
+        p->nWait++;
+        return;
+    }
+    if (!sGifDec.active)
+    {
+        xSemaphoreGive(sGifDec.mutex);
+        return;
+    }
+    if (!sGifDec.ready)
     {
+        xSemaphoreGive(sGifDec.mutex);
+        p->nWait++;
+        return;
+    }
+    sGifDec.waiting = false;
+
+    if (sGifDec.res < 0)
+    {
+        xSemaphoreGive(sGifDec.mutex);
         ERROR("gif decode: %d", sAniGif.getLastError());
         displayNoise(true);
         sGifOk = false;
         return;
     }
-
-    leddisplay_frame_update(&sFrame);
-    //DEBUG("gif frame %d", frameDur);
-    //sDisplayTicker.once_ms(frameDur, sDisplayGif);
-
-    if (res == 0)
+    const int frameDur = CLIP(sGifDec.frameDur, GIF_MIN_FRAME_DUR, GIF_MAX_FRAME_DUR);
+    const int32_t decTime = sGifDec.decTime;
+
+    // The back buffer becomes the front buffer, start decoding the next frame into the other one while we encode
+    // this one
+    sGifDec.front = 1 - sGifDec.front;
+    sGifDec.prev = sGifDec.curr;
+    sGifDec.ready = false;
+    xSemaphoreGive(sGifDec.mutex);
+    sGifDecodeNext();
+
+    // This frame is due at p->deadline and shall stay until the next deadline
+    const int64_t nextDeadline = p->deadline + ((int64_t)frameDur * 1000);
+
+    // Show the frame, unless we're already past its slot
+    if ( (t0 < nextDeadline) || (p->nDrop >= GIF_MAX_DROP) )
     {
-        //DEBUG("gif done");
-        //sAniGif.close();
-        const uint32_t t0 = millis();
-        sAniGif.reset();
-        const uint32_t dt = millis() - t0;
-        if (frameDur > dt)
-        {
-            frameDur -= dt;
-        }
-        else
-        {
-            frameDur = 1;
-        }
+        leddisplay_frame_update(skGifBufs[sGifDec.front]);
+        const int64_t late = t0 > p->deadline ? t0 - p->deadline : 0;
+        p->lateSum += late;
+        p->lateMax = MAX(p->lateMax, (int32_t)late);
+        p->nShown++;
+        p->nDrop = 0;
     }
-    if (frameDur <= 5)
+    else
     {
-        frameDur = 5;
+        p->nDropped++;
+        p->nDrop++;
     }
-    else if (frameDur > 1000)
+
+    const int64_t t1 = esp_timer_get_time();
+    const int32_t proc = decTime + (int32_t)(t1 - t0);
+    p->procSum += proc;
+    p->procMax = MAX(p->procMax, proc);
+    p->nFrames++;
+
+    // Schedule next frame
+    p->deadline = nextDeadline;
+    if ((t1 - p->deadline) > GIF_RESYNC_LATE)
     {
-        frameDur = 1000;
+        p->deadline = t1;
+        p->nResync++;
     }
-    sDisplayTicker.once_ms(frameDur, sDisplayGif);
+    const int64_t wait = p->deadline - t1;
+    sDisplayTicker.once_ms(wait > 1000 ? (uint32_t)((wait + 500) / 1000) : 1, sDisplayGif);
 }
 
 void displayGif(const char *file)
@@ -650,25 +1933,76 @@ void displayGif(const char *file)
     if (file == NULL)
     {
         sDisplayStop();
-        sAniGif.close();
+        sGifUnload();
         return;
     }
 
     sGifOk = true;
     displayNoise(true);
-    sAniGif.close();
+    sGifUnload();
+    sDisplayGifStats("display");
     DEBUG("display: gif (%s)", file);
+
+    // Play directly from the memory mapped asset pack, or from memory if possible, or stream from the filesystem
+    int32_t size = 0;
+    const uint8_t *packData = NULL;
+    const char *source = "stream";
+    bool openOk = false;
+    if (gifsGetData(file, &packData, &size))
+    {
+        openOk = sAniGif.open((uint8_t *)packData, size, sGifDraw) != 0;
+        source = "pack";
+    }
+    else if ((sGifMem = sGifLoad(file, &size)) != NULL)
+    {
+        openOk = sAniGif.open(sGifMem, size, sGifDraw) != 0;
+        source = "memory";
+    }
+    else
+    {
+        openOk = sAniGif.open(file, sGifOpen, sGifClose, sGifRead, sGifSeek, sGifDraw) != 0;
+    }
+
+    // Get info from the catalogue, or scan the GIF (which has to decode the whole file)
+    GIFS_INFO_t cat;
     GIFINFO info;
-    if (sAniGif.open(file, sGifOpen, sGifClose, sGifRead, sGifSeek, sGifDraw) && sAniGif.getInfo(&info))
+    if (openOk && gifsGetInfo(file, &cat))
+    {
+        DEBUG("display: %s: %dx%d, %d frames, %ums (%d..), %d bytes (%s)", file,
+            cat.width, cat.height, cat.nFrames, cat.duration, cat.minDelay, size, source);
+    }
+    else if (openOk && sAniGif.getInfo(&info))
     {
-        DEBUG("display: %s: %dx%d, %d frames, %dms (%d..%d)", file,
+        DEBUG("display: %s: %dx%d, %d frames, %dms (%d..%d), %d bytes (%s)", file,
             sAniGif.getCanvasWidth(), sAniGif.getCanvasHeight(),
-            info.iFrameCount, info.iDuration, info.iMinDelay, info.iMaxDelay);
+            info.iFrameCount, info.iDuration, info.iMinDelay, info.iMaxDelay,
+            size, source);
+    }
+    else
+    {
+        openOk = false;
+    }
+
+    if (openOk)
+    {
+        memset(&sGifPace, 0, sizeof(sGifPace));
+        strncpy(sGifPace.name, file, sizeof(sGifPace.name) - 1);
+        sGifPace.deadline = esp_timer_get_time() + (10 * 1000);
+
+        // Start with a blank canvas, and decode the first frame
+        leddisplay_frame_clear(skGifBufs[0]);
+        memset(&sGifDec.prev, 0, sizeof(sGifDec.prev));
+        sGifDec.front = 0;
+        sGifDec.ready = false;
+        sGifDec.waiting = false;
+        sGifDec.active = true;
+        sGifDecodeNext();
         sDisplayTicker.once_ms(10, sDisplayGif);
     }
     else
     {
         ERROR("display: gif %s fail", file);
+        sGifUnload();
         sGifOk = false;
     }
 }
@@ -680,5 +2014,18 @@ bool displayGifOk(void)
     return res;
 }
 
+// ---------------------------------------------------------------------------------------------------------------------
+
+static void sDisplayMon(void)
+{
+    sDisplayGifStats("mon: display");
+    sCoverArtStatsPrint("mon: display");
+    if (sCoverArtTask.task != NULL)
+    {
+        DEBUG("mon: display: cover task stack %u/%u free", uxTaskGetStackHighWaterMark(sCoverArtTask.task),
+            COVER_ART_TASK_STACK);
+    }
+}
+
 /* ****************************************************************************************************************** */
 // eof
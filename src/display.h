@@ -24,7 +24,40 @@ void displayNoise(const bool enable);
 
 void displayNyan(const bool enable);
 
-bool displayCoverArt(const char *playerId);
+//! request cover art (from the cache if the key is known), replaces any pending request
+/*!
+    The cover art is fetched, decoded and put on display in the background, use displayCoverArtPoll() to check the
+    result. Cancelling (or any new request) guarantees that the previous request no longer touches the display.
+
+    \param[in]  url  the image URL (see lmsLoop()), or NULL to cancel the pending request
+    \param[in]  key  the cache key (see lmsLoop()), or NULL if unknown
+
+    \returns true if the request was queued
+*/
+bool displayCoverArt(const char *url, const char *key = NULL);
+
+//! download cover art into the cache in the background (e.g. of the next track in the playlist)
+/*!
+    This does not abort or replace a pending displayCoverArt() request, but such a request aborts the prefetch.
+
+    \param[in]  url  the image URL
+    \param[in]  key  the cache key
+
+    \returns true if the request was queued, false if the cover art cannot be cached, or if the worker is busy
+*/
+bool displayCoverArtPrefetch(const char *url, const char *key);
+
+//! cover art request result
+typedef enum DISPLAY_COVERART_e
+{
+    DISPLAY_COVERART_NONE,  //!< no (new) result (yet)
+    DISPLAY_COVERART_OK,    //!< cover art is now on display
+    DISPLAY_COVERART_FAIL,  //!< failed getting the cover art
+
+} DISPLAY_COVERART_t;
+
+//! check for cover art request result
+DISPLAY_COVERART_t displayCoverArtPoll(void);
 
 void displayTest(void);
 
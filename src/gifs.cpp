@@ -9,6 +9,7 @@
 #include <FS.h>
 #include <SPIFFS.h>
 #include <stdlib.h>
+#include <esp_partition.h>
 
 #include "debug.h"
 
@@ -21,6 +22,84 @@
 static char sGifFiles[MAX_GIFS][MAX_NAME];
 static int sGifNumFiles;
 
+// ---------------------------------------------------------------------------------------------------------------------
+
+// GIF asset pack (see tools/mkgifpack.pl), flashed into the SPIFFS partition instead of a SPIFFS image, the entries
+// are the catalogue of GIFs
+#define PACK_MAGIC    0x50444141 // "AADP"
+#define PACK_VERSION  2
+
+typedef struct GIFS_PACK_HEAD_s
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t count;
+    uint32_t size;
+    uint32_t entSize;
+    uint32_t align;
+    uint32_t reserved[2];
+} GIFS_PACK_HEAD_t;
+
+typedef struct GIFS_PACK_ENTRY_s
+{
+    char     name[24];
+    uint32_t offset;
+    uint32_t size;
+    uint16_t width;
+    uint16_t height;
+    uint16_t nFrames;
+    uint16_t minDelay;
+    uint32_t duration;
+    uint32_t area;
+} GIFS_PACK_ENTRY_t;
+
+static const uint8_t           *spPackBase;
+static const GIFS_PACK_ENTRY_t *spPackEntries;
+
+static bool sGifsPackInit(void)
+{
+    const esp_partition_t *part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_SPIFFS, NULL);
+    if (part == NULL)
+    {
+        return false;
+    }
+
+    GIFS_PACK_HEAD_t head;
+    if ( (esp_partition_read(part, 0, &head, sizeof(head)) != ESP_OK) || (head.magic != PACK_MAGIC) )
+    {
+        return false;
+    }
+    if ( (head.version != PACK_VERSION) || (head.entSize != sizeof(GIFS_PACK_ENTRY_t)) || (head.size > part->size) ||
+         ((sizeof(head) + (head.count * sizeof(GIFS_PACK_ENTRY_t))) > head.size) )
+    {
+        WARNING("gifs: bad pack (version=%u, entSize=%u, size=%u/%u)", head.version, head.entSize, head.size, part->size);
+        return false;
+    }
+
+    const void *base = NULL;
+    spi_flash_mmap_handle_t handle;
+    const esp_err_t err = esp_partition_mmap(part, 0, head.size, SPI_FLASH_MMAP_DATA, &base, &handle);
+    if (err != ESP_OK)
+    {
+        WARNING("gifs: pack mmap fail (size=%u): %s", head.size, esp_err_to_name(err));
+        return false;
+    }
+
+    spPackBase = (const uint8_t *)base;
+    spPackEntries = (const GIFS_PACK_ENTRY_t *)&spPackBase[sizeof(head)];
+    sGifNumFiles = head.count;
+
+    DEBUG("gifs: init (%d gifs, pack %u/%u used, mapped at %p)", sGifNumFiles, head.size, part->size, base);
+    return true;
+}
+
+static int sGifsPackCmp(const void *a, const void *b)
+{
+    return strcmp((const char *)a, ((const GIFS_PACK_ENTRY_t *)b)->name);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
 static int sGifSort(const void *a, const void *b)
 {
     return strcmp((const char *)a, (const char *)b);
@@ -29,6 +108,11 @@ static int sGifSort(const void *a, const void *b)
 void gifsInit(void)
 {
     //DEBUG("gifs: init");
+    if (sGifsPackInit())
+    {
+        return;
+    }
+
     if (!SPIFFS.begin(false))
     {
         WARNING("gifs: fail mount fs");
@@ -75,12 +159,17 @@ void gifsInit(void)
 
 // ---------------------------------------------------------------------------------------------------------------------
 
+static const char *sGifsName(const int ix)
+{
+    return spPackEntries != NULL ? spPackEntries[ix].name : sGifFiles[ix];
+}
+
 const char *gifsGetRandom(void)
 {
     if (sGifNumFiles > 0)
     {
         const int ix = random(sGifNumFiles) % sGifNumFiles;
-        return sGifFiles[ix];
+        return sGifsName(ix);
     }
     else
     {
@@ -93,7 +182,7 @@ const char *gifsGetNext(void)
     if (sGifNumFiles > 0)
     {
         static int ix;
-        const char *name = sGifFiles[ix];
+        const char *name = sGifsName(ix);
         ix++;
         ix %= sGifNumFiles;
         return name;
@@ -104,5 +193,43 @@ const char *gifsGetNext(void)
     }
 }
 
+static const GIFS_PACK_ENTRY_t *sGifsPackFind(const char *name)
+{
+    if (spPackEntries == NULL)
+    {
+        return NULL;
+    }
+    return (const GIFS_PACK_ENTRY_t *)bsearch(
+        name, spPackEntries, sGifNumFiles, sizeof(*spPackEntries), sGifsPackCmp);
+}
+
+bool gifsGetData(const char *name, const uint8_t **pData, int32_t *pSize)
+{
+    const GIFS_PACK_ENTRY_t *entry = sGifsPackFind(name);
+    if (entry == NULL)
+    {
+        return false;
+    }
+    *pData = &spPackBase[entry->offset];
+    *pSize = entry->size;
+    return true;
+}
+
+bool gifsGetInfo(const char *name, GIFS_INFO_t *pInfo)
+{
+    const GIFS_PACK_ENTRY_t *entry = sGifsPackFind(name);
+    if (entry == NULL)
+    {
+        return false;
+    }
+    pInfo->width    = entry->width;
+    pInfo->height   = entry->height;
+    pInfo->nFrames  = entry->nFrames;
+    pInfo->minDelay = entry->minDelay;
+    pInfo->duration = entry->duration;
+    pInfo->area     = entry->area;
+    return true;
+}
+
 /* ****************************************************************************************************************** */
 // eof
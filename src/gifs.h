@@ -20,6 +20,27 @@ void gifsInit(void);
 const char *gifsGetRandom(void);
 const char *gifsGetNext(void);
 
+//! get GIF data from the (memory mapped) asset pack, returns false if there is no pack or no such GIF
+bool gifsGetData(const char *name, const uint8_t **pData, int32_t *pSize);
+
+//! GIF catalogue info
+typedef struct GIFS_INFO_s
+{
+    int      width;     //!< canvas width [pixels]
+    int      height;    //!< canvas height [pixels]
+    int      nFrames;   //!< number of frames
+    int      minDelay;  //!< smallest frame delay [ms]
+    uint32_t duration;  //!< total duration of one loop [ms]
+    uint32_t area;      //!< sum of all frame areas [pixels] (decoding cost)
+} GIFS_INFO_t;
+
+//! get GIF info from the catalogue, returns false if there is no pack or no such GIF
+/*!
+    The catalogue is made by tools/mkgifpack.pl and only exists with the asset pack (flash-gifpack). With the GIFs in
+    the SPIFFS filesystem (flash-spiffs) there is no catalogue and this always returns false.
+*/
+bool gifsGetInfo(const char *name, GIFS_INFO_t *pInfo);
+
 #endif // __GIFS_H__
 //@}
 // eof
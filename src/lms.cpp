@@ -12,6 +12,8 @@
 #include "config.h"
 #include "secrets.h"
 #include "debug.h"
+#include "wifi.h"
+#include "leddisplay.h"
 
 #include "lms.h"
 
@@ -19,79 +21,387 @@
 
 static WiFiClient sLmsClient;
 
+static void sLmsMon(void);
+
 void lmsInit(void)
 {
     DEBUG("lms: init (%s:%d)", LMS_CLI_HOST, LMS_CLI_PORT);
+    debugRegisterMon(sLmsMon);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+// Lines from the CLI socket are collected in a ring buffer that is filled in bulk reads. Complete lines are handed out
+// in place (the '\n' replaced by a '\0'), only lines that wrap around the end of the ring are copied to sLmsLine.
+// Longer lines than LMS_LINE_SIZE - 1 are dropped.
+#define LMS_RX_SIZE   5120 // [bytes] ring buffer size, must be > LMS_LINE_SIZE
+#define LMS_LINE_SIZE 4096 // [bytes] max. line length + 1 (the players response is ~300 bytes per player)
+
+typedef struct LMS_RX_s
+{
+    char     buf[LMS_RX_SIZE];
+    int      rd;         // start of the next line
+    int      size;       // number of bytes in the buffer
+    int      scan;       // number of bytes from rd that have been checked for the line end
+    bool     skip;       // dropping the rest of a too long line
+    uint32_t nBytes;
+    uint32_t nLines;
+    uint32_t nWrap;
+    uint32_t nOverflow;
+} LMS_RX_t;
+
+static LMS_RX_t sLmsRx;
+static char sLmsLine[LMS_LINE_SIZE];
+
+static void sLmsRxReset(void)
+{
+    sLmsRx.rd = 0;
+    sLmsRx.size = 0;
+    sLmsRx.scan = 0;
+    sLmsRx.skip = false;
+}
+
+static void sLmsRxDrop(const int num)
+{
+    sLmsRx.rd = (sLmsRx.rd + num) % LMS_RX_SIZE;
+    sLmsRx.size -= num;
+    sLmsRx.scan = 0;
+}
+
+// Read what's available into the free space of the ring (at most two reads, the free space may wrap)
+static void sLmsRxFill(void)
+{
+    for (int n = 0; n < 2; n++)
+    {
+        const int avail = sLmsClient.available();
+        const int wr = (sLmsRx.rd + sLmsRx.size) % LMS_RX_SIZE;
+        const int space = MIN(LMS_RX_SIZE - sLmsRx.size, LMS_RX_SIZE - wr);
+        if ( (avail <= 0) || (space <= 0) )
+        {
+            break;
+        }
+        const int num = sLmsClient.read((uint8_t *)&sLmsRx.buf[wr], MIN(avail, space));
+        if (num <= 0)
+        {
+            break;
+        }
+        sLmsRx.size += num;
+        sLmsRx.nBytes += num;
+    }
+}
+
+// Get next complete line (without the "\r\n"), or NULL if there is none (yet). The line is valid (and can be modified)
+// until the next call.
+static char *sLmsReadLine(void)
+{
+    sLmsRxFill();
+    while (sLmsRx.scan < sLmsRx.size)
+    {
+        // Not the end of the line yet
+        if (sLmsRx.buf[(sLmsRx.rd + sLmsRx.scan) % LMS_RX_SIZE] != '\n')
+        {
+            sLmsRx.scan++;
+            if (!sLmsRx.skip && (sLmsRx.scan >= LMS_LINE_SIZE))
+            {
+                WARNING("lms: line too long");
+                sLmsRx.nOverflow++;
+                sLmsRx.skip = true;
+            }
+            if (sLmsRx.skip)
+            {
+                sLmsRxDrop(sLmsRx.scan);
+            }
+            continue;
+        }
+
+        // Got the line, in one piece or wrapped around the end of the ring
+        const int len = sLmsRx.scan;
+        char *line;
+        if ((sLmsRx.rd + len) < LMS_RX_SIZE)
+        {
+            line = &sLmsRx.buf[sLmsRx.rd];
+        }
+        else
+        {
+            const int len1 = LMS_RX_SIZE - sLmsRx.rd;
+            memcpy(sLmsLine, &sLmsRx.buf[sLmsRx.rd], len1);
+            memcpy(&sLmsLine[len1], sLmsRx.buf, len - len1);
+            line = sLmsLine;
+            sLmsRx.nWrap++;
+        }
+        line[len] = '\0';
+        if ( (len > 0) && (line[len - 1] == '\r') )
+        {
+            line[len - 1] = '\0';
+        }
+        sLmsRxDrop(len + 1);
+
+        // Rest of a too long line
+        if (sLmsRx.skip)
+        {
+            sLmsRx.skip = false;
+            continue;
+        }
+        sLmsRx.nLines++;
+        return line;
+    }
+    return NULL;
+}
+
+static void sLmsMon(void)
+{
+    DEBUG("mon: lms: rx=%u lines=%u wrap=%u overflow=%u buf=%d/%d", sLmsRx.nBytes, sLmsRx.nLines, sLmsRx.nWrap,
+        sLmsRx.nOverflow, sLmsRx.size, LMS_RX_SIZE);
 }
 
 // ---------------------------------------------------------------------------------------------------------------------
 
 #define QUERY_TIMEOUT 2000 // [ms]
 
-// Send query, get response
-static String sLmsQuery(const char *query, const char *expect = NULL)
+// Send query, get response (the line is valid until the next query or read), NULL on timeout
+static char *sLmsQuery(const char *query, const char *expect = NULL)
 {
     DEBUG("lms: query [%s]", query);
     sLmsClient.println(query);
     const uint32_t t0 = millis();
-    String resp = "";
     while ( (millis() - t0) < QUERY_TIMEOUT )
     {
-        if (!sLmsClient.available())
+        char *resp = sLmsReadLine();
+        if (resp == NULL)
         {
-            delay(99);
+            wifiWaitAvailable(sLmsClient, 100);
             continue;
         }
-        resp = sLmsClient.readStringUntil('\n');
-        bool respOk = false;
-        if (expect != NULL)
+        if ( (expect == NULL) || (strstr(resp, expect) != NULL) )
         {
-            respOk = resp.indexOf(expect) >= 0;
+            const int len = strlen(resp);
+            DEBUG("lms: resp  [%.60s%s] (%d)", resp, len > 60 ? "..." : "", len);
+            return resp;
         }
-        else
+    }
+    WARNING("lms: no response");
+    return NULL;
+}
+
+// CLI response lines are tokenised and URL-decoded in place (no heap allocations)
+static int sLmsHex(const char c)
+{
+    return c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10;
+}
+
+// Get next token from a response line and URL-decode it in place. Returns the token, or NULL at the end of the line.
+// For "tag:value" tokens (e.g. "mode%3Aplay") the tag is returned and *val points to the value, otherwise *val is NULL.
+static char *sLmsToken(char **pLine, char **val)
+{
+    char *in = *pLine;
+    while (*in == ' ')
+    {
+        in++;
+    }
+    if (*in == '\0')
+    {
+        *pLine = in;
+        return NULL;
+    }
+
+    char *token = in;
+    char *out = in;
+    *val = NULL;
+    while ( (*in != ' ') && (*in != '\0') )
+    {
+        char c = *in++;
+        if ( (c == '%') && isxdigit(in[0]) && isxdigit(in[1]) )
         {
-            respOk = true;
+            c = (sLmsHex(in[0]) << 4) | sLmsHex(in[1]);
+            in += 2;
         }
-        if (respOk)
+        if ( (c == ':') && (*val == NULL) )
         {
-            resp.trim();
-            DEBUG("lms: resp  [%s] (%d)", resp.length() > 60 ? (resp.substring(0, 60) + "...").c_str() : resp.c_str(), resp.length());
-            break;
+            *out++ = '\0';
+            *val = out;
+        }
+        else if ( (c != '\r') && (c != '\n') )
+        {
+            *out++ = c;
         }
     }
-    if (resp.length() == 0)
+    *pLine = *in == ' ' ? in + 1 : in;
+    *out = '\0';
+    return token;
+}
+
+// Get next token without splitting it into tag and value (for the player ID, which is a MAC address)
+static char *sLmsTokenId(char **pLine)
+{
+    char *val;
+    char *token = sLmsToken(pLine, &val);
+    if (val != NULL)
     {
-        WARNING("lms: no response");
+        val[-1] = ':';
     }
-    return resp;
+    return token;
 }
 
-// Extract parameter from response
-static String sLmsParam(const String &resp, const char *param, const bool decode = false)
+// Status response, e.g. "00%3A04%3A20%3A27%3A7e%3A24 status - 2 tags%3AcK subscribe%3A0 player_name%3ALabor
+// player_connected%3A1 power%3A1 mode%3Aplay ... playlist%20index%3A3 id%3A123 title%3AFoo coverid%3Aabcd1234
+// playlist%20index%3A4 id%3A124 title%3ABar coverid%3Aabcd5678", all strings point into the line ("" if not present)
+typedef struct LMS_TRACK_s
 {
-    String res = "";
-    char search[50];
-    snprintf(search, sizeof(search), " %s%%3A", param); // " mode%3A"
-    const int ix0 = resp.indexOf(search);
-    if (ix0 > 0)
+    const char *title;
+    const char *coverId;
+    const char *artworkUrl;
+} LMS_TRACK_t;
+
+typedef struct LMS_STATUS_s
+{
+    const char *playerId;
+    const char *playerName;
+    const char *power;
+    const char *mode;
+    int         nTracks;
+    LMS_TRACK_t tracks[2];   // current and next
+} LMS_STATUS_t;
+
+static bool sLmsParseStatus(char *line, LMS_STATUS_t *status)
+{
+    char *val;
+    status->playerId = sLmsTokenId(&line);
+    const char *cmd = sLmsToken(&line, &val);
+    if ( (status->playerId == NULL) || (cmd == NULL) || (strcmp(cmd, "status") != 0) )
     {
-        const int ix1 = resp.indexOf(' ', ix0 + 1);
-        res = resp.substring(ix0 + strlen(param) + 1 + 3, ix1 > ix0 ? ix1 : resp.length());
-        res.replace("%0A", "");
-        res.replace("%0D", "");
+        return false;
     }
-    if (decode)
+    status->playerName = "";
+    status->power = "";
+    status->mode = "";
+    status->nTracks = 0;
+
+    LMS_TRACK_t *track = NULL;
+    const char *tag;
+    while ( (tag = sLmsToken(&line, &val)) != NULL )
     {
-        res.replace("%3A", ":");
-        res.replace("%20", " ");
-        // TODO: decode all
+        if (val == NULL)
+        {
+            continue;
+        }
+        // The playlist entries come last
+        if (strcmp(tag, "playlist index") == 0)
+        {
+            if (status->nTracks >= (int)NUMOF(status->tracks))
+            {
+                break;
+            }
+            track = &status->tracks[status->nTracks++];
+            track->title = "";
+            track->coverId = "";
+            track->artworkUrl = "";
+        }
+        else if (track != NULL)
+        {
+            if      (strcmp(tag, "title") == 0)       { track->title = val; }
+            else if (strcmp(tag, "coverid") == 0)     { track->coverId = val; }
+            else if (strcmp(tag, "artwork_url") == 0) { track->artworkUrl = val; }
+        }
+        else
+        {
+            if      (strcmp(tag, "player_name") == 0) { status->playerName = val; }
+            else if (strcmp(tag, "power") == 0)       { status->power = val; }
+            else if (strcmp(tag, "mode") == 0)        { status->mode = val; }
+        }
     }
-    return res;
+    return true;
+}
+
+// Players response, e.g. "players 0 10 count%3A2 playerindex%3A0 playerid%3A00%3A04%3A20%3A27%3A7e%3A24 ...
+// modelname%3ASqueezebox%20Radio power%3A1 isplaying%3A1 ... playerindex%3A1 playerid%3A..." (one record per player)
+#define NUM_PLAYERS 10
+typedef struct LMS_PLAYERINFO_s
+{
+    const char *playerId;
+    const char *modelName;
+    const char *power;
+    const char *isPlaying;
+} LMS_PLAYERINFO_t;
+
+typedef struct LMS_PLAYERS_s
+{
+    int              count;      // -1 if not present
+    int              num;        // number of records (at most NUM_PLAYERS)
+    LMS_PLAYERINFO_t players[NUM_PLAYERS];
+} LMS_PLAYERS_t;
+
+static bool sLmsParsePlayers(char *line, LMS_PLAYERS_t *players)
+{
+    char *val;
+    const char *cmd = sLmsToken(&line, &val);
+    if ( (cmd == NULL) || (strcmp(cmd, "players") != 0) )
+    {
+        return false;
+    }
+    players->count = -1;
+    players->num = 0;
+
+    LMS_PLAYERINFO_t *player = NULL;
+    const char *tag;
+    while ( (tag = sLmsToken(&line, &val)) != NULL )
+    {
+        if (val == NULL)
+        {
+            continue;
+        }
+        // Next record
+        if (strcmp(tag, "playerindex") == 0)
+        {
+            player = players->num < NUM_PLAYERS ? &players->players[players->num++] : NULL;
+            if (player != NULL)
+            {
+                player->playerId = "";
+                player->modelName = "";
+                player->power = "";
+                player->isPlaying = "";
+            }
+        }
+        else if (strcmp(tag, "count") == 0)     { players->count = atoi(val); }
+        else if (player == NULL)                { } // more than NUM_PLAYERS
+        else if (strcmp(tag, "playerid") == 0)  { player->playerId = val; }
+        else if (strcmp(tag, "modelname") == 0) { player->modelName = val; }
+        else if (strcmp(tag, "power") == 0)     { player->power = val; }
+        else if (strcmp(tag, "isplaying") == 0) { player->isPlaying = val; }
+    }
+    return true;
+}
+
+// Client event (from "subscribe client"), e.g. "00%3A04%3A20%3A27%3A7e%3A24 client new", event is "new",
+// "disconnect", "reconnect" or "forget"
+typedef struct LMS_CLIENT_s
+{
+    const char *playerId;
+    const char *event;
+} LMS_CLIENT_t;
+
+static bool sLmsParseClient(char *line, LMS_CLIENT_t *client)
+{
+    // Check before tokenising, so that other lines are left alone
+    const char *cmd0 = strchr(line, ' ');
+    if ( (cmd0 == NULL) || (strncmp(cmd0, " client ", 8) != 0) )
+    {
+        return false;
+    }
+    char *val;
+    const char *playerId = sLmsTokenId(&line);
+    const char *cmd = sLmsToken(&line, &val);
+    const char *event = sLmsToken(&line, &val);
+    if ( (playerId == NULL) || (cmd == NULL) || (strcmp(cmd, "client") != 0) || (event == NULL) )
+    {
+        return false;
+    }
+    client->playerId = playerId;
+    client->event = event;
+    return true;
 }
 
 // ---------------------------------------------------------------------------------------------------------------------
 
-#define NUM_PLAYERS 10
 typedef struct LMS_PLAYER_s
 {
     String id;
@@ -99,11 +409,15 @@ typedef struct LMS_PLAYER_s
     String name;
     bool   playing;
     String title;
+    LMS_COVERART_t coverArt;
+    LMS_COVERART_t nextCoverArt; // of the next track in the playlist
     bool   updated;
+    bool   nextUpdated;
 } LMS_PLAYER_t;
 
 static LMS_PLAYER_t sLmsPlayers[NUM_PLAYERS];
 static int sLmsPlayersCount = 0;
+static bool sLmsNeedPlayers = true; // enumerate players (after connecting), client events keep the list up to date
 static String sLmsPlayerCurrentId = "";
 
 // ---------------------------------------------------------------------------------------------------------------------
@@ -113,23 +427,109 @@ static void sLmsDumpStatus(void)
 {
     for (int ix = 0; ix < sLmsPlayersCount; ix++)
     {
-        PRINT("lms: %cPlayer %d/%d: id=[%s] model=[%s] name=[%s] playing=%s title=[%s] updated=%s",
+        PRINT("lms: %cPlayer %d/%d: id=[%s] model=[%s] name=[%s] playing=%s title=[%s] coverart=[%s] updated=%s",
             sLmsPlayers[ix].id == sLmsPlayerCurrentId ? '*' : ' ', ix + 1, sLmsPlayersCount,
             sLmsPlayers[ix].id.c_str(), sLmsPlayers[ix].model.c_str(),  sLmsPlayers[ix].name.c_str(),
             sLmsPlayers[ix].playing ? "yes" : "no",
             sLmsPlayers[ix].title.length() > 20 ? (sLmsPlayers[ix].title.substring(0, 20) + "...").c_str() : sLmsPlayers[ix].title.c_str(),
-            sLmsPlayers[ix].updated ? "yes" : "no");
+            sLmsPlayers[ix].coverArt.key.c_str(), sLmsPlayers[ix].updated ? "yes" : "no");
     }
 }
 
 // ---------------------------------------------------------------------------------------------------------------------
 
-// Update player knowledge from status response
-static bool sLmsUpdateStatus(String &resp)
+// Cover art URLs have LMS resize the image to the display size, e.g. "/music/<coverid>/cover_64x64_o.png". LMS keeps
+// the aspect ratio ("_o"), the display letterboxes images that are not square.
+#define COVER_ART_RESIZE "_" STRINGIFY(LEDDISPLAY_WIDTH) "x" STRINGIFY(LEDDISPLAY_HEIGHT) "_o"
+
+// Base URL of the LMS web server ("http[s]://host[:port]") from COVER_ART_URL
+static String sLmsBaseUrl(void)
+{
+    const char *host = strstr(COVER_ART_URL, "://");
+    host = host != NULL ? &host[3] : COVER_ART_URL;
+    const char *path = strchr(host, '/');
+    return path != NULL ? String(COVER_ART_URL).substring(0, path - COVER_ART_URL) : String(COVER_ART_URL);
+}
+
+// URL-encode a string (e.g. a URL to pass in the path of another URL)
+static String sLmsUrlEncode(const char *str)
+{
+    String res;
+    res.reserve(strlen(str) * 3);
+    for (const char *pc = str; *pc != '\0'; pc++)
+    {
+        if ( isalnum(*pc) || (strchr("-._~", *pc) != NULL) )
+        {
+            res += *pc;
+        }
+        else
+        {
+            char esc[4];
+            snprintf(esc, sizeof(esc), "%%%02X", (uint8_t)*pc);
+            res += esc;
+        }
+    }
+    return res;
+}
+
+// Cover art of a track (from a status response), see sLmsUpdateStatus()
+static LMS_COVERART_t sLmsCoverArt(const LMS_TRACK_t *track, const char *playerId)
+{
+    LMS_COVERART_t coverArt;
+
+    // Local track (or remote track with cached artwork): the coverid is the key, stable per album
+    if ( (track != NULL) && (track->coverId[0] != '\0') )
+    {
+        coverArt.key = track->coverId;
+        coverArt.url = sLmsBaseUrl() + "/music/" + track->coverId + "/cover" COVER_ART_RESIZE ".png";
+    }
+    // Remote track with artwork URL: hash of the URL is the key
+    else if ( (track != NULL) && (track->artworkUrl[0] != '\0') )
+    {
+        const char *artworkUrl = track->artworkUrl;
+        uint32_t hash = 0x811c9dc5; // FNV-1a
+        for (const char *pc = artworkUrl; *pc != '\0'; pc++)
+        {
+            hash = (hash ^ (uint8_t)*pc) * 0x01000193;
+        }
+        char key[10];
+        snprintf(key, sizeof(key), "a%08x", hash);
+        coverArt.key = key;
+
+        // External image, LMS can fetch and resize it for us
+        if ( (strncmp(artworkUrl, "http://", 7) == 0) || (strncmp(artworkUrl, "https://", 8) == 0) )
+        {
+            coverArt.url = sLmsBaseUrl() + "/imageproxy/" + sLmsUrlEncode(artworkUrl) +
+                "/image" COVER_ART_RESIZE ".png";
+        }
+        // Image on the LMS, e.g. "/imageproxy/.../image.png" or "html/images/radio.png"
+        else
+        {
+            String path = artworkUrl[0] == '/' ? String(artworkUrl) : (String("/") + artworkUrl);
+            const int ixExt = path.lastIndexOf('.');
+            if ( (ixExt > path.lastIndexOf('/')) && (path.indexOf('?') < 0) )
+            {
+                path = path.substring(0, ixExt) + COVER_ART_RESIZE + path.substring(ixExt);
+            }
+            coverArt.url = sLmsBaseUrl() + path;
+        }
+    }
+    // Unknown, use whatever the player has
+    else if ( (playerId != NULL) && (playerId[0] != '\0') )
+    {
+        coverArt.url = sLmsBaseUrl() + "/music/current/cover" COVER_ART_RESIZE ".png?player=" + sLmsUrlEncode(playerId);
+    }
+    return coverArt;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+// Update player knowledge from status response (the line is modified)
+static bool sLmsUpdateStatus(char *line)
 {
     // Looks like status?
-    // e.g. "00%3A04%3A20%3A27%3A7e%3A24 status - 1 subscribe%3ACJK player_name%3ALabor player_connected%3A1..."
-    if (resp.indexOf(" status ") <= 0)
+    LMS_STATUS_t status;
+    if (!sLmsParseStatus(line, &status))
     {
         return false;
     }
@@ -138,7 +538,7 @@ static bool sLmsUpdateStatus(String &resp)
     int ix = -1;
     for (int cand = 0; cand < sLmsPlayersCount; cand++)
     {
-        if (sLmsPlayers[cand].id == resp.substring(0, sLmsPlayers[cand].id.length()))
+        if (sLmsPlayers[cand].id == status.playerId)
         {
             ix = cand;
             break;
@@ -148,21 +548,24 @@ static bool sLmsUpdateStatus(String &resp)
     {
         return false;
     }
-    String power = sLmsParam(resp, "power");
-    String mode  = sLmsParam(resp, "mode");
-    String name  = sLmsParam(resp, "player_name", true);
-    String title = sLmsParam(resp, "title", true);
-    //DEBUG("lms: update %d: resp=[%s]", ix, resp.c_str());
-    DEBUG("lms: update %d: power=%s mode=%s name=%s title=%s", ix, power.c_str(), mode.c_str(), name.c_str(), title.c_str());
-    if (mode.length() == 0)
+    const char *title = status.nTracks > 0 ? status.tracks[0].title : "";
+    const LMS_COVERART_t coverArt = sLmsCoverArt(status.nTracks > 0 ? &status.tracks[0] : NULL, status.playerId);
+    const LMS_COVERART_t nextCoverArt = status.nTracks > 1 ? sLmsCoverArt(&status.tracks[1], NULL) : LMS_COVERART_t();
+    DEBUG("lms: update %d: power=%s mode=%s name=%s title=%s coverart=%s next=%s", ix, status.power, status.mode,
+        status.playerName, title, coverArt.url.c_str(), nextCoverArt.url.c_str());
+    if (status.mode[0] == '\0')
     {
         return false;
     }
 
-    sLmsPlayers[ix].name  = name;
-    const bool playing = (mode == "play") && (power == "1");
-    sLmsPlayers[ix].updated = playing && (sLmsPlayers[ix].title != title);
+    sLmsPlayers[ix].name  = status.playerName;
+    const bool playing = (strcmp(status.mode, "play") == 0) && (strcmp(status.power, "1") == 0);
+    sLmsPlayers[ix].updated = playing &&
+        ((sLmsPlayers[ix].title != title) || (sLmsPlayers[ix].coverArt.url != coverArt.url));
     sLmsPlayers[ix].title   = playing ? title : "";
+    sLmsPlayers[ix].coverArt = playing ? coverArt : LMS_COVERART_t();
+    sLmsPlayers[ix].nextUpdated = playing && (sLmsPlayers[ix].nextCoverArt.url != nextCoverArt.url);
+    sLmsPlayers[ix].nextCoverArt = playing ? nextCoverArt : LMS_COVERART_t();
     sLmsPlayers[ix].playing = playing;
 
     return true;
@@ -170,6 +573,131 @@ static bool sLmsUpdateStatus(String &resp)
 
 // ---------------------------------------------------------------------------------------------------------------------
 
+// Subscribe to status changes of a player, we want the coverid (tag c) and artwork_url (tag K, for remote tracks) of
+// the current and the next track (the title is always there). The response (and the updates later) are handled in
+// lmsLoop(), so this doesn't wait for it.
+static void sLmsSubscribeStatus(const int ix)
+{
+    char query[100];
+    snprintf(query, sizeof(query), "%s status - 2 tags:cK subscribe:0",
+        sLmsUrlEncode(sLmsPlayers[ix].id.c_str()).c_str());
+    DEBUG("lms: query [%s]", query);
+    sLmsClient.println(query);
+}
+
+// Enumerate the players, for the model of new players (the name comes with the status). The response is handled in
+// lmsLoop(), so this doesn't wait for it.
+static void sLmsRequestPlayers(void)
+{
+    char query[20];
+    snprintf(query, sizeof(query), "players 0 %d", NUM_PLAYERS);
+    DEBUG("lms: query [%s]", query);
+    sLmsClient.println(query);
+}
+
+static void sLmsClearPlayer(const int ix)
+{
+    sLmsPlayers[ix].id      = "";
+    sLmsPlayers[ix].model   = "";
+    sLmsPlayers[ix].name    = "";
+    sLmsPlayers[ix].playing = false;
+    sLmsPlayers[ix].title   = "";
+    sLmsPlayers[ix].coverArt = LMS_COVERART_t();
+    sLmsPlayers[ix].nextCoverArt = LMS_COVERART_t();
+    sLmsPlayers[ix].updated = false;
+    sLmsPlayers[ix].nextUpdated = false;
+}
+
+// Update player list from client event (the line is modified)
+static bool sLmsUpdateClient(char *line)
+{
+    LMS_CLIENT_t client;
+    if (!sLmsParseClient(line, &client))
+    {
+        return false;
+    }
+    DEBUG("lms: client %s %s", client.playerId, client.event);
+
+    int ix = -1;
+    for (int cand = 0; cand < sLmsPlayersCount; cand++)
+    {
+        if (sLmsPlayers[cand].id == client.playerId)
+        {
+            ix = cand;
+            break;
+        }
+    }
+
+    // New player (or one that we didn't know about), add it and get its status
+    if ( (strcmp(client.event, "new") == 0) || (strcmp(client.event, "reconnect") == 0) )
+    {
+        if (ix < 0)
+        {
+            if (sLmsPlayersCount >= NUM_PLAYERS)
+            {
+                WARNING("lms: too many players");
+                return false;
+            }
+            ix = sLmsPlayersCount++;
+            sLmsClearPlayer(ix);
+            sLmsPlayers[ix].id = client.playerId;
+            sLmsRequestPlayers();
+        }
+        sLmsSubscribeStatus(ix);
+        return true;
+    }
+
+    // Player gone, remove it
+    else if ( (ix >= 0) && ((strcmp(client.event, "disconnect") == 0) || (strcmp(client.event, "forget") == 0)) )
+    {
+        if (sLmsPlayers[ix].id == sLmsPlayerCurrentId)
+        {
+            sLmsPlayerCurrentId = "";
+        }
+        sLmsPlayersCount--;
+        for (; ix < sLmsPlayersCount; ix++)
+        {
+            sLmsPlayers[ix] = sLmsPlayers[ix + 1];
+        }
+        sLmsClearPlayer(sLmsPlayersCount);
+        return true;
+    }
+
+    return false;
+}
+
+// Update player models from players response (see sLmsRequestPlayers(), the line is modified)
+static bool sLmsUpdatePlayers(char *line)
+{
+    // Check before tokenising, so that other lines are left alone
+    if (strncmp(line, "players ", 8) != 0)
+    {
+        return false;
+    }
+    LMS_PLAYERS_t players;
+    if (!sLmsParsePlayers(line, &players))
+    {
+        return false;
+    }
+    bool res = false;
+    for (int pIx = 0; pIx < players.num; pIx++)
+    {
+        const LMS_PLAYERINFO_t *player = &players.players[pIx];
+        for (int ix = 0; ix < sLmsPlayersCount; ix++)
+        {
+            if ( (sLmsPlayers[ix].id == player->playerId) && (sLmsPlayers[ix].model != player->modelName) )
+            {
+                DEBUG("lms: model %d: playerid=[%s] modelname=[%s]", ix, player->playerId, player->modelName);
+                sLmsPlayers[ix].model = player->modelName;
+                res = true;
+            }
+        }
+    }
+    return res;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
 // Get all players and subscribe to status update
 static void sLmsGetPlayers(void)
 {
@@ -179,45 +707,46 @@ static void sLmsGetPlayers(void)
     sLmsPlayersCount = 0;
     for (int ix = 0; ix < NUM_PLAYERS; ix++)
     {
-        sLmsPlayers[ix].id      = "";
-        sLmsPlayers[ix].model   = "";
-        sLmsPlayers[ix].playing = false;
-        sLmsPlayers[ix].title   = "";
+        sLmsClearPlayer(ix);
     }
 
-    // Enumerate players
-    int num = NUM_PLAYERS;
+    // Get told about new and disconnected players
+    DEBUG("lms: query [subscribe client]");
+    sLmsClient.println("subscribe client");
+
+    // Enumerate players, all in one go
+    char query[20];
+    snprintf(query, sizeof(query), "players 0 %d", NUM_PLAYERS);
+    LMS_PLAYERS_t players;
+    char *resp = sLmsQuery(query, query);
+    if ( (resp == NULL) || !sLmsParsePlayers(resp, &players) )
+    {
+        players.count = 0;
+        players.num = 0;
+    }
+    if (players.count > NUM_PLAYERS)
+    {
+        WARNING("lms: too many players (%d)", players.count);
+    }
     bool haveCurrentPlayer = false;
-    for (int ix = 0; ix < num; ix++)
-    {
-        char query[20];
-        snprintf(query, sizeof(query), "players %d 1", ix);
-        String resp = sLmsQuery(query, query); // e.g. "players 0 1 count%3A2 playerindex%3A0 playerid%3A0..."
-        String count = sLmsParam(resp, "count");
-        if ( (count.length() > 0) && (count.toInt() < num) )
-        {
-            num = count.toInt();
-        }
-        String playerid  = sLmsParam(resp, "playerid");
-        String modelname = sLmsParam(resp, "modelname", true);
-        String isplaying = sLmsParam(resp, "isplaying");
-        String power     = sLmsParam(resp, "power");
-        DEBUG("lms: get %d: playerid=[%s] modelname=[%s] isplaying=[%s] power=[%s]", sLmsPlayersCount, playerid.c_str(), modelname.c_str(), isplaying.c_str(), power.c_str());
-        if (playerid.length() > 0)
-        {
-            sLmsPlayers[sLmsPlayersCount].id      = playerid;
-            sLmsPlayers[sLmsPlayersCount].model   = modelname;
-            // Synced players will say playing=1 even if power=0
-            sLmsPlayers[sLmsPlayersCount].playing = (isplaying == "1") && (power == "1");
-            sLmsPlayersCount++;
-            if (sLmsPlayerCurrentId == playerid)
-            {
-                haveCurrentPlayer = true;
-            }
+    for (int ix = 0; ix < players.num; ix++)
+    {
+        const LMS_PLAYERINFO_t *player = &players.players[ix];
+        DEBUG("lms: get %d: playerid=[%s] modelname=[%s] isplaying=[%s] power=[%s]", sLmsPlayersCount,
+            player->playerId, player->modelName, player->isPlaying, player->power);
+        if (player->playerId[0] == '\0')
+        {
+            continue;
         }
-        else
+        sLmsPlayers[sLmsPlayersCount].id      = player->playerId;
+        sLmsPlayers[sLmsPlayersCount].model   = player->modelName;
+        // Synced players will say playing=1 even if power=0
+        sLmsPlayers[sLmsPlayersCount].playing =
+            (strcmp(player->isPlaying, "1") == 0) && (strcmp(player->power, "1") == 0);
+        sLmsPlayersCount++;
+        if (sLmsPlayerCurrentId == player->playerId)
         {
-            break;
+            haveCurrentPlayer = true;
         }
     }
 
@@ -226,18 +755,15 @@ static void sLmsGetPlayers(void)
         sLmsPlayerCurrentId = "";
     }
 
-    if (num == 0)
+    if (sLmsPlayersCount == 0)
     {
         WARNING("lms: no players online");
     }
 
-    // Subscribe to status changes
+    // Subscribe to status changes (the responses and the updates are handled in lmsLoop())
     for (int ix = 0; ix < sLmsPlayersCount; ix++)
     {
-        char query[100];
-        snprintf(query, sizeof(query), "%s status - 1 subscribe:CJK", sLmsPlayers[ix].id.c_str());
-        String resp = sLmsQuery(query, " status ");
-        sLmsUpdateStatus(resp);
+        sLmsSubscribeStatus(ix);
     }
 }
 
@@ -246,21 +772,22 @@ static void sLmsGetPlayers(void)
 bool lmsConnect(void)
 {
     DEBUG("lms: connecting to %s:%d", LMS_CLI_HOST, LMS_CLI_PORT);
+    sLmsRxReset();
     if (sLmsClient.connect(LMS_CLI_HOST, LMS_CLI_PORT) == 0)
     {
         ERROR("lms: Failed connecting to %s:%d!", LMS_CLI_HOST, LMS_CLI_PORT);
         return false;
     }
+    sLmsNeedPlayers = true;
 
     return sLmsClient.connected() != 0;
 }
 
 // ---------------------------------------------------------------------------------------------------------------------
 
-LMS_STATE_t lmsLoop(String &coverArtPlayerId)
+LMS_STATE_t lmsLoop(LMS_COVERART_t &coverArt, LMS_COVERART_t &nextCoverArt)
 {
     static uint32_t lastDumpStatus;
-    static uint32_t lastGetPlayers;
     const uint32_t now = millis();
 
     // Are we still connected?
@@ -271,27 +798,27 @@ LMS_STATE_t lmsLoop(String &coverArtPlayerId)
     }
 
     // Get full player info
-    if ( (lastGetPlayers == 0) || ((now - lastGetPlayers) > ((sLmsPlayersCount > 0 ? 5 : 1) * 60 * 1000)) )
+    if (sLmsNeedPlayers)
     {
         sLmsGetPlayers();
-        lastGetPlayers = now;
+        sLmsNeedPlayers = false;
         lastDumpStatus = 0;
     }
 
-    // Update status
+    // Update players and status
     bool statusUpdated = false;
-    while (sLmsClient.available())
+    char *resp;
+    while ( (resp = sLmsReadLine()) != NULL )
     {
-        String resp = sLmsClient.readStringUntil('\n');
-        resp.trim();
-        if (sLmsUpdateStatus(resp))
+        if (sLmsUpdateClient(resp) || sLmsUpdatePlayers(resp) || sLmsUpdateStatus(resp))
         {
             statusUpdated = true;
         }
     }
 
     // Work out current display state (playing -> which cover art? not playing
-    coverArtPlayerId = "";
+    coverArt = LMS_COVERART_t();
+    nextCoverArt = LMS_COVERART_t();
     LMS_STATE_t res = LMS_STATE_STOPPED;
 
     // First check if current player is still playing and perhaps changed the song
@@ -304,9 +831,13 @@ LMS_STATE_t lmsLoop(String &coverArtPlayerId)
             res = LMS_STATE_PLAYING;
             if (sLmsPlayers[ix].updated)
             {
-                coverArtPlayerId = sLmsPlayerCurrentId;
+                coverArt = sLmsPlayers[ix].coverArt;
                 lastDumpStatus = 0;
             }
+            if (sLmsPlayers[ix].updated || sLmsPlayers[ix].nextUpdated)
+            {
+                nextCoverArt = sLmsPlayers[ix].nextCoverArt;
+            }
             break;
         }
     }
@@ -320,7 +851,8 @@ LMS_STATE_t lmsLoop(String &coverArtPlayerId)
             {
                 sLmsPlayerCurrentId = sLmsPlayers[ix].id;
                 haveCurrentPlayer = true;
-                coverArtPlayerId = sLmsPlayerCurrentId;
+                coverArt = sLmsPlayers[ix].coverArt;
+                nextCoverArt = sLmsPlayers[ix].nextCoverArt;
                 res = LMS_STATE_PLAYING;
                 lastDumpStatus = 0;
                 break;
@@ -345,10 +877,17 @@ LMS_STATE_t lmsLoop(String &coverArtPlayerId)
     for (int ix = 0; ix < sLmsPlayersCount; ix++)
     {
         sLmsPlayers[ix].updated = false;
+        sLmsPlayers[ix].nextUpdated = false;
     }
 
     return res;
 }
 
+// ---------------------------------------------------------------------------------------------------------------------
+bool lmsWait(const uint32_t timeout)
+{
+    return wifiWaitAvailable(sLmsClient, timeout);
+}
+
 // ---------------------------------------------------------------------------------------------------------------------
 // eof
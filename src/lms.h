@@ -28,7 +28,19 @@ typedef enum LMS_STATE_e
 
 bool lmsConnect(void);
 
-LMS_STATE_t lmsLoop(String &coverArtPlayerId);
+//! cover art
+typedef struct LMS_COVERART_s
+{
+    String key;  //!< cache key (the coverid, or a hash of the artwork URL), empty if unknown
+    String url;  //!< image URL (resized to the display size by LMS), empty for no (new) cover art
+} LMS_COVERART_t;
+
+//! check players, returns the cover art when it should be updated, and the cover art of the next track in the playlist
+//! when it should be prefetched
+LMS_STATE_t lmsLoop(LMS_COVERART_t &coverArt, LMS_COVERART_t &nextCoverArt);
+
+//! wait until the LMS has something for us (or the timeout expires), returns true if there's data
+bool lmsWait(const uint32_t timeout);
 
 //LMS_STATE_t checkLmsCli();
 
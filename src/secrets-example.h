@@ -16,7 +16,7 @@
 #define LMS_CLI_HOST  "10.1.1.17"
 #define LMS_CLI_PORT  9090"
 
-// Cover art URL from LMS
+// LMS web server, only the "http[s]://host[:port]" part is used, the cover art URLs are made from the coverid
 #define COVER_ART_URL "http://10.1.1.17:9000/music/current/cover_64x64.png"
 
 #endif // __SECRETS_H__
\ No newline at end of file
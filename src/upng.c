@@ -36,6 +36,7 @@ freely, subject to the following restrictions:
 #define MAKE_DWORD_PTR(p) MAKE_DWORD((p)[0], (p)[1], (p)[2], (p)[3])
 
 #define CHUNK_IHDR MAKE_DWORD('I','H','D','R')
+#define CHUNK_PLTE MAKE_DWORD('P','L','T','E')
 #define CHUNK_IDAT MAKE_DWORD('I','D','A','T')
 #define CHUNK_IEND MAKE_DWORD('I','E','N','D')
 
@@ -47,20 +48,14 @@ freely, subject to the following restrictions:
 #define NUM_CODE_LENGTH_CODES 19	/*the code length codes. 0-15: code lengths, 16: copy previous 3-6 times, 17: 3-10 zeros, 18: 11-138 zeros */
 #define MAX_SYMBOLS 288 /* largest number of symbols used by any tree type */
 
-#define DEFLATE_CODE_BITLEN 15
-#define DISTANCE_BITLEN 15
-#define CODE_LENGTH_BITLEN 7
 #define MAX_BIT_LENGTH 15 /* largest bitlen used by any tree type */
 
-#define DEFLATE_CODE_BUFFER_SIZE (NUM_DEFLATE_CODE_SYMBOLS * 2)
-#define DISTANCE_BUFFER_SIZE (NUM_DISTANCE_SYMBOLS * 2)
-#define CODE_LENGTH_BUFFER_SIZE (NUM_DISTANCE_SYMBOLS * 2)
+#define HUFFMAN_FAST_BITS 9	/* codes up to this length are decoded with a single table lookup */
+#define HUFFMAN_FAST_MASK ((1 << HUFFMAN_FAST_BITS) - 1)
 
 #define SET_ERROR(upng,code) do { (upng)->error = (code); (upng)->error_line = __LINE__; } while (0)
 
-#define upng_chunk_length(chunk) MAKE_DWORD_PTR(chunk)
-#define upng_chunk_type(chunk) MAKE_DWORD_PTR((chunk) + 4)
-#define upng_chunk_critical(chunk) (((chunk)[4] & 32) == 0)
+#define upng_chunk_critical(type) (((type) & 0x20000000) == 0)
 
 typedef enum upng_state {
 	UPNG_ERROR		= -1,
@@ -72,16 +67,55 @@ typedef enum upng_state {
 typedef enum upng_color {
 	UPNG_LUM		= 0,
 	UPNG_RGB		= 2,
+	UPNG_PAL		= 3,
 	UPNG_LUMA		= 4,
 	UPNG_RGBA		= 6
 } upng_color;
 
+#define UPNG_INBUF_SIZE 512	/* size of the input buffer for reading from the source */
+
 typedef struct upng_source {
-	const unsigned char*	buffer;
+	upng_read_fn			read;	/* read function */
+	void*					user;	/* read function user data */
+	const unsigned char*	buffer;	/* memory source (upng_new_from_bytes(), upng_new_from_file()) */
 	unsigned long			size;
+	unsigned long			pos;
 	char					owning;
 } upng_source;
 
+typedef struct upng_stream {
+	unsigned char	inbuf[UPNG_INBUF_SIZE];	/* input buffer */
+	unsigned		inpos;					/* next byte in input buffer */
+	unsigned		inlen;					/* number of bytes in input buffer */
+	unsigned long	chunk_left;				/* remaining bytes in current IDAT chunk */
+	char			in_idat;				/* currently in an IDAT chunk */
+	unsigned long	bitbuf;					/* bit buffer (LSB is next bit) */
+	unsigned		bitcnt;					/* number of bits in bit buffer */
+	unsigned char*	window;					/* sliding window (ring buffer) */
+	unsigned long	wsize;					/* window size */
+	unsigned long	wdst;					/* next byte in window */
+	unsigned long	wpos;					/* number of bytes inflated so far */
+	unsigned long	wtotal;					/* number of bytes to inflate (all scanlines incl. filter bytes) */
+	unsigned char*	line;					/* current scanline (filter byte + data) */
+	unsigned char*	prevline;				/* previous (unfiltered) scanline (filter byte + data) */
+	unsigned long	linebytes;				/* size of a scanline (without filter byte) */
+	unsigned long	linepos;				/* next byte in current scanline */
+	unsigned long	bytewidth;				/* bytes per pixel for unfiltering */
+	unsigned		y;						/* current scanline */
+	upng_row_fn		row;					/* row callback */
+	void*			row_user;				/* row callback user data */
+	struct huffman_tree*	codetree;		/* literal/length codes */
+	struct huffman_tree*	codetreeD;		/* distance codes */
+	struct huffman_tree*	codelengthcodetree;	/* code length codes */
+} upng_stream;
+
+typedef struct upng_arena {
+	unsigned char*	buffer;	/* caller provided memory, or NULL to use malloc() */
+	unsigned long	size;
+	unsigned long	used;	/* currently allocated */
+	unsigned long	peak;	/* maximum allocated */
+} upng_arena;
+
 struct upng_t {
 	unsigned		width;
 	unsigned		height;
@@ -90,6 +124,9 @@ struct upng_t {
 	unsigned		color_depth;
 	upng_format		format;
 
+	unsigned char	palette[3 * 256];	/* RGB palette entries, unused entries are black */
+	unsigned		palette_size;		/* number of palette entries */
+
 	unsigned char*	buffer;
 	unsigned long	size;
 
@@ -98,12 +135,17 @@ struct upng_t {
 
 	upng_state		state;
 	upng_source		source;
+	upng_stream		stream;
+	upng_arena		arena;
+	char			in_arena;	/* upng_t itself is in the arena */
 };
 
 typedef struct huffman_tree {
-	unsigned* tree2d;
-	unsigned maxbitlen;	/*maximum number of bits a single code can get */
-	unsigned numcodes;	/*number of symbols in the alphabet = number of codes */
+	unsigned short fast[1 << HUFFMAN_FAST_BITS];	/* (bit length << 9) | symbol, indexed by the next HUFFMAN_FAST_BITS bits, 0 if the code is longer */
+	unsigned long maxcode[MAX_BIT_LENGTH + 2];		/* first code (MSB aligned to 16 bits) that is longer than the given bit length */
+	unsigned short firstcode[MAX_BIT_LENGTH + 1];	/* first code of the given bit length */
+	unsigned short firstsymbol[MAX_BIT_LENGTH + 1];	/* index into value[] of the first code of the given bit length */
+	unsigned short value[MAX_SYMBOLS];				/* symbols sorted by code */
 } huffman_tree;
 
 static const unsigned LENGTH_BASE[29] = {	/*the base lengths represented by codes 257-285 */
@@ -129,204 +171,322 @@ static const unsigned DISTANCE_EXTRA[30] = {	/*the extra bits of backwards dista
 static const unsigned CLCL[NUM_CODE_LENGTH_CODES]	/*the order in which "code length alphabet code lengths" are stored, out of this the huffman tree of the dynamic huffman tree lengths is generated */
 = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
 
-static const unsigned FIXED_DEFLATE_CODE_TREE[NUM_DEFLATE_CODE_SYMBOLS * 2] = {
-	289, 370, 290, 307, 546, 291, 561, 292, 293, 300, 294, 297, 295, 296, 0, 1,
-	2, 3, 298, 299, 4, 5, 6, 7, 301, 304, 302, 303, 8, 9, 10, 11, 305, 306, 12,
-	13, 14, 15, 308, 339, 309, 324, 310, 317, 311, 314, 312, 313, 16, 17, 18,
-	19, 315, 316, 20, 21, 22, 23, 318, 321, 319, 320, 24, 25, 26, 27, 322, 323,
-	28, 29, 30, 31, 325, 332, 326, 329, 327, 328, 32, 33, 34, 35, 330, 331, 36,
-	37, 38, 39, 333, 336, 334, 335, 40, 41, 42, 43, 337, 338, 44, 45, 46, 47,
-	340, 355, 341, 348, 342, 345, 343, 344, 48, 49, 50, 51, 346, 347, 52, 53,
-	54, 55, 349, 352, 350, 351, 56, 57, 58, 59, 353, 354, 60, 61, 62, 63, 356,
-	363, 357, 360, 358, 359, 64, 65, 66, 67, 361, 362, 68, 69, 70, 71, 364,
-	367, 365, 366, 72, 73, 74, 75, 368, 369, 76, 77, 78, 79, 371, 434, 372,
-	403, 373, 388, 374, 381, 375, 378, 376, 377, 80, 81, 82, 83, 379, 380, 84,
-	85, 86, 87, 382, 385, 383, 384, 88, 89, 90, 91, 386, 387, 92, 93, 94, 95,
-	389, 396, 390, 393, 391, 392, 96, 97, 98, 99, 394, 395, 100, 101, 102, 103,
-	397, 400, 398, 399, 104, 105, 106, 107, 401, 402, 108, 109, 110, 111, 404,
-	419, 405, 412, 406, 409, 407, 408, 112, 113, 114, 115, 410, 411, 116, 117,
-	118, 119, 413, 416, 414, 415, 120, 121, 122, 123, 417, 418, 124, 125, 126,
-	127, 420, 427, 421, 424, 422, 423, 128, 129, 130, 131, 425, 426, 132, 133,
-	134, 135, 428, 431, 429, 430, 136, 137, 138, 139, 432, 433, 140, 141, 142,
-	143, 435, 483, 436, 452, 568, 437, 438, 445, 439, 442, 440, 441, 144, 145,
-	146, 147, 443, 444, 148, 149, 150, 151, 446, 449, 447, 448, 152, 153, 154,
-	155, 450, 451, 156, 157, 158, 159, 453, 468, 454, 461, 455, 458, 456, 457,
-	160, 161, 162, 163, 459, 460, 164, 165, 166, 167, 462, 465, 463, 464, 168,
-	169, 170, 171, 466, 467, 172, 173, 174, 175, 469, 476, 470, 473, 471, 472,
-	176, 177, 178, 179, 474, 475, 180, 181, 182, 183, 477, 480, 478, 479, 184,
-	185, 186, 187, 481, 482, 188, 189, 190, 191, 484, 515, 485, 500, 486, 493,
-	487, 490, 488, 489, 192, 193, 194, 195, 491, 492, 196, 197, 198, 199, 494,
-	497, 495, 496, 200, 201, 202, 203, 498, 499, 204, 205, 206, 207, 501, 508,
-	502, 505, 503, 504, 208, 209, 210, 211, 506, 507, 212, 213, 214, 215, 509,
-	512, 510, 511, 216, 217, 218, 219, 513, 514, 220, 221, 222, 223, 516, 531,
-	517, 524, 518, 521, 519, 520, 224, 225, 226, 227, 522, 523, 228, 229, 230,
-	231, 525, 528, 526, 527, 232, 233, 234, 235, 529, 530, 236, 237, 238, 239,
-	532, 539, 533, 536, 534, 535, 240, 241, 242, 243, 537, 538, 244, 245, 246,
-	247, 540, 543, 541, 542, 248, 249, 250, 251, 544, 545, 252, 253, 254, 255,
-	547, 554, 548, 551, 549, 550, 256, 257, 258, 259, 552, 553, 260, 261, 262,
-	263, 555, 558, 556, 557, 264, 265, 266, 267, 559, 560, 268, 269, 270, 271,
-	562, 565, 563, 564, 272, 273, 274, 275, 566, 567, 276, 277, 278, 279, 569,
-	572, 570, 571, 280, 281, 282, 283, 573, 574, 284, 285, 286, 287, 0, 0
-};
+#define ARENA_ALIGN(size) (((size) + 7) & ~7UL)
 
-static const unsigned FIXED_DISTANCE_TREE[NUM_DISTANCE_SYMBOLS * 2] = {
-	33, 48, 34, 41, 35, 38, 36, 37, 0, 1, 2, 3, 39, 40, 4, 5, 6, 7, 42, 45, 43,
-	44, 8, 9, 10, 11, 46, 47, 12, 13, 14, 15, 49, 56, 50, 53, 51, 52, 16, 17,
-	18, 19, 54, 55, 20, 21, 22, 23, 57, 60, 58, 59, 24, 25, 26, 27, 61, 62, 28,
-	29, 30, 31, 0, 0
-};
+/* allocate memory from the arena (or the heap if there's no arena) */
+static void* arena_alloc(upng_t* upng, unsigned long size)
+{
+	upng_arena *arena = &upng->arena;
+	void *ptr;
+
+	size = ARENA_ALIGN(size);
+	if (arena->buffer != NULL) {
+		if (size > arena->size - arena->used) {
+			return NULL;
+		}
+		ptr = arena->buffer + arena->used;
+	} else {
+		ptr = malloc(size);
+		if (ptr == NULL) {
+			return NULL;
+		}
+	}
 
-static unsigned char read_bit(unsigned long *bitpointer, const unsigned char *bitstream)
+	arena->used += size;
+	if (arena->used > arena->peak) {
+		arena->peak = arena->used;
+	}
+	return ptr;
+}
+
+/* release memory, allocations must be released in reverse order */
+static void arena_free(upng_t* upng, void* ptr, unsigned long size)
 {
-	unsigned char result = (unsigned char)((bitstream[(*bitpointer) >> 3] >> ((*bitpointer) & 0x7)) & 1);
-	(*bitpointer)++;
-	return result;
+	upng_arena *arena = &upng->arena;
+
+	if (ptr == NULL) {
+		return;
+	}
+	if (arena->buffer == NULL) {
+		free(ptr);
+	}
+	arena->used -= ARENA_ALIGN(size);
 }
 
-static unsigned read_bits(unsigned long *bitpointer, const unsigned char *bitstream, unsigned long nbits)
+/* size of the sliding window, scanlines and decoding tables needed for decoding */
+static unsigned long scratch_size(unsigned long wsize, unsigned long linebytes)
 {
-	unsigned result = 0, i;
-	for (i = 0; i < nbits; i++)
-		result |= ((unsigned)read_bit(bitpointer, bitstream)) << i;
-	return result;
+	return (3 * sizeof(huffman_tree)) + wsize + (2 * (linebytes + 1));
 }
 
-/* the buffer must be numcodes*2 in size! */
-static void huffman_tree_init(huffman_tree* tree, unsigned* buffer, unsigned numcodes, unsigned maxbitlen)
+/* read bytes from the source into the input buffer, returns the next byte */
+static unsigned char read_source_byte(upng_t* upng)
 {
-	tree->tree2d = buffer;
+	upng_stream *stream = &upng->stream;
+	if (stream->inpos >= stream->inlen) {
+		stream->inpos = 0;
+		stream->inlen = upng->source.read(upng->source.user, stream->inbuf, sizeof(stream->inbuf));
+		if (stream->inlen == 0) {
+			SET_ERROR(upng, UPNG_EMALFORMED);
+			return 0;
+		}
+	}
+	return stream->inbuf[stream->inpos++];
+}
 
-	tree->numcodes = numcodes;
-	tree->maxbitlen = maxbitlen;
+static unsigned long read_source_dword(upng_t* upng)
+{
+	unsigned long result = 0;
+	unsigned i;
+	for (i = 0; i < 4; i++) {
+		result = (result << 8) | read_source_byte(upng);
+	}
+	return result;
 }
 
-/*given the code lengths (as stored in the PNG file), generate the tree as defined by Deflate. maxbitlen is the maximum bits that a code in the tree can have. return value is error.*/
-static void huffman_tree_create_lengths(upng_t* upng, huffman_tree* tree, const unsigned *bitlen)
+/* read the PLTE chunk data and CRC */
+static void read_palette(upng_t* upng, unsigned long length)
 {
-	unsigned tree1d[MAX_SYMBOLS];
-	unsigned blcount[MAX_BIT_LENGTH];
-	unsigned nextcode[MAX_BIT_LENGTH+1];
-	unsigned bits, n, i;
-	unsigned nodefilled = 0;	/*up to which node it is filled */
-	unsigned treepos = 0;	/*position in the tree (1 of the numcodes columns) */
+	unsigned long i;
 
-	/* initialize local vectors */
-	memset(blcount, 0, sizeof(blcount));
-	memset(nextcode, 0, sizeof(nextcode));
+	if ((length == 0) || (length > sizeof(upng->palette)) || ((length % 3) != 0)) {
+		SET_ERROR(upng, UPNG_EMALFORMED);
+		return;
+	}
 
-	/*step 1: count number of instances of each code length */
-	for (bits = 0; bits < tree->numcodes; bits++) {
-		blcount[bitlen[bits]]++;
+	for (i = 0; i < length; i++) {
+		upng->palette[i] = read_source_byte(upng);
 	}
+	upng->palette_size = length / 3;
 
-	/*step 2: generate the nextcode values */
-	for (bits = 1; bits <= tree->maxbitlen; bits++) {
-		nextcode[bits] = (nextcode[bits - 1] + blcount[bits - 1]) << 1;
+	read_source_dword(upng);
+}
+
+/* walk the chunks until the next IDAT chunk, skipping (ancillary) chunks */
+static void read_next_idat(upng_t* upng)
+{
+	upng_stream *stream = &upng->stream;
+
+	/* skip CRC of previous IDAT chunk */
+	if (stream->in_idat) {
+		read_source_dword(upng);
+		stream->in_idat = 0;
 	}
 
-	/*step 3: generate all the codes */
-	for (n = 0; n < tree->numcodes; n++) {
-		if (bitlen[n] != 0) {
-			tree1d[n] = nextcode[bitlen[n]]++;
+	while (upng->error == UPNG_EOK) {
+		unsigned long length = read_source_dword(upng);
+		unsigned long type = read_source_dword(upng);
+		if (upng->error != UPNG_EOK) {
+			return;
 		}
-	}
 
-	/*convert tree1d[] to tree2d[][]. In the 2D array, a value of 32767 means uninited, a value >= numcodes is an address to another bit, a value < numcodes is a code. The 2 rows are the 2 possible bit values (0 or 1), there are as many columns as codes - 1
-	   a good huffmann tree has N * 2 - 1 nodes, of which N - 1 are internal nodes. Here, the internal nodes are stored (what their 0 and 1 option point to). There is only memory for such good tree currently, if there are more nodes (due to too long length codes), error 55 will happen */
-	for (n = 0; n < tree->numcodes * 2; n++) {
-		tree->tree2d[n] = 32767;	/*32767 here means the tree2d isn't filled there yet */
-	}
+		if (length > INT_MAX) {
+			SET_ERROR(upng, UPNG_EMALFORMED);
+			return;
+		}
 
-	for (n = 0; n < tree->numcodes; n++) {	/*the codes */
-		for (i = 0; i < bitlen[n]; i++) {	/*the bits for this code */
-			unsigned char bit = (unsigned char)((tree1d[n] >> (bitlen[n] - i - 1)) & 1);
-			/* check if oversubscribed */
-			if (treepos > tree->numcodes - 2) {
+		if (type == CHUNK_IDAT) {
+			if ((upng->color_type == UPNG_PAL) && (upng->palette_size == 0)) {
 				SET_ERROR(upng, UPNG_EMALFORMED);
 				return;
 			}
-
-			if (tree->tree2d[2 * treepos + bit] == 32767) {	/*not yet filled in */
-				if (i + 1 == bitlen[n]) {	/*last bit */
-					tree->tree2d[2 * treepos + bit] = n;	/*put the current code in it */
-					treepos = 0;
-				} else {	/*put address of the next step in here, first that address has to be found of course (it's just nodefilled + 1)... */
-					nodefilled++;
-					tree->tree2d[2 * treepos + bit] = nodefilled + tree->numcodes;	/*addresses encoded with numcodes added to it */
-					treepos = nodefilled;
-				}
-			} else {
-				treepos = tree->tree2d[2 * treepos + bit] - tree->numcodes;
-			}
+			stream->chunk_left = length;
+			stream->in_idat = 1;
+			return;
+		} else if (type == CHUNK_IEND) {
+			/* end of image data before end of compressed stream */
+			SET_ERROR(upng, UPNG_EMALFORMED);
+			return;
+		} else if (type == CHUNK_PLTE) {
+			read_palette(upng, length);
+			continue;
+		} else if (upng_chunk_critical(type)) {
+			SET_ERROR(upng, UPNG_EUNSUPPORTED);
+			return;
 		}
-	}
 
-	for (n = 0; n < tree->numcodes * 2; n++) {
-		if (tree->tree2d[n] == 32767) {
-			tree->tree2d[n] = 0;	/*remove possible remaining 32767's */
+		/* skip chunk data and CRC */
+		length += 4;
+		while ((length > 0) && (upng->error == UPNG_EOK)) {
+			read_source_byte(upng);
+			length--;
 		}
 	}
 }
 
-static unsigned huffman_decode_symbol(upng_t *upng, const unsigned char *in, unsigned long *bp, const huffman_tree* codetree, unsigned long inlength)
+/* get next byte of the compressed data (the concatenated IDAT chunks payload) */
+static unsigned char read_byte(upng_t* upng)
 {
-	unsigned treepos = 0, ct;
-	unsigned char bit;
-	for (;;) {
-		/* error: end of input memory reached without endcode */
-		if (((*bp) & 0x07) == 0 && ((*bp) >> 3) > inlength) {
-			SET_ERROR(upng, UPNG_EMALFORMED);
+	upng_stream *stream = &upng->stream;
+	while (stream->chunk_left == 0) {
+		if (upng->error != UPNG_EOK) {
 			return 0;
 		}
+		read_next_idat(upng);
+		if (stream->in_idat && (stream->chunk_left == 0)) {
+			continue; /* empty IDAT chunk */
+		}
+	}
+	stream->chunk_left--;
+	return read_source_byte(upng);
+}
 
-		bit = read_bit(bp, in);
+/* make sure there are at least 25 bits in the bit buffer, more than the longest code or the longest run of extra bits;
+ * as the deflate data is always followed by the adler32 checksum this never reads past the end of the zlib stream */
+static void fill_bits(upng_t* upng)
+{
+	upng_stream *stream = &upng->stream;
+	while (stream->bitcnt <= 24) {
+		stream->bitbuf |= (unsigned long)read_byte(upng) << stream->bitcnt;
+		stream->bitcnt += 8;
+	}
+}
 
-		ct = codetree->tree2d[(treepos << 1) | bit];
-		if (ct < codetree->numcodes) {
-			return ct;
-		}
+static unsigned read_bits(upng_t* upng, unsigned nbits)
+{
+	upng_stream *stream = &upng->stream;
+	unsigned result;
+	if (stream->bitcnt < nbits) {
+		fill_bits(upng);
+	}
+	result = (unsigned)(stream->bitbuf & ((1UL << nbits) - 1));
+	stream->bitbuf >>= nbits;
+	stream->bitcnt -= nbits;
+	return result;
+}
+
+static unsigned bit_reverse(unsigned code, unsigned nbits)
+{
+	unsigned result = 0, i;
+	for (i = 0; i < nbits; i++) {
+		result = (result << 1) | (code & 1);
+		code >>= 1;
+	}
+	return result;
+}
 
-		treepos = ct - codetree->numcodes;
-		if (treepos >= codetree->numcodes) {
+/*given the code lengths (as stored in the PNG file), generate the decoding tables as defined by Deflate*/
+static void huffman_tree_create_lengths(upng_t* upng, huffman_tree* tree, const unsigned *bitlen, unsigned numcodes)
+{
+	unsigned blcount[MAX_BIT_LENGTH + 1];
+	unsigned nextcode[MAX_BIT_LENGTH + 1];
+	unsigned bits, n, code, symbol;
+
+	/* initialize local vectors */
+	memset(blcount, 0, sizeof(blcount));
+	memset(tree->fast, 0, sizeof(tree->fast));
+
+	/*step 1: count number of instances of each code length */
+	for (n = 0; n < numcodes; n++) {
+		blcount[bitlen[n]]++;
+	}
+	blcount[0] = 0;
+
+	/*step 2: generate the first code of each length, checking that the codes are not oversubscribed */
+	code = 0;
+	symbol = 0;
+	for (bits = 1; bits <= MAX_BIT_LENGTH; bits++) {
+		nextcode[bits] = code;
+		tree->firstcode[bits] = (unsigned short)code;
+		tree->firstsymbol[bits] = (unsigned short)symbol;
+		code += blcount[bits];
+		if (blcount[bits] != 0 && code > (1U << bits)) {
 			SET_ERROR(upng, UPNG_EMALFORMED);
-			return 0;
+			return;
+		}
+		tree->maxcode[bits] = code << (16 - bits);
+		code <<= 1;
+		symbol += blcount[bits];
+	}
+	tree->maxcode[MAX_BIT_LENGTH + 1] = 0x10000;
+
+	/*step 3: assign the codes, and put the short ones into the fast lookup table (with the bits reversed, as they
+	  appear in the bitstream) */
+	for (n = 0; n < numcodes; n++) {
+		bits = bitlen[n];
+		if (bits != 0) {
+			code = nextcode[bits]++;
+			tree->value[tree->firstsymbol[bits] + code - tree->firstcode[bits]] = (unsigned short)n;
+			if (bits <= HUFFMAN_FAST_BITS) {
+				unsigned ix = bit_reverse(code, bits);
+				while (ix < (1 << HUFFMAN_FAST_BITS)) {
+					tree->fast[ix] = (unsigned short)((bits << 9) | n);
+					ix += (1 << bits);
+				}
+			}
 		}
 	}
 }
 
+static unsigned huffman_decode_symbol(upng_t *upng, const huffman_tree* codetree)
+{
+	upng_stream *stream = &upng->stream;
+	unsigned entry, code, bits, ix;
+
+	if (stream->bitcnt < 16) {
+		fill_bits(upng);
+	}
+
+	/* short code: single table lookup */
+	entry = codetree->fast[stream->bitbuf & HUFFMAN_FAST_MASK];
+	if (entry != 0) {
+		bits = entry >> 9;
+		stream->bitbuf >>= bits;
+		stream->bitcnt -= bits;
+		return entry & 511;
+	}
+
+	/* long code: find its length by comparing against the first code that is too long for each length */
+	code = bit_reverse((unsigned)(stream->bitbuf & 0xffff), 16);
+	for (bits = HUFFMAN_FAST_BITS + 1; code >= codetree->maxcode[bits]; bits++) {
+	}
+
+	/* error: invalid code */
+	if (bits > MAX_BIT_LENGTH) {
+		SET_ERROR(upng, UPNG_EMALFORMED);
+		return 0;
+	}
+
+	ix = codetree->firstsymbol[bits] + (code >> (16 - bits)) - codetree->firstcode[bits];
+	if (ix >= MAX_SYMBOLS) {
+		SET_ERROR(upng, UPNG_EMALFORMED);
+		return 0;
+	}
+	stream->bitbuf >>= bits;
+	stream->bitcnt -= bits;
+	return codetree->value[ix];
+}
+
 /* get the tree of a deflated block with dynamic tree, the tree itself is also Huffman compressed with a known tree*/
-static void get_tree_inflate_dynamic(upng_t* upng, huffman_tree* codetree, huffman_tree* codetreeD, huffman_tree* codelengthcodetree, const unsigned char *in, unsigned long *bp, unsigned long inlength)
+static void get_tree_inflate_dynamic(upng_t* upng, huffman_tree* codetree, huffman_tree* codetreeD, huffman_tree* codelengthcodetree)
 {
 	unsigned codelengthcode[NUM_CODE_LENGTH_CODES];
 	unsigned bitlen[NUM_DEFLATE_CODE_SYMBOLS];
 	unsigned bitlenD[NUM_DISTANCE_SYMBOLS];
 	unsigned n, hlit, hdist, hclen, i;
 
-	/*make sure that length values that aren't filled in will be 0, or a wrong tree will be generated */
-	/*C-code note: use no "return" between ctor and dtor of an uivector! */
-	if ((*bp) >> 3 >= inlength - 2) {
-		SET_ERROR(upng, UPNG_EMALFORMED);
-		return;
-	}
-
-	/* clear bitlen arrays */
+	/* clear bitlen arrays (make sure that length values that aren't filled in will be 0, or a wrong tree will be generated) */
 	memset(bitlen, 0, sizeof(bitlen));
 	memset(bitlenD, 0, sizeof(bitlenD));
 
-	/*the bit pointer is or will go past the memory */
-	hlit = read_bits(bp, in, 5) + 257;	/*number of literal/length codes + 257. Unlike the spec, the value 257 is added to it here already */
-	hdist = read_bits(bp, in, 5) + 1;	/*number of distance codes. Unlike the spec, the value 1 is added to it here already */
-	hclen = read_bits(bp, in, 4) + 4;	/*number of code length codes. Unlike the spec, the value 4 is added to it here already */
+	hlit = read_bits(upng, 5) + 257;	/*number of literal/length codes + 257. Unlike the spec, the value 257 is added to it here already */
+	hdist = read_bits(upng, 5) + 1;	/*number of distance codes. Unlike the spec, the value 1 is added to it here already */
+	hclen = read_bits(upng, 4) + 4;	/*number of code length codes. Unlike the spec, the value 4 is added to it here already */
 
 	for (i = 0; i < NUM_CODE_LENGTH_CODES; i++) {
 		if (i < hclen) {
-			codelengthcode[CLCL[i]] = read_bits(bp, in, 3);
+			codelengthcode[CLCL[i]] = read_bits(upng, 3);
 		} else {
 			codelengthcode[CLCL[i]] = 0;	/*if not, it must stay 0 */
 		}
 	}
 
-	huffman_tree_create_lengths(upng, codelengthcodetree, codelengthcode);
+	/* bail now if we ran out of input */
+	if (upng->error != UPNG_EOK) {
+		return;
+	}
+
+	huffman_tree_create_lengths(upng, codelengthcodetree, codelengthcode, NUM_CODE_LENGTH_CODES);
 
 	/* bail now if we encountered an error earlier */
 	if (upng->error != UPNG_EOK) {
@@ -336,7 +496,7 @@ static void get_tree_inflate_dynamic(upng_t* upng, huffman_tree* codetree, huffm
 	/*now we can use this tree to read the lengths for the tree that this function will return */
 	i = 0;
 	while (i < hlit + hdist) {	/*i is the current symbol we're reading in the part that contains the code lengths of lit/len codes and dist codes */
-		unsigned code = huffman_decode_symbol(upng, in, bp, codelengthcodetree, inlength);
+		unsigned code = huffman_decode_symbol(upng, codelengthcodetree);
 		if (upng->error != UPNG_EOK) {
 			break;
 		}
@@ -352,12 +512,13 @@ static void get_tree_inflate_dynamic(upng_t* upng, huffman_tree* codetree, huffm
 			unsigned replength = 3;	/*read in the 2 bits that indicate repeat length (3-6) */
 			unsigned value;	/*set value to the previous code */
 
-			if ((*bp) >> 3 >= inlength) {
+			replength += read_bits(upng, 2);
+
+			/* there is no previous value */
+			if (i == 0) {
 				SET_ERROR(upng, UPNG_EMALFORMED);
 				break;
 			}
-			/*error, bit pointer jumps past memory */
-			replength += read_bits(bp, in, 2);
 
 			if ((i - 1) < hlit) {
 				value = bitlen[i - 1];
@@ -382,13 +543,8 @@ static void get_tree_inflate_dynamic(upng_t* upng, huffman_tree* codetree, huffm
 			}
 		} else if (code == 17) {	/*repeat "0" 3-10 times */
 			unsigned replength = 3;	/*read in the bits that indicate repeat length */
-			if ((*bp) >> 3 >= inlength) {
-				SET_ERROR(upng, UPNG_EMALFORMED);
-				break;
-			}
 
-			/*error, bit pointer jumps past memory */
-			replength += read_bits(bp, in, 3);
+			replength += read_bits(upng, 3);
 
 			/*repeat this value in the next lengths */
 			for (n = 0; n < replength; n++) {
@@ -408,12 +564,8 @@ static void get_tree_inflate_dynamic(upng_t* upng, huffman_tree* codetree, huffm
 		} else if (code == 18) {	/*repeat "0" 11-138 times */
 			unsigned replength = 11;	/*read in the bits that indicate repeat length */
 			/* error, bit pointer jumps past memory */
-			if ((*bp) >> 3 >= inlength) {
-				SET_ERROR(upng, UPNG_EMALFORMED);
-				break;
-			}
 
-			replength += read_bits(bp, in, 7);
+			replength += read_bits(upng, 7);
 
 			/*repeat this value in the next lengths */
 			for (n = 0; n < replength; n++) {
@@ -442,40 +594,219 @@ static void get_tree_inflate_dynamic(upng_t* upng, huffman_tree* codetree, huffm
 	/*the length of the end code 256 must be larger than 0 */
 	/*now we've finally got hlit and hdist, so generate the code trees, and the function is done */
 	if (upng->error == UPNG_EOK) {
-		huffman_tree_create_lengths(upng, codetree, bitlen);
+		huffman_tree_create_lengths(upng, codetree, bitlen, NUM_DEFLATE_CODE_SYMBOLS);
 	}
 	if (upng->error == UPNG_EOK) {
-		huffman_tree_create_lengths(upng, codetreeD, bitlenD);
+		huffman_tree_create_lengths(upng, codetreeD, bitlenD, NUM_DISTANCE_SYMBOLS);
+	}
+}
+
+/*Paeth predicter, used by PNG filter type 4*/
+static int paeth_predictor(int a, int b, int c)
+{
+	int p = a + b - c;
+	int pa = p > a ? p - a : a - p;
+	int pb = p > b ? p - b : b - p;
+	int pc = p > c ? p - c : c - p;
+
+	if (pa <= pb && pa <= pc)
+		return a;
+	else if (pb <= pc)
+		return b;
+	else
+		return c;
+}
+
+static void unfilter_scanline(upng_t* upng, unsigned char *recon, const unsigned char *scanline, const unsigned char *precon, unsigned long bytewidth, unsigned char filterType, unsigned long length)
+{
+	/*
+	   For PNG filter method 0
+	   unfilter a PNG image scanline by scanline. when the pixels are smaller than 1 byte, the filter works byte per byte (bytewidth = 1)
+	   precon is the previous unfiltered scanline, recon the result, scanline the current one
+	   the incoming scanlines do NOT include the filtertype byte, that one is given in the parameter filterType instead
+	   recon and scanline MAY be the same memory address! precon must be disjoint.
+	 */
+
+	unsigned long i;
+	switch (filterType) {
+	case 0:
+		for (i = 0; i < length; i++)
+			recon[i] = scanline[i];
+		break;
+	case 1:
+		for (i = 0; i < bytewidth; i++)
+			recon[i] = scanline[i];
+		for (i = bytewidth; i < length; i++)
+			recon[i] = scanline[i] + recon[i - bytewidth];
+		break;
+	case 2:
+		if (precon)
+			for (i = 0; i < length; i++)
+				recon[i] = scanline[i] + precon[i];
+		else
+			for (i = 0; i < length; i++)
+				recon[i] = scanline[i];
+		break;
+	case 3:
+		if (precon) {
+			for (i = 0; i < bytewidth; i++)
+				recon[i] = scanline[i] + precon[i] / 2;
+			for (i = bytewidth; i < length; i++)
+				recon[i] = scanline[i] + ((recon[i - bytewidth] + precon[i]) / 2);
+		} else {
+			for (i = 0; i < bytewidth; i++)
+				recon[i] = scanline[i];
+			for (i = bytewidth; i < length; i++)
+				recon[i] = scanline[i] + recon[i - bytewidth] / 2;
+		}
+		break;
+	case 4:
+		if (precon) {
+			for (i = 0; i < bytewidth; i++)
+				recon[i] = (unsigned char)(scanline[i] + paeth_predictor(0, precon[i], 0));
+			for (i = bytewidth; i < length; i++)
+				recon[i] = (unsigned char)(scanline[i] + paeth_predictor(recon[i - bytewidth], precon[i], precon[i - bytewidth]));
+		} else {
+			for (i = 0; i < bytewidth; i++)
+				recon[i] = scanline[i];
+			for (i = bytewidth; i < length; i++)
+				recon[i] = (unsigned char)(scanline[i] + paeth_predictor(recon[i - bytewidth], 0, 0));
+		}
+		break;
+	default:
+		SET_ERROR(upng, UPNG_EMALFORMED);
+		break;
+	}
+}
+
+/* unfilter and output the completed scanline */
+static void write_line(upng_t* upng)
+{
+	upng_stream *stream = &upng->stream;
+	unsigned char *line = stream->line;
+
+	/* the first byte is the filter type */
+	unfilter_scanline(upng, &line[1], &line[1], stream->y > 0 ? &stream->prevline[1] : NULL, stream->bytewidth, line[0], stream->linebytes);
+	if (upng->error != UPNG_EOK) {
+		return;
+	}
+
+	stream->row(stream->row_user, stream->y, &line[1], stream->linebytes);
+
+	stream->line = stream->prevline;
+	stream->prevline = line;
+	stream->linepos = 0;
+	stream->y++;
+}
+
+/* store an inflated byte: append it to the sliding window and to the current scanline */
+static void write_byte(upng_t* upng, unsigned char byte)
+{
+	upng_stream *stream = &upng->stream;
+
+	/* more data than the image has */
+	if (stream->wpos >= stream->wtotal) {
+		SET_ERROR(upng, UPNG_EMALFORMED);
+		return;
+	}
+
+	stream->window[stream->wdst++] = byte;
+	if (stream->wdst >= stream->wsize) {
+		stream->wdst = 0;
+	}
+	stream->wpos++;
+
+	stream->line[stream->linepos++] = byte;
+	if (stream->linepos > stream->linebytes) {
+		write_line(upng);
+	}
+}
+
+/* copy length bytes from distance bytes back in the window, in runs up to the end of the current scanline */
+static void copy_bytes(upng_t* upng, unsigned long distance, unsigned long length)
+{
+	upng_stream *stream = &upng->stream;
+	unsigned char *window = stream->window;
+	const unsigned long wsize = stream->wsize;
+
+	while ((length > 0) && (upng->error == UPNG_EOK)) {
+		unsigned char *line = &stream->line[stream->linepos];
+		unsigned long dst = stream->wdst;
+		unsigned long src = dst >= distance ? dst - distance : dst + wsize - distance;
+		unsigned long n = stream->linebytes + 1 - stream->linepos, i;
+		if (n > length) {
+			n = length;
+		}
+
+		if ((src + n <= wsize) && (dst + n <= wsize)) {
+			/* no wrap-around in the window; the source can still be right after (or at) the destination if it
+			 * was taken from the end of the ring, that is fine for memmove() but not for memcpy() */
+			if (distance >= n) {
+				memmove(&window[dst], &window[src], n);
+			} else {
+				for (i = 0; i < n; i++) {
+					window[dst + i] = window[src + i];
+				}
+			}
+			memcpy(line, &window[dst], n);
+			dst += n;
+			if (dst >= wsize) {
+				dst = 0;
+			}
+		} else {
+			for (i = 0; i < n; i++) {
+				unsigned char byte = window[src++];
+				if (src >= wsize) {
+					src = 0;
+				}
+				window[dst++] = byte;
+				if (dst >= wsize) {
+					dst = 0;
+				}
+				line[i] = byte;
+			}
+		}
+
+		stream->wdst = dst;
+		stream->wpos += n;
+		stream->linepos += n;
+		length -= n;
+		if (stream->linepos > stream->linebytes) {
+			write_line(upng);
+		}
 	}
 }
 
 /*inflate a block with dynamic of fixed Huffman tree*/
-static void inflate_huffman(upng_t* upng, unsigned char* out, unsigned long outsize, const unsigned char *in, unsigned long *bp, unsigned long *pos, unsigned long inlength, unsigned btype)
+static void inflate_huffman(upng_t* upng, unsigned btype)
 {
-	unsigned codetree_buffer[DEFLATE_CODE_BUFFER_SIZE];
-	unsigned codetreeD_buffer[DISTANCE_BUFFER_SIZE];
+	upng_stream *stream = &upng->stream;
+	huffman_tree* codetree = stream->codetree;
+	huffman_tree* codetreeD = stream->codetreeD;
 	unsigned done = 0;
 
-	huffman_tree codetree;
-	huffman_tree codetreeD;
-
 	if (btype == 1) {
 		/* fixed trees */
-		huffman_tree_init(&codetree, (unsigned*)FIXED_DEFLATE_CODE_TREE, NUM_DEFLATE_CODE_SYMBOLS, DEFLATE_CODE_BITLEN);
-		huffman_tree_init(&codetreeD, (unsigned*)FIXED_DISTANCE_TREE, NUM_DISTANCE_SYMBOLS, DISTANCE_BITLEN);
+		unsigned bitlen[NUM_DEFLATE_CODE_SYMBOLS];
+		unsigned n;
+		for (n = 0; n < NUM_DEFLATE_CODE_SYMBOLS; n++) {
+			bitlen[n] = n <= 143 ? 8 : (n <= 255 ? 9 : (n <= 279 ? 7 : 8));
+		}
+		huffman_tree_create_lengths(upng, codetree, bitlen, NUM_DEFLATE_CODE_SYMBOLS);
+		for (n = 0; n < NUM_DISTANCE_SYMBOLS; n++) {
+			bitlen[n] = 5;
+		}
+		huffman_tree_create_lengths(upng, codetreeD, bitlen, NUM_DISTANCE_SYMBOLS);
 	} else if (btype == 2) {
 		/* dynamic trees */
-		unsigned codelengthcodetree_buffer[CODE_LENGTH_BUFFER_SIZE];
-		huffman_tree codelengthcodetree;
-
-		huffman_tree_init(&codetree, codetree_buffer, NUM_DEFLATE_CODE_SYMBOLS, DEFLATE_CODE_BITLEN);
-		huffman_tree_init(&codetreeD, codetreeD_buffer, NUM_DISTANCE_SYMBOLS, DISTANCE_BITLEN);
-		huffman_tree_init(&codelengthcodetree, codelengthcodetree_buffer, NUM_CODE_LENGTH_CODES, CODE_LENGTH_BITLEN);
-		get_tree_inflate_dynamic(upng, &codetree, &codetreeD, &codelengthcodetree, in, bp, inlength);
+		get_tree_inflate_dynamic(upng, codetree, codetreeD, stream->codelengthcodetree);
+		if (upng->error != UPNG_EOK) {
+			return;
+		}
 	}
 
 	while (done == 0) {
-		unsigned code = huffman_decode_symbol(upng, in, bp, &codetree, inlength);
+		unsigned code = huffman_decode_symbol(upng, codetree);
 		if (upng->error != UPNG_EOK) {
 			return;
 		}
@@ -485,31 +816,22 @@ static void inflate_huffman(upng_t* upng, unsigned char* out, unsigned long outs
 			done = 1;
 		} else if (code <= 255) {
 			/* literal symbol */
-			if ((*pos) >= outsize) {
-				SET_ERROR(upng, UPNG_EMALFORMED);
+			write_byte(upng, (unsigned char)(code));
+			if (upng->error != UPNG_EOK) {
 				return;
 			}
-
-			/* store output */
-			out[(*pos)++] = (unsigned char)(code);
 		} else if (code >= FIRST_LENGTH_CODE_INDEX && code <= LAST_LENGTH_CODE_INDEX) {	/*length code */
 			/* part 1: get length base */
 			unsigned long length = LENGTH_BASE[code - FIRST_LENGTH_CODE_INDEX];
 			unsigned codeD, distance, numextrabitsD;
-			unsigned long start, forward, backward, numextrabits;
+			unsigned long numextrabits;
 
 			/* part 2: get extra bits and add the value of that to length */
 			numextrabits = LENGTH_EXTRA[code - FIRST_LENGTH_CODE_INDEX];
-
-			/* error, bit pointer will jump past memory */
-			if (((*bp) >> 3) >= inlength) {
-				SET_ERROR(upng, UPNG_EMALFORMED);
-				return;
-			}
-			length += read_bits(bp, in, numextrabits);
+			length += read_bits(upng, numextrabits);
 
 			/*part 3: get distance code */
-			codeD = huffman_decode_symbol(upng, in, bp, &codetreeD, inlength);
+			codeD = huffman_decode_symbol(upng, codetreeD);
 			if (upng->error != UPNG_EOK) {
 				return;
 			}
@@ -524,111 +846,85 @@ static void inflate_huffman(upng_t* upng, unsigned char* out, unsigned long outs
 
 			/*part 4: get extra bits from distance */
 			numextrabitsD = DISTANCE_EXTRA[codeD];
-
-			/* error, bit pointer will jump past memory */
-			if (((*bp) >> 3) >= inlength) {
-				SET_ERROR(upng, UPNG_EMALFORMED);
+			distance += read_bits(upng, numextrabitsD);
+			if (upng->error != UPNG_EOK) {
 				return;
 			}
 
-			distance += read_bits(bp, in, numextrabitsD);
-
-			/*part 5: fill in all the out[n] values based on the length and dist */
-			start = (*pos);
-			backward = start - distance;
-
-			if ((*pos) + length >= outsize) {
+			/* distance goes back before the start of the data or beyond the window, or length goes past the end of the image */
+			if (distance > stream->wpos || distance > stream->wsize || stream->wpos + length > stream->wtotal) {
 				SET_ERROR(upng, UPNG_EMALFORMED);
 				return;
 			}
 
-			for (forward = 0; forward < length; forward++) {
-				out[(*pos)++] = out[backward];
-				backward++;
-
-				if (backward >= start) {
-					backward = start - distance;
-				}
+			/*part 5: copy length bytes from distance bytes back in the window */
+			copy_bytes(upng, distance, length);
+			if (upng->error != UPNG_EOK) {
+				return;
 			}
+		} else {
+			/* invalid length code (286-287 are never used) */
+			SET_ERROR(upng, UPNG_EMALFORMED);
+			return;
 		}
 	}
 }
 
-static void inflate_uncompressed(upng_t* upng, unsigned char* out, unsigned long outsize, const unsigned char *in, unsigned long *bp, unsigned long *pos, unsigned long inlength)
+static void inflate_uncompressed(upng_t* upng)
 {
-	unsigned long p;
+	upng_stream *stream = &upng->stream;
 	unsigned len, nlen, n;
 
 	/* go to first boundary of byte */
-	while (((*bp) & 0x7) != 0) {
-		(*bp)++;
-	}
-	p = (*bp) / 8;		/*byte position */
+	read_bits(upng, stream->bitcnt & 0x7);
 
 	/* read len (2 bytes) and nlen (2 bytes) */
-	if (p >= inlength - 4) {
-		SET_ERROR(upng, UPNG_EMALFORMED);
+	len = read_bits(upng, 16);
+	nlen = read_bits(upng, 16);
+	if (upng->error != UPNG_EOK) {
 		return;
 	}
 
-	len = in[p] + 256 * in[p + 1];
-	p += 2;
-	nlen = in[p] + 256 * in[p + 1];
-	p += 2;
-
 	/* check if 16-bit nlen is really the one's complement of len */
-	if (len + nlen != 65535) {
-		SET_ERROR(upng, UPNG_EMALFORMED);
-		return;
-	}
-
-	if ((*pos) + len >= outsize) {
+	if (len + nlen != 65535) {
 		SET_ERROR(upng, UPNG_EMALFORMED);
 		return;
 	}
 
-	/* read the literal data: len bytes are now stored in the out buffer */
-	if (p + len > inlength) {
+	if (stream->wpos + len > stream->wtotal) {
 		SET_ERROR(upng, UPNG_EMALFORMED);
 		return;
 	}
 
-	for (n = 0; n < len; n++) {
-		out[(*pos)++] = in[p++];
+	/* read the literal data */
+	for (n = 0; (n < len) && (upng->error == UPNG_EOK); n++) {
+		write_byte(upng, (unsigned char)read_bits(upng, 8));
 	}
-
-	(*bp) = p * 8;
 }
 
 /*inflate the deflated data (cfr. deflate spec); return value is the error*/
-static upng_error uz_inflate_data(upng_t* upng, unsigned char* out, unsigned long outsize, const unsigned char *in, unsigned long insize, unsigned long inpos)
+static upng_error uz_inflate_data(upng_t* upng)
 {
-	unsigned long bp = 0;	/*bit pointer in the "in" data, current byte is bp >> 3, current bit is bp & 0x7 (from lsb to msb of the byte) */
-	unsigned long pos = 0;	/*byte position in the out buffer */
-
 	unsigned done = 0;
 
 	while (done == 0) {
 		unsigned btype;
 
-		/* ensure next bit doesn't point past the end of the buffer */
-		if ((bp >> 3) >= insize) {
-			SET_ERROR(upng, UPNG_EMALFORMED);
+		/* read block control bits */
+		done = read_bits(upng, 1);
+		btype = read_bits(upng, 2);
+		if (upng->error != UPNG_EOK) {
 			return upng->error;
 		}
 
-		/* read block control bits */
-		done = read_bit(&bp, &in[inpos]);
-		btype = read_bit(&bp, &in[inpos]) | (read_bit(&bp, &in[inpos]) << 1);
-
 		/* process control type appropriateyly */
 		if (btype == 3) {
 			SET_ERROR(upng, UPNG_EMALFORMED);
 			return upng->error;
 		} else if (btype == 0) {
-			inflate_uncompressed(upng, out, outsize, &in[inpos], &bp, &pos, insize);	/*no compression */
+			inflate_uncompressed(upng);	/*no compression */
 		} else {
-			inflate_huffman(upng, out, outsize, &in[inpos], &bp, &pos, insize, btype);	/*compression, btype 01 or 10 */
+			inflate_huffman(upng, btype);	/*compression, btype 01 or 10 */
 		}
 
 		/* stop if an error has occured */
@@ -640,193 +936,96 @@ static upng_error uz_inflate_data(upng_t* upng, unsigned char* out, unsigned lon
 	return upng->error;
 }
 
-static upng_error uz_inflate(upng_t* upng, unsigned char *out, unsigned long outsize, const unsigned char *in, unsigned long insize)
+static upng_error uz_inflate(upng_t* upng)
 {
-	/* we require two bytes for the zlib data header */
-	if (insize < 2) {
-		SET_ERROR(upng, UPNG_EMALFORMED);
+	upng_stream *stream = &upng->stream;
+	unsigned char cmf, flg;
+	unsigned long wsize, size;
+	unsigned char *buffer;
+
+	/* read the two bytes zlib data header */
+	cmf = read_byte(upng);
+	flg = read_byte(upng);
+	if (upng->error != UPNG_EOK) {
 		return upng->error;
 	}
 
-	/* 256 * in[0] + in[1] must be a multiple of 31, the FCHECK value is supposed to be made that way */
-	if ((in[0] * 256 + in[1]) % 31 != 0) {
+	/* 256 * cmf + flg must be a multiple of 31, the FCHECK value is supposed to be made that way */
+	if ((cmf * 256 + flg) % 31 != 0) {
 		SET_ERROR(upng, UPNG_EMALFORMED);
 		return upng->error;
 	}
 
 	/*error: only compression method 8: inflate with sliding window of 32k is supported by the PNG spec */
-	if ((in[0] & 15) != 8 || ((in[0] >> 4) & 15) > 7) {
+	if ((cmf & 15) != 8 || ((cmf >> 4) & 15) > 7) {
 		SET_ERROR(upng, UPNG_EMALFORMED);
 		return upng->error;
 	}
 
 	/* the specification of PNG says about the zlib stream: "The additional flags shall not specify a preset dictionary." */
-	if (((in[1] >> 5) & 1) != 0) {
+	if (((flg >> 5) & 1) != 0) {
 		SET_ERROR(upng, UPNG_EMALFORMED);
 		return upng->error;
 	}
 
-	/* create output buffer */
-	uz_inflate_data(upng, out, outsize, in, insize, 2);
-
-	return upng->error;
-}
-
-/*Paeth predicter, used by PNG filter type 4*/
-static int paeth_predictor(int a, int b, int c)
-{
-	int p = a + b - c;
-	int pa = p > a ? p - a : a - p;
-	int pb = p > b ? p - b : b - p;
-	int pc = p > c ? p - c : c - p;
-
-	if (pa <= pb && pa <= pc)
-		return a;
-	else if (pb <= pc)
-		return b;
-	else
-		return c;
-}
-
-static void unfilter_scanline(upng_t* upng, unsigned char *recon, const unsigned char *scanline, const unsigned char *precon, unsigned long bytewidth, unsigned char filterType, unsigned long length)
-{
-	/*
-	   For PNG filter method 0
-	   unfilter a PNG image scanline by scanline. when the pixels are smaller than 1 byte, the filter works byte per byte (bytewidth = 1)
-	   precon is the previous unfiltered scanline, recon the result, scanline the current one
-	   the incoming scanlines do NOT include the filtertype byte, that one is given in the parameter filterType instead
-	   recon and scanline MAY be the same memory address! precon must be disjoint.
-	 */
+	/* window size is given by CINFO, but there's no need for a window larger than the whole inflated data */
+	wsize = 1UL << (((cmf >> 4) & 15) + 8);
+	if (wsize > stream->wtotal) {
+		wsize = stream->wtotal;
+	}
 
-	unsigned long i;
-	switch (filterType) {
-	case 0:
-		for (i = 0; i < length; i++)
-			recon[i] = scanline[i];
-		break;
-	case 1:
-		for (i = 0; i < bytewidth; i++)
-			recon[i] = scanline[i];
-		for (i = bytewidth; i < length; i++)
-			recon[i] = scanline[i] + recon[i - bytewidth];
-		break;
-	case 2:
-		if (precon)
-			for (i = 0; i < length; i++)
-				recon[i] = scanline[i] + precon[i];
-		else
-			for (i = 0; i < length; i++)
-				recon[i] = scanline[i];
-		break;
-	case 3:
-		if (precon) {
-			for (i = 0; i < bytewidth; i++)
-				recon[i] = scanline[i] + precon[i] / 2;
-			for (i = bytewidth; i < length; i++)
-				recon[i] = scanline[i] + ((recon[i - bytewidth] + precon[i]) / 2);
-		} else {
-			for (i = 0; i < bytewidth; i++)
-				recon[i] = scanline[i];
-			for (i = bytewidth; i < length; i++)
-				recon[i] = scanline[i] + recon[i - bytewidth] / 2;
-		}
-		break;
-	case 4:
-		if (precon) {
-			for (i = 0; i < bytewidth; i++)
-				recon[i] = (unsigned char)(scanline[i] + paeth_predictor(0, precon[i], 0));
-			for (i = bytewidth; i < length; i++)
-				recon[i] = (unsigned char)(scanline[i] + paeth_predictor(recon[i - bytewidth], precon[i], precon[i - bytewidth]));
-		} else {
-			for (i = 0; i < bytewidth; i++)
-				recon[i] = scanline[i];
-			for (i = bytewidth; i < length; i++)
-				recon[i] = (unsigned char)(scanline[i] + paeth_predictor(recon[i - bytewidth], 0, 0));
-		}
-		break;
-	default:
+	/* allocate decoding tables, window and two scanlines */
+	size = scratch_size(wsize, stream->linebytes);
+	buffer = (unsigned char*)arena_alloc(upng, size);
+	if (buffer == NULL) {
+		SET_ERROR(upng, UPNG_ENOMEM);
+		return upng->error;
+	}
+	stream->codetree = (huffman_tree*)buffer;
+	stream->codetreeD = &stream->codetree[1];
+	stream->codelengthcodetree = &stream->codetree[2];
+	stream->window = &buffer[3 * sizeof(huffman_tree)];
+	stream->wsize = wsize;
+	stream->wdst = 0;
+	stream->line = &stream->window[wsize];
+	stream->prevline = &stream->line[stream->linebytes + 1];
+
+	uz_inflate_data(upng);
+
+	/* the compressed data must have all scanlines */
+	if ((upng->error == UPNG_EOK) && (stream->y != upng->height)) {
 		SET_ERROR(upng, UPNG_EMALFORMED);
-		break;
 	}
-}
-
-static void unfilter(upng_t* upng, unsigned char *out, const unsigned char *in, unsigned w, unsigned h, unsigned bpp)
-{
-	/*
-	   For PNG filter method 0
-	   this function unfilters a single image (e.g. without interlacing this is called once, with Adam7 it's called 7 times)
-	   out must have enough bytes allocated already, in must have the scanlines + 1 filtertype byte per scanline
-	   w and h are image dimensions or dimensions of reduced image, bpp is bpp per pixel
-	   in and out are allowed to be the same memory address!
-	 */
 
-	unsigned y;
-	unsigned char *prevline = 0;
-
-	unsigned long bytewidth = (bpp + 7) / 8;	/*bytewidth is used for filtering, is 1 when bpp < 8, number of bytes per pixel otherwise */
-	unsigned long linebytes = (w * bpp + 7) / 8;
-
-	for (y = 0; y < h; y++) {
-		unsigned long outindex = linebytes * y;
-		unsigned long inindex = (1 + linebytes) * y;	/*the extra filterbyte added to each row */
-		unsigned char filterType = in[inindex];
-
-		unfilter_scanline(upng, &out[outindex], &in[inindex + 1], prevline, bytewidth, filterType, linebytes);
-		if (upng->error != UPNG_EOK) {
-			return;
-		}
+	arena_free(upng, buffer, size);
+	stream->window = stream->line = stream->prevline = NULL;
+	stream->codetree = stream->codetreeD = stream->codelengthcodetree = NULL;
 
-		prevline = &out[outindex];
-	}
+	return upng->error;
 }
 
-static void remove_padding_bits(unsigned char *out, const unsigned char *in, unsigned long olinebits, unsigned long ilinebits, unsigned h)
+/* row callback for upng_decode(): copy the row into the image buffer, removing the padding bits of the scanlines (if
+ * any) so that the image is one continuous bitstream */
+static void decode_row(void* user, unsigned y, const unsigned char* row, unsigned long size)
 {
-	/*
-	   After filtering there are still padding bpp if scanlines have non multiple of 8 bit amounts. They need to be removed (except at last scanline of (Adam7-reduced) image) before working with pure image buffers for the Adam7 code, the color convert code and the output to the user.
-	   in and out are allowed to be the same buffer, in may also be higher but still overlapping; in must have >= ilinebits*h bpp, out must have >= olinebits*h bpp, olinebits must be <= ilinebits
-	   also used to move bpp after earlier such operations happened, e.g. in a sequence of reduced images from Adam7
-	   only useful if (ilinebits - olinebits) is a value in the range 1..7
-	 */
-	unsigned y;
-	unsigned long diff = ilinebits - olinebits;
-	unsigned long obp = 0, ibp = 0;	/*bit pointers */
-	for (y = 0; y < h; y++) {
+	upng_t* upng = (upng_t*)user;
+	unsigned long linebits = upng->width * upng_get_bpp(upng);
+
+	if ((linebits % 8) == 0) {
+		memcpy(&upng->buffer[y * size], row, size);
+	} else {
+		unsigned long obp = y * linebits, ibp = 0;	/*bit pointers */
 		unsigned long x;
-		for (x = 0; x < olinebits; x++) {
-			unsigned char bit = (unsigned char)((in[(ibp) >> 3] >> (7 - ((ibp) & 0x7))) & 1);
+		for (x = 0; x < linebits; x++) {
+			unsigned char bit = (unsigned char)((row[(ibp) >> 3] >> (7 - ((ibp) & 0x7))) & 1);
 			ibp++;
 
 			if (bit == 0)
-				out[(obp) >> 3] &= (unsigned char)(~(1 << (7 - ((obp) & 0x7))));
+				upng->buffer[(obp) >> 3] &= (unsigned char)(~(1 << (7 - ((obp) & 0x7))));
 			else
-				out[(obp) >> 3] |= (1 << (7 - ((obp) & 0x7)));
+				upng->buffer[(obp) >> 3] |= (1 << (7 - ((obp) & 0x7)));
 			++obp;
 		}
-		ibp += diff;
-	}
-}
-
-/*out must be buffer big enough to contain full image, and in must contain the full decompressed data from the IDAT chunks*/
-static void post_process_scanlines(upng_t* upng, unsigned char *out, unsigned char *in, const upng_t* info_png)
-{
-	unsigned bpp = upng_get_bpp(info_png);
-	unsigned w = info_png->width;
-	unsigned h = info_png->height;
-
-	if (bpp == 0) {
-		SET_ERROR(upng, UPNG_EMALFORMED);
-		return;
-	}
-
-	if (bpp < 8 && w * bpp != ((w * bpp + 7) / 8) * 8) {
-		unfilter(upng, in, in, w, h, bpp);
-		if (upng->error != UPNG_EOK) {
-			return;
-		}
-		remove_padding_bits(out, in, w * bpp, ((w * bpp + 7) / 8) * 8, h);
-	} else {
-		unfilter(upng, out, in, w, h, bpp);	/*we can immediatly filter into the out buffer, no other steps needed */
 	}
 }
 
@@ -842,6 +1041,8 @@ static upng_format determine_format(upng_t* upng) {
 			return UPNG_LUMINANCE4;
 		case 8:
 			return UPNG_LUMINANCE8;
+		case 16:
+			return UPNG_LUMINANCE16;
 		default:
 			return UPNG_BADFORMAT;
 		}
@@ -864,6 +1065,21 @@ static upng_format determine_format(upng_t* upng) {
 			return UPNG_LUMINANCE_ALPHA4;
 		case 8:
 			return UPNG_LUMINANCE_ALPHA8;
+		case 16:
+			return UPNG_LUMINANCE_ALPHA16;
+		default:
+			return UPNG_BADFORMAT;
+		}
+	case UPNG_PAL:
+		switch (upng->color_depth) {
+		case 1:
+			return UPNG_INDEXED1;
+		case 2:
+			return UPNG_INDEXED2;
+		case 4:
+			return UPNG_INDEXED4;
+		case 8:
+			return UPNG_INDEXED8;
 		default:
 			return UPNG_BADFORMAT;
 		}
@@ -895,6 +1111,9 @@ static void upng_free_source(upng_t* upng)
 /*read the information from the header and store it in the upng_Info. return value is error*/
 upng_error upng_header(upng_t* upng)
 {
+	unsigned char header[33];
+	unsigned i;
+
 	/* if we have an error state, bail now */
 	if (upng->error != UPNG_EOK) {
 		return upng->error;
@@ -905,31 +1124,32 @@ upng_error upng_header(upng_t* upng)
 		return upng->error;
 	}
 
-	/* minimum length of a valid PNG file is 29 bytes
-	 * FIXME: verify this against the specification, or
-	 * better against the actual code below */
-	if (upng->source.size < 29) {
+	/* read PNG signature (8 bytes) and IHDR chunk (length, type, 13 bytes data, CRC) */
+	for (i = 0; i < sizeof(header); i++) {
+		header[i] = read_source_byte(upng);
+	}
+	if (upng->error != UPNG_EOK) {
 		SET_ERROR(upng, UPNG_ENOTPNG);
 		return upng->error;
 	}
 
 	/* check that PNG header matches expected value */
-	if (upng->source.buffer[0] != 137 || upng->source.buffer[1] != 80 || upng->source.buffer[2] != 78 || upng->source.buffer[3] != 71 || upng->source.buffer[4] != 13 || upng->source.buffer[5] != 10 || upng->source.buffer[6] != 26 || upng->source.buffer[7] != 10) {
+	if (header[0] != 137 || header[1] != 80 || header[2] != 78 || header[3] != 71 || header[4] != 13 || header[5] != 10 || header[6] != 26 || header[7] != 10) {
 		SET_ERROR(upng, UPNG_ENOTPNG);
 		return upng->error;
 	}
 
 	/* check that the first chunk is the IHDR chunk */
-	if (MAKE_DWORD_PTR(upng->source.buffer + 12) != CHUNK_IHDR) {
+	if (MAKE_DWORD_PTR(header + 12) != CHUNK_IHDR) {
 		SET_ERROR(upng, UPNG_EMALFORMED);
 		return upng->error;
 	}
 
 	/* read the values given in the header */
-	upng->width = MAKE_DWORD_PTR(upng->source.buffer + 16);
-	upng->height = MAKE_DWORD_PTR(upng->source.buffer + 20);
-	upng->color_depth = upng->source.buffer[24];
-	upng->color_type = (upng_color)upng->source.buffer[25];
+	upng->width = MAKE_DWORD_PTR(header + 16);
+	upng->height = MAKE_DWORD_PTR(header + 20);
+	upng->color_depth = header[24];
+	upng->color_type = (upng_color)header[25];
 
 	/* determine our color format */
 	upng->format = determine_format(upng);
@@ -939,19 +1159,19 @@ upng_error upng_header(upng_t* upng)
 	}
 
 	/* check that the compression method (byte 27) is 0 (only allowed value in spec) */
-	if (upng->source.buffer[26] != 0) {
+	if (header[26] != 0) {
 		SET_ERROR(upng, UPNG_EMALFORMED);
 		return upng->error;
 	}
 
 	/* check that the compression method (byte 27) is 0 (only allowed value in spec) */
-	if (upng->source.buffer[27] != 0) {
+	if (header[27] != 0) {
 		SET_ERROR(upng, UPNG_EMALFORMED);
 		return upng->error;
 	}
 
 	/* check that the compression method (byte 27) is 0 (spec allows 1, but uPNG does not support it) */
-	if (upng->source.buffer[28] != 0) {
+	if (header[28] != 0) {
 		SET_ERROR(upng, UPNG_EUNINTERLACED);
 		return upng->error;
 	}
@@ -960,15 +1180,11 @@ upng_error upng_header(upng_t* upng)
 	return upng->error;
 }
 
-/*read a PNG, the result will be in the same color type as the PNG (hence "generic")*/
-upng_error upng_decode(upng_t* upng)
+/*decode a PNG scanline by scanline, the rows passed to the callback are in the same color type as the PNG*/
+upng_error upng_decode_rows(upng_t* upng, upng_row_fn row, void* user)
 {
-	const unsigned char *chunk;
-	unsigned char* compressed;
-	unsigned char* inflated;
-	unsigned long compressed_size = 0, compressed_index = 0;
-	unsigned long inflated_size;
-	upng_error error;
+	upng_stream *stream = &upng->stream;
+	unsigned bpp;
 
 	/* if we have an error state, bail now */
 	if (upng->error != UPNG_EOK) {
@@ -986,142 +1202,99 @@ upng_error upng_decode(upng_t* upng)
 		return upng->error;
 	}
 
-	/* release old result, if any */
-	if (upng->buffer != 0) {
-		free(upng->buffer);
-		upng->buffer = 0;
-		upng->size = 0;
-	}
-
-	/* first byte of the first chunk after the header */
-	chunk = upng->source.buffer + 33;
-
-	/* scan through the chunks, finding the size of all IDAT chunks, and also
-	 * verify general well-formed-ness */
-	while (chunk < upng->source.buffer + upng->source.size) {
-		unsigned long length;
-		const unsigned char *data;	/*the data in the chunk */
-
-		/* make sure chunk header is not larger than the total compressed */
-		if ((unsigned long)(chunk - upng->source.buffer + 12) > upng->source.size) {
-			SET_ERROR(upng, UPNG_EMALFORMED);
-			return upng->error;
-		}
-
-		/* get length; sanity check it */
-		length = upng_chunk_length(chunk);
-		if (length > INT_MAX) {
-			SET_ERROR(upng, UPNG_EMALFORMED);
-			return upng->error;
-		}
-
-		/* make sure chunk header+paylaod is not larger than the total compressed */
-		if ((unsigned long)(chunk - upng->source.buffer + length + 12) > upng->source.size) {
-			SET_ERROR(upng, UPNG_EMALFORMED);
-			return upng->error;
-		}
-
-		/* get pointer to payload */
-		data = chunk + 8;
-
-		/* parse chunks */
-		if (upng_chunk_type(chunk) == CHUNK_IDAT) {
-			compressed_size += length;
-		} else if (upng_chunk_type(chunk) == CHUNK_IEND) {
-			break;
-		} else if (upng_chunk_critical(chunk)) {
-			SET_ERROR(upng, UPNG_EUNSUPPORTED);
-			return upng->error;
-		}
-
-		chunk += upng_chunk_length(chunk) + 12;
-	}
-
-	/* allocate enough space for the (compressed and filtered) image data */
-	compressed = (unsigned char*)malloc(compressed_size);
-	if (compressed == NULL) {
-		SET_ERROR(upng, UPNG_ENOMEM);
+	bpp = upng_get_bpp(upng);
+	if (bpp == 0 || upng->width == 0 || upng->height == 0) {
+		SET_ERROR(upng, UPNG_EMALFORMED);
 		return upng->error;
 	}
 
-	/* scan through the chunks again, this time copying the values into
-	 * our compressed buffer.  there's no reason to validate anything a second time. */
-	chunk = upng->source.buffer + 33;
-	while (chunk < upng->source.buffer + upng->source.size) {
-		unsigned long length;
-		const unsigned char *data;	/*the data in the chunk */
+	/* prepare inflating and unfiltering, the compressed data starts in the next IDAT chunk */
+	stream->chunk_left = 0;
+	stream->in_idat = 0;
+	stream->bitbuf = 0;
+	stream->bitcnt = 0;
+	stream->bytewidth = (bpp + 7) / 8;	/*bytewidth is used for filtering, is 1 when bpp < 8, number of bytes per pixel otherwise */
+	stream->linebytes = (upng->width * bpp + 7) / 8;
+	stream->linepos = 0;
+	stream->wpos = 0;
+	stream->wtotal = upng->height * (stream->linebytes + 1);	/*the extra filterbyte added to each row */
+	stream->y = 0;
+	stream->row = row;
+	stream->row_user = user;
+
+	/* decompress and unfilter image data */
+	if (uz_inflate(upng) == UPNG_EOK) {
+		upng->state = UPNG_DECODED;
+	}
 
-		length = upng_chunk_length(chunk);
-		data = chunk + 8;
+	/* we are done with our input buffer; free it if we own it */
+	upng_free_source(upng);
 
-		/* parse chunks */
-		if (upng_chunk_type(chunk) == CHUNK_IDAT) {
-			memcpy(compressed + compressed_index, data, length);
-			compressed_index += length;
-		} else if (upng_chunk_type(chunk) == CHUNK_IEND) {
-			break;
-		}
+	return upng->error;
+}
 
-		chunk += upng_chunk_length(chunk) + 12;
+/*read a PNG, the result will be in the same color type as the PNG (hence "generic")*/
+upng_error upng_decode(upng_t* upng)
+{
+	/* if we have an error state, bail now */
+	if (upng->error != UPNG_EOK) {
+		return upng->error;
 	}
 
-	/* allocate space to store inflated (but still filtered) data */
-	inflated_size = ((upng->width * (upng->height * upng_get_bpp(upng) + 7)) / 8) + upng->height;
-	inflated = (unsigned char*)malloc(inflated_size);
-	if (inflated == NULL) {
-		free(compressed);
-		SET_ERROR(upng, UPNG_ENOMEM);
+	/* parse the main header, if necessary */
+	upng_header(upng);
+	if (upng->error != UPNG_EOK) {
 		return upng->error;
 	}
 
-	/* decompress image data */
-	error = uz_inflate(upng, inflated, inflated_size, compressed, compressed_size);
-	if (error != UPNG_EOK) {
-		free(compressed);
-		free(inflated);
+	/* if the state is not HEADER (meaning we are ready to decode the image), stop now */
+	if (upng->state != UPNG_HEADER) {
 		return upng->error;
 	}
 
-	/* free the compressed compressed data */
-	free(compressed);
+	/* release old result, if any */
+	if (upng->buffer != 0) {
+		arena_free(upng, upng->buffer, upng->size);
+		upng->buffer = 0;
+		upng->size = 0;
+	}
 
 	/* allocate final image buffer */
 	upng->size = (upng->height * upng->width * upng_get_bpp(upng) + 7) / 8;
-	upng->buffer = (unsigned char*)malloc(upng->size);
+	upng->buffer = (unsigned char*)arena_alloc(upng, upng->size);
 	if (upng->buffer == NULL) {
-		free(inflated);
 		upng->size = 0;
 		SET_ERROR(upng, UPNG_ENOMEM);
 		return upng->error;
 	}
 
-	/* unfilter scanlines */
-	post_process_scanlines(upng, upng->buffer, inflated, upng);
-	free(inflated);
+	/* decompress and unfilter scanlines into the image buffer */
+	upng_decode_rows(upng, decode_row, upng);
 
 	if (upng->error != UPNG_EOK) {
-		free(upng->buffer);
+		arena_free(upng, upng->buffer, upng->size);
 		upng->buffer = NULL;
 		upng->size = 0;
-	} else {
-		upng->state = UPNG_DECODED;
 	}
 
-	/* we are done with our input buffer; free it if we own it */
-	upng_free_source(upng);
-
 	return upng->error;
 }
 
-static upng_t* upng_new(void)
+/* read function for memory sources */
+static unsigned long read_memory(void* user, unsigned char* buffer, unsigned long size)
 {
-	upng_t* upng;
-
-	upng = (upng_t*)malloc(sizeof(upng_t));
-	if (upng == NULL) {
-		return NULL;
+	upng_source* source = (upng_source*)user;
+	unsigned long left = source->buffer != NULL ? source->size - source->pos : 0;
+	if (size > left) {
+		size = left;
 	}
+	memcpy(buffer, source->buffer + source->pos, size);
+	source->pos += size;
+	return size;
+}
 
+static void upng_init(upng_t* upng)
+{
 	upng->buffer = NULL;
 	upng->size = 0;
 
@@ -1131,15 +1304,41 @@ static upng_t* upng_new(void)
 	upng->color_depth = 8;
 	upng->format = UPNG_RGBA8;
 
+	memset(upng->palette, 0, sizeof(upng->palette));
+	upng->palette_size = 0;
+
 	upng->state = UPNG_NEW;
 
 	upng->error = UPNG_EOK;
 	upng->error_line = 0;
 
+	upng->source.read = read_memory;
+	upng->source.user = &upng->source;
 	upng->source.buffer = NULL;
 	upng->source.size = 0;
+	upng->source.pos = 0;
 	upng->source.owning = 0;
 
+	memset(&upng->stream, 0, sizeof(upng->stream));
+
+	upng->arena.buffer = NULL;
+	upng->arena.size = 0;
+	upng->arena.used = 0;
+	upng->arena.peak = 0;
+	upng->in_arena = 0;
+}
+
+static upng_t* upng_new(void)
+{
+	upng_t* upng;
+
+	upng = (upng_t*)malloc(sizeof(upng_t));
+	if (upng == NULL) {
+		return NULL;
+	}
+
+	upng_init(upng);
+
 	return upng;
 }
 
@@ -1157,6 +1356,50 @@ upng_t* upng_new_from_bytes(const unsigned char* buffer, unsigned long size)
 	return upng;
 }
 
+upng_t* upng_new_from_stream(upng_read_fn read, void* user)
+{
+	upng_t* upng = upng_new();
+	if (upng == NULL) {
+		return NULL;
+	}
+
+	upng->source.read = read;
+	upng->source.user = user;
+
+	return upng;
+}
+
+upng_t* upng_new_from_stream_arena(upng_read_fn read, void* user, void* arena, unsigned long size)
+{
+	upng_t* upng = (upng_t*)arena;
+	if (arena == NULL || size < ARENA_ALIGN(sizeof(upng_t))) {
+		return NULL;
+	}
+
+	upng_init(upng);
+
+	upng->source.read = read;
+	upng->source.user = user;
+
+	upng->arena.buffer = (unsigned char*)arena;
+	upng->arena.size = size;
+	upng->arena.used = ARENA_ALIGN(sizeof(upng_t));
+	upng->arena.peak = upng->arena.used;
+	upng->in_arena = 1;
+
+	return upng;
+}
+
+unsigned long upng_get_arena_size(unsigned width, unsigned height, unsigned bpp)
+{
+	unsigned long linebytes = ((unsigned long)width * bpp + 7) / 8;
+	unsigned long wsize = height * (linebytes + 1);
+	if (wsize > 32768) {
+		wsize = 32768;
+	}
+	return ARENA_ALIGN(sizeof(upng_t)) + ARENA_ALIGN(scratch_size(wsize, linebytes));
+}
+
 upng_t* upng_new_from_file(const char *filename)
 {
 	upng_t* upng;
@@ -1202,14 +1445,16 @@ void upng_free(upng_t* upng)
 {
 	/* deallocate image buffer */
 	if (upng->buffer != NULL) {
-		free(upng->buffer);
+		arena_free(upng, upng->buffer, upng->size);
 	}
 
 	/* deallocate source buffer, if necessary */
 	upng_free_source(upng);
 
 	/* deallocate struct itself */
-	free(upng);
+	if (!upng->in_arena) {
+		free(upng);
+	}
 }
 
 upng_error upng_get_error(const upng_t* upng)
@@ -1244,6 +1489,8 @@ unsigned upng_get_components(const upng_t* upng)
 		return 1;
 	case UPNG_RGB:
 		return 3;
+	case UPNG_PAL:
+		return 1;
 	case UPNG_LUMA:
 		return 2;
 	case UPNG_RGBA:
@@ -1270,6 +1517,14 @@ upng_format upng_get_format(const upng_t* upng)
 	return upng->format;
 }
 
+const unsigned char* upng_get_palette(const upng_t* upng, unsigned* count)
+{
+	if (count != NULL) {
+		*count = upng->palette_size;
+	}
+	return upng->palette;
+}
+
 const unsigned char* upng_get_buffer(const upng_t* upng)
 {
 	return upng->buffer;
@@ -1279,3 +1534,8 @@ unsigned upng_get_size(const upng_t* upng)
 {
 	return upng->size;
 }
+
+unsigned long upng_get_arena_peak(const upng_t* upng)
+{
+	return upng->arena.peak;
+}
@@ -52,17 +52,38 @@ typedef enum upng_format {
 	UPNG_LUMINANCE_ALPHA1,
 	UPNG_LUMINANCE_ALPHA2,
 	UPNG_LUMINANCE_ALPHA4,
-	UPNG_LUMINANCE_ALPHA8
+	UPNG_LUMINANCE_ALPHA8,
+	UPNG_LUMINANCE16,
+	UPNG_LUMINANCE_ALPHA16,
+	UPNG_INDEXED1,
+	UPNG_INDEXED2,
+	UPNG_INDEXED4,
+	UPNG_INDEXED8
 } upng_format;
 
 typedef struct upng_t upng_t;
 
+/* read up to size bytes into buffer, return the number of bytes read (0 on end of input or error) */
+typedef unsigned long	(*upng_read_fn)	(void* user, unsigned char* buffer, unsigned long size);
+
+/* receives the unfiltered scanlines (in the same color type as the PNG, size bytes), top to bottom */
+typedef void			(*upng_row_fn)	(void* user, unsigned y, const unsigned char* row, unsigned long size);
+
 upng_t*		upng_new_from_bytes	(const unsigned char* buffer, unsigned long size);
 upng_t*		upng_new_from_file	(const char* path);
+upng_t*		upng_new_from_stream(upng_read_fn read, void* user);
 void		upng_free			(upng_t* upng);
 
+/* like upng_new_from_stream(), but the upng_t and all memory needed for decoding are taken from the given arena, so
+ * that decoding does not malloc(); upng_get_arena_size() gives the arena size needed for upng_decode_rows() (add the
+ * image size for upng_decode()), upng_free() does not free the arena */
+upng_t*			upng_new_from_stream_arena	(upng_read_fn read, void* user, void* arena, unsigned long size);
+unsigned long	upng_get_arena_size			(unsigned width, unsigned height, unsigned bpp);
+unsigned long	upng_get_arena_peak			(const upng_t* upng);
+
 upng_error	upng_header			(upng_t* upng);
 upng_error	upng_decode			(upng_t* upng);
+upng_error	upng_decode_rows	(upng_t* upng, upng_row_fn row, void* user);
 
 upng_error	upng_get_error		(const upng_t* upng);
 unsigned	upng_get_error_line	(const upng_t* upng);
@@ -75,6 +96,9 @@ unsigned	upng_get_components	(const upng_t* upng);
 unsigned	upng_get_pixelsize	(const upng_t* upng);
 upng_format	upng_get_format		(const upng_t* upng);
 
+/* palette of UPNG_INDEXED* images (available once decoding has started), count RGB entries, 256 entries are valid */
+const unsigned char*	upng_get_palette	(const upng_t* upng, unsigned* count);
+
 const unsigned char*	upng_get_buffer		(const upng_t* upng);
 unsigned				upng_get_size		(const upng_t* upng);
 
@@ -15,6 +15,7 @@
 #elif defined(ESP32)
 #  include <WiFi.h>
 #  include <WiFiMulti.h>
+#  include <lwip/sockets.h>
 #endif
 
 #include "stuff.h"
@@ -168,4 +169,34 @@ const char *wifiUserAgentStr(void)
     return sUserAgent;
 }
 
+bool wifiWaitAvailable(WiFiClient &client, const uint32_t timeout)
+{
+    if (client.available() > 0)
+    {
+        return true;
+    }
+
+    // Sleep in select() until the socket becomes readable (data or EOF), or the timeout expires
+    const int fd = client.fd();
+    if (fd >= 0)
+    {
+        fd_set readFds;
+        FD_ZERO(&readFds);
+        FD_SET(fd, &readFds);
+        struct timeval tv;
+        tv.tv_sec = timeout / 1000;
+        tv.tv_usec = (timeout % 1000) * 1000;
+        if (select(fd + 1, &readFds, NULL, NULL, &tv) <= 0)
+        {
+            return false;
+        }
+    }
+    // No socket (e.g. TLS client), poll
+    else
+    {
+        delay(MIN(timeout, 5));
+    }
+    return client.available() > 0;
+}
+
 // eof
@@ -14,6 +14,7 @@
 #define __WIFI_H__
 
 #include <Arduino.h>
+#include <WiFiClient.h>
 
 //! initialise
 void wifiInit(void);
@@ -24,6 +25,17 @@ bool wifiWaitForConnect(void);
 
 const char *wifiUserAgentStr(void);
 
+//! wait for data from a client
+/*!
+    Blocks (in select(), i.e. without polling) until data arrives, the connection is closed or the timeout expires.
+
+    \param[in]  client   the client
+    \param[in]  timeout  max. time to wait [ms]
+
+    \returns true if data is available, false otherwise
+*/
+bool wifiWaitAvailable(WiFiClient &client, const uint32_t timeout);
+
 #endif // __WIFI_H__
 //@}
 // eof
@@ -0,0 +1,234 @@
+####################################################################################################
+
+package Ffi::Aadc;
+
+=pod
+
+=encoding utf-8
+
+=head1 Ffi::Aadc -- pre-encoded cover art ("AADC") format
+
+Encodes raw RGB images into the compact cover art format that the firmware decodes straight into
+its frame buffer (see sCoverArtAadc() in display.cpp), and decodes it again (for checking).
+
+Format (all values little-endian):
+
+    header (16 bytes):  magic "AADC", version (u8, 1), pixel format (u8, 1 = RGB565, 2 = RGB888),
+                        width (u16), height (u16), raw size [bytes] (u32), 2 bytes reserved
+    data:               the pixels (row by row, top to bottom), compressed in LZ4 block format
+
+=head2 Examples
+
+    use Ffi::Aadc;
+
+    my $aadc = Ffi::Aadc::encode($rgb, 64, 64, Ffi::Aadc::RGB565);
+    my ($rgb2, $width, $height) = Ffi::Aadc::decode($aadc);
+
+=cut
+
+use strict;
+use warnings;
+
+our $VERSION = '1.0';
+
+use constant MAGIC   => 'AADC';
+use constant VERSION => 1;
+use constant RGB565  => 1;
+use constant RGB888  => 2;
+
+###############################################################################
+
+=pod
+
+=head2 Functions
+
+=head3 encode($rgb, $width, $height, $format)
+
+Encodes the raw RGB data (3 bytes per pixel, row by row) in C<$rgb> and returns the AADC data.
+C<$format> is C<RGB565> (default) or C<RGB888>.
+
+=cut
+
+sub encode
+{
+    my ($rgb, $width, $height, $format) = @_;
+    $format ||= RGB565;
+    die("Bad RGB data size\n") unless (length($rgb) == $width * $height * 3);
+
+    my $raw = $rgb;
+    if ($format == RGB565)
+    {
+        $raw = '';
+        foreach my $px (unpack('(a3)*', $rgb))
+        {
+            my ($r, $g, $b) = unpack('C3', $px);
+            $raw .= pack('v', (($r >> 3) << 11) | (($g >> 2) << 5) | ($b >> 3));
+        }
+    }
+    return pack('a4 C C v v V x2', MAGIC, VERSION, $format, $width, $height, length($raw)) . lz4($raw);
+}
+
+=pod
+
+=head3 decode($aadc)
+
+Decodes the AADC data in C<$aadc> and returns the raw RGB data (3 bytes per pixel), the width and
+the height, or an empty list if the data is not valid.
+
+=cut
+
+sub decode
+{
+    my ($aadc) = @_;
+    return () if (length($aadc) < 16);
+    my ($magic, $version, $format, $width, $height, $rawSize) = unpack('a4 C C v v V', $aadc);
+    my $bpp = $format == RGB565 ? 2 : ($format == RGB888 ? 3 : 0);
+    return () if ( ($magic ne MAGIC) || ($version != VERSION) || ($bpp == 0) ||
+                   ($rawSize != $width * $height * $bpp) );
+
+    my $raw = unlz4(substr($aadc, 16), $rawSize);
+    return () unless (defined $raw);
+    my $rgb = $raw;
+    if ($format == RGB565)
+    {
+        $rgb = '';
+        foreach my $v (unpack('v*', $raw))
+        {
+            my ($r, $g, $b) = (($v >> 11) & 0x1f, ($v >> 5) & 0x3f, $v & 0x1f);
+            $rgb .= pack('C3', ($r << 3) | ($r >> 2), ($g << 2) | ($g >> 4), ($b << 3) | ($b >> 2));
+        }
+    }
+    return ($rgb, $width, $height);
+}
+
+=pod
+
+=head3 lz4($data)
+
+Compresses C<$data> into an LZ4 block (greedy matching, no frame header) and returns it.
+
+=cut
+
+sub lz4
+{
+    my ($data) = @_;
+    my $len = length($data);
+    my $out = '';
+    my %last = ();
+    my $anchor = 0;
+    my $offs = 0;
+    # the last match must start at least 12 bytes before the end, the last 5 bytes are always literals
+    while ($offs + 12 <= $len)
+    {
+        my $seq = substr($data, $offs, 4);
+        my $ref = $last{$seq};
+        $last{$seq} = $offs;
+        if (defined($ref) && (($offs - $ref) <= 0xffff))
+        {
+            my $matchLen = 4;
+            while ( ($offs + $matchLen < $len - 5) &&
+                    (substr($data, $ref + $matchLen, 1) eq substr($data, $offs + $matchLen, 1)) )
+            {
+                $matchLen++;
+            }
+            $out .= _sequence(substr($data, $anchor, $offs - $anchor), $offs - $ref, $matchLen);
+            $offs += $matchLen;
+            $anchor = $offs;
+        }
+        else
+        {
+            $offs++;
+        }
+    }
+    $out .= _sequence(substr($data, $anchor));
+    return $out;
+}
+
+sub _sequence
+{
+    my ($literals, $matchOffs, $matchLen) = @_;
+    my $litLen = length($literals);
+    my $mLen = defined($matchOffs) ? $matchLen - 4 : 0;
+    my $seq = chr((($litLen >= 15 ? 15 : $litLen) << 4) | ($mLen >= 15 ? 15 : $mLen));
+    $seq .= _length($litLen - 15) if ($litLen >= 15);
+    $seq .= $literals;
+    if (defined($matchOffs))
+    {
+        $seq .= pack('v', $matchOffs);
+        $seq .= _length($mLen - 15) if ($mLen >= 15);
+    }
+    return $seq;
+}
+
+sub _length
+{
+    my ($len) = @_;
+    my $res = '';
+    while ($len >= 255)
+    {
+        $res .= "\xff";
+        $len -= 255;
+    }
+    return $res . chr($len);
+}
+
+=pod
+
+=head3 unlz4($block, $size)
+
+Decompresses the LZ4 block C<$block> and returns the data, or C<undef> if the block is invalid or
+does not decompress to C<$size> bytes.
+
+=cut
+
+sub unlz4
+{
+    my ($block, $size) = @_;
+    my @in = unpack('C*', $block);
+    my $out = '';
+    my $ix = 0;
+    while ($ix <= $#in)
+    {
+        my $token = $in[$ix++];
+        my $litLen = $token >> 4;
+        if ($litLen == 15)
+        {
+            my $b;
+            do { return undef if ($ix > $#in); $b = $in[$ix++]; $litLen += $b; } while ($b == 255);
+        }
+        return undef if ($ix + $litLen > $#in + 1);
+        $out .= pack('C*', @in[$ix .. $ix + $litLen - 1]);
+        $ix += $litLen;
+        last if ($ix > $#in);
+
+        return undef if ($ix + 2 > $#in + 1);
+        my $matchOffs = $in[$ix] | ($in[$ix + 1] << 8);
+        $ix += 2;
+        my $matchLen = $token & 0x0f;
+        if ($matchLen == 15)
+        {
+            my $b;
+            do { return undef if ($ix > $#in); $b = $in[$ix++]; $matchLen += $b; } while ($b == 255);
+        }
+        $matchLen += 4;
+        return undef if ( ($matchOffs == 0) || ($matchOffs > length($out)) );
+        for (my $n = 0; $n < $matchLen; $n++)
+        {
+            $out .= substr($out, -$matchOffs, 1);
+        }
+    }
+    return length($out) == $size ? $out : undef;
+}
+
+=pod
+
+=head2 See also
+
+L<Ffi>
+
+=cut
+
+###############################################################################
+
+1;
+# eof
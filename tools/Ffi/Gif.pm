@@ -0,0 +1,167 @@
+####################################################################################################
+
+package Ffi::Gif;
+
+=pod
+
+=encoding utf-8
+
+=head1 Ffi::Gif -- GIF file inspection
+
+Minimal GIF parser that walks the block structure of a GIF file without decoding any image data.
+
+=head2 Examples
+
+    use Ffi::Gif;
+
+    my $info = Ffi::Gif::parse($data) || die("not a GIF");
+    printf("%ux%u, %u frames, %u ms\n", $info->{width}, $info->{height},
+        $info->{frames}, $info->{duration});
+
+=cut
+
+use strict;
+use warnings;
+
+our $VERSION = '1.0';
+
+# Frame duration limits of the firmware (GIF_MIN_FRAME_DUR and GIF_MAX_FRAME_DUR in display.cpp) [ms]
+our $MIN_FRAME_DUR = 5;
+our $MAX_FRAME_DUR = 1000;
+
+###############################################################################
+
+=pod
+
+=head2 Functions
+
+=head3 parse($data)
+
+Parses the GIF in C<$data> (a string of bytes) and returns a hash ref with the following fields, or
+C<undef> if the data is not a valid GIF:
+
+=over
+
+=item * C<width>, C<height> -- the canvas size
+
+=item * C<frames> -- the number of frames (image descriptors)
+
+=item * C<delays> -- array ref of the frame delays [ms] (from the graphic control extension, 0 if
+none)
+
+=item * C<gces> -- array ref of the offsets of the delay field of all graphic control extensions (in
+the same order as the frames they apply to)
+
+=item * C<duration> -- the play time of one loop on the display [ms]: the sum of all frame delays,
+each clamped to C<$MIN_FRAME_DUR>..C<$MAX_FRAME_DUR> like the firmware does (GIF_MIN_FRAME_DUR and
+GIF_MAX_FRAME_DUR in display.cpp)
+
+=item * C<minDelay>, C<maxDelay> -- the smallest and largest frame delay [ms]
+
+=item * C<area> -- the sum of all frame areas [pixels], a measure for the decoding cost
+
+=back
+
+=cut
+
+sub parse
+{
+    my ($data) = @_;
+    my $len = length($data);
+    return undef if ( ($len < 13) || (substr($data, 0, 3) ne 'GIF') );
+
+    my ($width, $height, $flags) = unpack('v v C', substr($data, 6, 5));
+    my $offs = 13;
+    if ($flags & 0x80)
+    {
+        $offs += 3 * (1 << (($flags & 0x07) + 1));
+    }
+
+    my %info = ( width => $width, height => $height, frames => 0, delays => [], gces => [],
+                 duration => 0, minDelay => 0, maxDelay => 0, area => 0 );
+    my $delay = 0;
+    while ($offs < $len)
+    {
+        my $type = ord(substr($data, $offs++, 1));
+        # extension
+        if ($type == 0x21)
+        {
+            return undef if ($offs + 1 > $len);
+            my $label = ord(substr($data, $offs++, 1));
+            # graphic control extension: size (4), flags, delay (u16), transparent index, terminator
+            if ( ($label == 0xf9) && ($offs + 6 <= $len) && (ord(substr($data, $offs, 1)) == 4) )
+            {
+                $delay = 10 * unpack('v', substr($data, $offs + 2, 2));
+                push(@{$info{gces}}, $offs + 2);
+            }
+            $offs = _skipSubBlocks($data, $offs);
+        }
+        # image descriptor: x, y, w, h (u16), flags, [local colour table], LZW min code size, data
+        elsif ($type == 0x2c)
+        {
+            return undef if ($offs + 9 > $len);
+            my ($w, $h, $f) = unpack('x4 v v C', substr($data, $offs, 9));
+            $offs += 9;
+            if ($f & 0x80)
+            {
+                $offs += 3 * (1 << (($f & 0x07) + 1));
+            }
+            $offs++;
+            $offs = _skipSubBlocks($data, $offs);
+
+            $info{frames}++;
+            $info{area} += $w * $h;
+            push(@{$info{delays}}, $delay);
+            $delay = 0;
+        }
+        # trailer
+        elsif ($type == 0x3b)
+        {
+            last;
+        }
+        else
+        {
+            return undef;
+        }
+        return undef unless (defined $offs);
+    }
+    return undef unless ($info{frames} > 0);
+
+    my @d = sort { $a <=> $b } @{$info{delays}};
+    $info{minDelay} = $d[0];
+    $info{maxDelay} = $d[-1];
+    foreach my $delay (@d)
+    {
+        $delay = $MIN_FRAME_DUR if ($delay < $MIN_FRAME_DUR);
+        $delay = $MAX_FRAME_DUR if ($delay > $MAX_FRAME_DUR);
+        $info{duration} += $delay;
+    }
+
+    return \%info;
+}
+
+sub _skipSubBlocks
+{
+    my ($data, $offs) = @_;
+    my $len = length($data);
+    while ($offs < $len)
+    {
+        my $size = ord(substr($data, $offs++, 1));
+        return $offs if ($size == 0);
+        $offs += $size;
+    }
+    return undef;
+}
+
+=pod
+
+=head2 See also
+
+L<Ffi>
+
+=cut
+
+###############################################################################
+
+1;
+# eof
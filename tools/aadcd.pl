@@ -0,0 +1,180 @@
+#!/usr/bin/perl -w
+####################################################################################################
+#
+# flipflip's Album Art Display: cover art converter service
+#
+# Copyright (c) 2020 Philippe Kehl <flipflip at oinkzwurgl dot org>
+# https://oinkzwurgl.org/projaeggd/album-art-display
+#
+####################################################################################################
+#
+# Small HTTP server that sits between the display and the LMS web server. It forwards the cover art
+# requests to the LMS, converts the images to the panel size and serves them in the pre-encoded AADC
+# format (see Ffi/Aadc.pm), which the firmware decodes straight into its frame buffer. Point
+# COVER_ART_URL (secrets.h) to this service instead of the LMS.
+#
+# Instead of an LMS URL a directory can be given, in which case "/music/<coverid>/..." is served
+# from the file <dir>/<coverid>.<ext> (any image format). That is a local stand-in for testing.
+#
+# The panel size is taken from the requested path ("cover_64x64_o.png"), it defaults to 64x64. The
+# responses have an ETag and If-None-Match is honoured. Connections are kept alive, one client is
+# served at a time.
+#
+# Needs ImageMagick (convert).
+#
+# Usage: tools/aadcd.pl http://10.1.1.17:9000 9001
+#        tools/aadcd.pl covers/ 9001 rgb888
+#
+####################################################################################################
+
+use strict;
+use warnings;
+
+use FindBin;
+use lib $FindBin::Bin;
+use Ffi::Aadc;
+use IO::Socket::INET;
+use IO::Select;
+use HTTP::Tiny;
+use Digest::MD5 qw(md5_hex);
+use File::Temp qw(tempfile);
+
+my ($source, $port, $format) = @ARGV;
+unless ($source)
+{
+    die("Usage: $0 <lms-url>|<dir> [<port> [rgb565|rgb888]]\n");
+}
+$port   ||= 9001;
+$format ||= 'rgb565';
+die("Bad format $format\n") unless ($format =~ m{^rgb(565|888)$});
+my $aadcFormat = $format eq 'rgb888' ? Ffi::Aadc::RGB888 : Ffi::Aadc::RGB565;
+$source =~ s{/+$}{};
+my $isLms = $source =~ m{^https?://};
+die("Bad source $source\n") unless ($isLms || -d $source);
+
+my $KEEPALIVE = 10; # [s]
+my $http = HTTP::Tiny->new(timeout => 10, agent => 'aadcd/1.0');
+
+my $server = IO::Socket::INET->new(LocalPort => $port, Listen => 5, ReuseAddr => 1, Proto => 'tcp')
+    || die("Cannot listen on port $port: $!\n");
+printf(STDERR "Listening on port %u, source %s, format %s\n", $port, $source, $format);
+
+while (my $client = $server->accept())
+{
+    $client->autoflush(1);
+    my $peer = $client->peerhost();
+    while (my $req = readRequest($client))
+    {
+        my ($status, $headers, $body) = handleRequest($req);
+        my $resp = "HTTP/1.1 $status\r\n";
+        $headers->{'Content-Length'} = length($body);
+        $headers->{'Connection'} = $req->{close} ? 'close' : 'keep-alive';
+        $resp .= "$_: $headers->{$_}\r\n" for (sort keys %{$headers});
+        $resp .= "\r\n";
+        print($client $resp . $body);
+        printf(STDERR "%s %s %s -> %s (%u bytes)\n", $peer, $req->{method}, $req->{path}, $status, length($body));
+        last if ($req->{close});
+    }
+    close($client);
+}
+
+# Read a request (request line and headers), returns undef on EOF, error or keep-alive timeout
+sub readRequest
+{
+    my ($client) = @_;
+    return undef unless (IO::Select->new($client)->can_read($KEEPALIVE));
+    my %req = ( headers => {} );
+    while (1)
+    {
+        my $line = <$client>;
+        return undef unless (defined $line);
+        $line =~ s{\r?\n$}{};
+        if (!$req{method})
+        {
+            next if ($line eq '');
+            return undef unless ($line =~ m{^(\S+)\s+(\S+)\s+HTTP/(\d\.\d)$});
+            @req{qw(method path version)} = ($1, $2, $3);
+        }
+        elsif ($line eq '')
+        {
+            last;
+        }
+        elsif ($line =~ m{^([^:]+):\s*(.*)$})
+        {
+            $req{headers}->{lc($1)} = $2;
+        }
+    }
+    my $connection = lc($req{headers}->{connection} || '');
+    $req{close} = ($connection eq 'close') || (($req{version} eq '1.0') && ($connection ne 'keep-alive'));
+    return \%req;
+}
+
+# Get image, convert it, returns status, headers and body
+sub handleRequest
+{
+    my ($req) = @_;
+    return ('405 Method Not Allowed', {}, '') unless ($req->{method} eq 'GET');
+
+    # Get image
+    my $image;
+    if ($isLms)
+    {
+        my $resp = $http->get($source . $req->{path});
+        return ("$resp->{status} $resp->{reason}", {}, '') unless ($resp->{success});
+        $image = $resp->{content};
+    }
+    else
+    {
+        return ('404 Not Found', {}, '') unless ($req->{path} =~ m{^/music/([^/]+)/});
+        my $coverId = $1;
+        opendir(my $dh, $source) || return ('500 Internal Server Error', {}, '');
+        my ($file) = grep { m{^\Q$coverId\E\.\w+$} && -f "$source/$_" } readdir($dh);
+        closedir($dh);
+        return ('404 Not Found', {}, '') unless ($file);
+        $image = slurp("$source/$file");
+    }
+
+    # Convert to raw RGB of the panel size, and to AADC
+    my ($width, $height) = $req->{path} =~ m{_(\d+)x(\d+)} ? ($1, $2) : (64, 64);
+    my $rgb = convert($image, $width, $height);
+    return ('502 Bad Gateway', {}, '') unless (defined $rgb);
+    my $aadc = Ffi::Aadc::encode($rgb, $width, $height, $aadcFormat);
+
+    my $etag = '"' . md5_hex($aadc) . '"';
+    if (($req->{headers}->{'if-none-match'} || '') eq $etag)
+    {
+        return ('304 Not Modified', { 'ETag' => $etag }, '');
+    }
+    return ('200 OK', { 'Content-Type' => 'image/x-aadc', 'ETag' => $etag }, $aadc);
+}
+
+# Resize (exact size, like the firmware's downscaler would) and return raw RGB data
+sub convert
+{
+    my ($image, $width, $height) = @_;
+    my ($fh, $tmpFile) = tempfile(UNLINK => 1);
+    binmode($fh);
+    print($fh $image);
+    close($fh);
+    open(my $pipe, '-|', 'convert', "$tmpFile\[0\]", '-flatten', '-resize', "${width}x${height}!",
+        '-depth', '8', 'rgb:-') || return undef;
+    binmode($pipe);
+    local $/;
+    my $rgb = <$pipe>;
+    close($pipe);
+    unlink($tmpFile);
+    return (defined($rgb) && (length($rgb) == $width * $height * 3)) ? $rgb : undef;
+}
+
+sub slurp
+{
+    my ($file) = @_;
+    local $/;
+    open(F, '<', $file) || die("Cannot read $file: $!");
+    binmode(F);
+    my $c = <F>;
+    close(F);
+    return $c;
+}
+
+# eof
@@ -0,0 +1,625 @@
+/*!
+    \file
+    \brief flipflip's Album Art Display: host benchmark of the GIF draw callback (sGifDraw() in display.cpp)
+
+    - Copyright (c) 2020 Philippe Kehl (flipflip at oinkzwurgl dot org),
+      https://oinkzwurgl.org/projaeggd/album-art-display
+
+    Decodes the GIFs given on the command line (LZW, frame geometry, palettes, transparency) into the lines that
+    AnimatedGIF hands to the draw callback, and then times the draw callback alone: sGifDraw() as it is in display.cpp
+    (extracted into gifdraw.inc by the Makefile) against the original per-pixel RGB565 expansion (sGifDrawOld() below,
+    as it was before the palette was expanded per frame). Both must produce the same canvas.
+
+    It also plays the GIFs, and generated frame sequences with all disposal methods, the way the firmware does
+    (sGifPrepare() and sGifDraw() with two buffers) and checks the result after every frame against a straightforward
+    implementation of the disposal methods.
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <chrono>
+#include <vector>
+#include <string>
+
+#define MIN(a, b) ((b) < (a) ? (b) : (a))
+#define MAX(a, b) ((b) > (a) ? (b) : (a))
+#define CLIP(x, a, b) ((x) <= (a) ? (a) : ((x) >= (b) ? (b) : (x)))
+
+#define LEDDISPLAY_WIDTH  64
+#define LEDDISPLAY_HEIGHT 64
+
+typedef struct leddisplay_frame_s
+{
+    uint8_t yx[LEDDISPLAY_HEIGHT][LEDDISPLAY_WIDTH][3];
+} leddisplay_frame_t;
+
+// The part of AnimatedGIF's GIFDRAW that the callback uses
+typedef struct GIFDRAW_s
+{
+    int       iX, iY;             // frame position on the canvas
+    int       y;                  // line in the frame
+    int       iWidth;             // frame width
+    uint8_t  *pPixels;            // palette indices of the line
+    uint16_t *pPalette;           // RGB565 palette
+    uint8_t   ucTransparent;
+    uint8_t   ucHasTransparency;
+    uint8_t   ucDisposalMethod;
+    uint8_t   ucBackground;
+} GIFDRAW;
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+typedef void *TaskHandle_t;
+typedef void *SemaphoreHandle_t;
+typedef void *esp_timer_handle_t;
+
+// GIF_RECT_t, GIF_DEC_t, sGifDec, sGifDrawFrame, sGifRestore, sGifPalette, sGifDraw() and sGifPrepare() from
+// display.cpp
+#include "gifdraw.inc"
+
+// The original draw callback (from the AnimatedGIF examples), for comparison
+static void sGifDrawPixel(const uint16_t x, const uint16_t y, const uint16_t rgb585)
+{
+    const uint16_t r5 = (rgb585 & 0xf800) >> 11;
+    const uint16_t g6 = (rgb585 & 0x07e0) >>  5;
+    const uint16_t b5 = (rgb585 & 0x001f);
+    const uint8_t r8 = ((r5 * 527) + 23 ) >> 6;
+    const uint8_t g8 = ((g6 * 259) + 33 ) >> 6;
+    const uint8_t b8 = ((b5 * 527) + 23 ) >> 6;
+    if ( (x < LEDDISPLAY_WIDTH) && (y < LEDDISPLAY_HEIGHT) )
+    {
+        sGifDrawFrame->yx[y][x][0] = r8;
+        sGifDrawFrame->yx[y][x][1] = g8;
+        sGifDrawFrame->yx[y][x][2] = b8;
+    }
+}
+
+static void sGifDrawOld(GIFDRAW *pDraw)
+{
+    const uint16_t *usPalette = pDraw->pPalette;
+    const int y = pDraw->iY + pDraw->y; // current line
+
+    GIF_RECT_t *curr = &sGifDec.curr;
+    if (pDraw->y == 0)
+    {
+        curr->x0 = pDraw->iX;
+        curr->x1 = pDraw->iX + pDraw->iWidth;
+        curr->y0 = y;
+        curr->disposal = pDraw->ucDisposalMethod;
+        if (pDraw->ucHasTransparency && (pDraw->ucBackground == pDraw->ucTransparent))
+        {
+            curr->bg[0] = curr->bg[1] = curr->bg[2] = 0;
+        }
+        else
+        {
+            const uint16_t bg = usPalette[pDraw->ucBackground];
+            curr->bg[0] = (((bg & 0xf800) >> 11) * 527 + 23) >> 6;
+            curr->bg[1] = (((bg & 0x07e0) >>  5) * 259 + 33) >> 6;
+            curr->bg[2] = (( bg & 0x001f       ) * 527 + 23) >> 6;
+        }
+    }
+    curr->y1 = y + 1;
+
+    uint8_t *pixels = pDraw->pPixels;
+    if (pDraw->ucHasTransparency)
+    {
+        const uint8_t ucTransparent = pDraw->ucTransparent;
+        const uint8_t *pEnd = pixels + pDraw->iWidth;
+        int x = 0;
+        int iCount = 0;
+        uint8_t c;
+        while (x < pDraw->iWidth)
+        {
+            c = ucTransparent - 1;
+            static uint16_t usTemp[320];
+            uint16_t *d = usTemp;
+            while (c != ucTransparent && pixels < pEnd)
+            {
+                c = *pixels++;
+                if (c == ucTransparent)
+                {
+                    pixels--;
+                }
+                else
+                {
+                    *d++ = usPalette[c];
+                    iCount++;
+                }
+            }
+            if (iCount)
+            {
+                for (int xOffset = 0; xOffset < iCount; xOffset++ )
+                {
+                    sGifDrawPixel(pDraw->iX + x + xOffset, y, usTemp[xOffset]);
+                }
+                x += iCount;
+                iCount = 0;
+            }
+            c = ucTransparent;
+            while (c == ucTransparent && pixels < pEnd)
+            {
+                c = *pixels++;
+                if (c == ucTransparent)
+                {
+                    iCount++;
+                }
+                else
+                {
+                    pixels--;
+                }
+            }
+            if (iCount)
+            {
+                x += iCount;
+                iCount = 0;
+            }
+        }
+    }
+    else
+    {
+        uint16_t x = pDraw->iX;
+        for (int ix = 0; ix < pDraw->iWidth; ix++, x++)
+        {
+            sGifDrawPixel(x, y, usPalette[pixels[ix]]);
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+// A decoded frame: the callback parameters and the palette indices of all lines
+typedef struct FRAME_s
+{
+    GIFDRAW               draw;
+    std::vector<uint16_t> palette;
+    std::vector<uint8_t>  pixels;   // iWidth * height
+    int                   height;
+} FRAME_t;
+
+static uint16_t sRgb565(const uint8_t *rgb)
+{
+    return ((rgb[0] >> 3) << 11) | ((rgb[1] >> 2) << 5) | (rgb[2] >> 3);
+}
+
+// Read the data sub-blocks starting at offs, returns the offset after the terminator
+static size_t sGifSubBlocks(const std::vector<uint8_t> &gif, size_t offs, std::vector<uint8_t> *data)
+{
+    while ( (offs < gif.size()) && (gif[offs] != 0) )
+    {
+        const size_t len = gif[offs];
+        if ((offs + 1 + len) > gif.size())
+        {
+            return gif.size();
+        }
+        if (data != NULL)
+        {
+            data->insert(data->end(), &gif[offs + 1], &gif[offs + 1 + len]);
+        }
+        offs += 1 + len;
+    }
+    return offs + 1;
+}
+
+static bool sGifLzw(const std::vector<uint8_t> &in, const int minCodeSize, std::vector<uint8_t> &out, const size_t size)
+{
+    static uint16_t prefix[4096];
+    static uint8_t  suffix[4096];
+    static uint8_t  stack[4097];
+    const int clear = 1 << minCodeSize;
+    int codeSize = minCodeSize + 1;
+    int next = clear + 2;
+    int prev = -1;
+    uint8_t first = 0;
+    uint32_t acc = 0;
+    int nBits = 0;
+    size_t ix = 0;
+    for (int code = 0; code < clear; code++)
+    {
+        prefix[code] = 0xffff;
+        suffix[code] = code;
+    }
+    while (out.size() < size)
+    {
+        while ( (nBits < codeSize) && (ix < in.size()) )
+        {
+            acc |= (uint32_t)in[ix++] << nBits;
+            nBits += 8;
+        }
+        if (nBits < codeSize)
+        {
+            break;
+        }
+        int code = acc & ((1 << codeSize) - 1);
+        acc >>= codeSize;
+        nBits -= codeSize;
+        if (code == clear)
+        {
+            codeSize = minCodeSize + 1;
+            next = clear + 2;
+            prev = -1;
+            continue;
+        }
+        if (code == (clear + 1))
+        {
+            break;
+        }
+        if (prev < 0)
+        {
+            if (code >= clear)
+            {
+                return false;
+            }
+            out.push_back(code);
+            first = code;
+            prev = code;
+            continue;
+        }
+        int sp = 0;
+        int cur = code;
+        if (code >= next)
+        {
+            if (code > next)
+            {
+                return false;
+            }
+            stack[sp++] = first;
+            cur = prev;
+        }
+        while (cur >= clear)
+        {
+            stack[sp++] = suffix[cur];
+            cur = prefix[cur];
+        }
+        stack[sp++] = cur;
+        first = cur;
+        while (sp > 0)
+        {
+            out.push_back(stack[--sp]);
+        }
+        if (next < 4096)
+        {
+            prefix[next] = prev;
+            suffix[next] = first;
+            next++;
+            if ( (next == (1 << codeSize)) && (codeSize < 12) )
+            {
+                codeSize++;
+            }
+        }
+        prev = code;
+    }
+    out.resize(size, 0);
+    return true;
+}
+
+static bool sGifDecode(const char *file, std::vector<FRAME_t> &frames)
+{
+    std::vector<uint8_t> gif;
+    FILE *fh = fopen(file, "rb");
+    if (fh == NULL)
+    {
+        return false;
+    }
+    uint8_t buf[4096];
+    size_t n;
+    while ( (n = fread(buf, 1, sizeof(buf), fh)) > 0 )
+    {
+        gif.insert(gif.end(), buf, buf + n);
+    }
+    fclose(fh);
+    if ( (gif.size() < 13) || (memcmp(gif.data(), "GIF8", 4) != 0) )
+    {
+        return false;
+    }
+
+    std::vector<uint16_t> globalPalette(256, 0);
+    const uint8_t flags = gif[10];
+    const uint8_t background = gif[11];
+    size_t offs = 13;
+    if (flags & 0x80)
+    {
+        const int num = 2 << (flags & 7);
+        for (int ix = 0; (ix < num) && ((offs + 3) <= gif.size()); ix++, offs += 3)
+        {
+            globalPalette[ix] = sRgb565(&gif[offs]);
+        }
+    }
+
+    int disposal = 0;
+    int transparent = -1;
+    while (offs < gif.size())
+    {
+        const uint8_t block = gif[offs++];
+        if (block == 0x3b)
+        {
+            break;
+        }
+        else if (block == 0x21)
+        {
+            if (offs >= gif.size())
+            {
+                break;
+            }
+            const uint8_t label = gif[offs++];
+            if ( (label == 0xf9) && ((offs + 5) <= gif.size()) )
+            {
+                disposal = (gif[offs + 1] >> 2) & 7;
+                transparent = (gif[offs + 1] & 1) ? gif[offs + 4] : -1;
+            }
+            offs = sGifSubBlocks(gif, offs, NULL);
+        }
+        else if ( (block == 0x2c) && ((offs + 9) <= gif.size()) )
+        {
+            FRAME_t frame;
+            frame.draw.iX = gif[offs + 0] | (gif[offs + 1] << 8);
+            frame.draw.iY = gif[offs + 2] | (gif[offs + 3] << 8);
+            frame.draw.iWidth = gif[offs + 4] | (gif[offs + 5] << 8);
+            frame.height = gif[offs + 6] | (gif[offs + 7] << 8);
+            const uint8_t imgFlags = gif[offs + 8];
+            offs += 9;
+            frame.palette = globalPalette;
+            if (imgFlags & 0x80)
+            {
+                const int num = 2 << (imgFlags & 7);
+                frame.palette.assign(256, 0);
+                for (int ix = 0; (ix < num) && ((offs + 3) <= gif.size()); ix++, offs += 3)
+                {
+                    frame.palette[ix] = sRgb565(&gif[offs]);
+                }
+            }
+            if (offs >= gif.size())
+            {
+                break;
+            }
+            const int minCodeSize = gif[offs++];
+            std::vector<uint8_t> lzw;
+            offs = sGifSubBlocks(gif, offs, &lzw);
+            std::vector<uint8_t> pixels;
+            const size_t size = (size_t)frame.draw.iWidth * frame.height;
+            if ( (minCodeSize < 2) || (minCodeSize > 8) || !sGifLzw(lzw, minCodeSize, pixels, size) )
+            {
+                return false;
+            }
+            // Interlaced: rows 0, 8, 16, ..., 4, 12, ..., 2, 6, ..., 1, 3, ...
+            if (imgFlags & 0x40)
+            {
+                frame.pixels.resize(size);
+                int src = 0;
+                const int starts[] = { 0, 4, 2, 1 }, steps[] = { 8, 8, 4, 2 };
+                for (int pass = 0; pass < 4; pass++)
+                {
+                    for (int y = starts[pass]; y < frame.height; y += steps[pass], src++)
+                    {
+                        memcpy(&frame.pixels[(size_t)y * frame.draw.iWidth],
+                            &pixels[(size_t)src * frame.draw.iWidth], frame.draw.iWidth);
+                    }
+                }
+            }
+            else
+            {
+                frame.pixels.swap(pixels);
+            }
+            frame.draw.ucTransparent = transparent >= 0 ? transparent : 0;
+            frame.draw.ucHasTransparency = transparent >= 0;
+            frame.draw.ucDisposalMethod = disposal;
+            frame.draw.ucBackground = background;
+            frames.push_back(frame);
+            disposal = 0;
+            transparent = -1;
+        }
+        else
+        {
+            break;
+        }
+    }
+    for (FRAME_t &frame : frames)
+    {
+        frame.draw.pPalette = frame.palette.data();
+    }
+    return !frames.empty();
+}
+
+// Frames with random position, size, pixels, transparency and disposal method, partly outside the canvas
+static void sGifGenerate(std::vector<FRAME_t> &frames, const int nFrames)
+{
+    for (int ix = 0; ix < nFrames; ix++)
+    {
+        FRAME_t frame;
+        memset(&frame.draw, 0, sizeof(frame.draw));
+        frame.draw.iX = rand() % (LEDDISPLAY_WIDTH + 8);
+        frame.draw.iY = rand() % (LEDDISPLAY_HEIGHT + 8);
+        frame.draw.iWidth = 1 + (rand() % LEDDISPLAY_WIDTH);
+        frame.height = 1 + (rand() % LEDDISPLAY_HEIGHT);
+        frame.palette.resize(256);
+        for (uint16_t &rgb565 : frame.palette)
+        {
+            rgb565 = rand();
+        }
+        frame.pixels.resize((size_t)frame.draw.iWidth * frame.height);
+        for (uint8_t &pixel : frame.pixels)
+        {
+            pixel = rand() % 8;
+        }
+        frame.draw.ucHasTransparency = (rand() % 2) == 0;
+        frame.draw.ucTransparent = rand() % 8;
+        frame.draw.ucBackground = rand() % 8;
+        frame.draw.ucDisposalMethod = rand() % 4;
+        frames.push_back(frame);
+    }
+    for (FRAME_t &frame : frames)
+    {
+        frame.draw.pPalette = frame.palette.data();
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+static void sDrawFrame(void (*draw)(GIFDRAW *), FRAME_t &frame)
+{
+    GIFDRAW pDraw = frame.draw;
+    for (int y = 0; y < frame.height; y++)
+    {
+        pDraw.y = y;
+        pDraw.pPixels = &frame.pixels[(size_t)y * frame.draw.iWidth];
+        draw(&pDraw);
+    }
+}
+
+static double sBench(void (*draw)(GIFDRAW *), std::vector<std::vector<FRAME_t>> &gifs, const int nRuns)
+{
+    static leddisplay_frame_t canvas;
+    sGifDrawFrame = &canvas;
+    const auto t0 = std::chrono::steady_clock::now();
+    for (int run = 0; run < nRuns; run++)
+    {
+        for (std::vector<FRAME_t> &frames : gifs)
+        {
+            for (FRAME_t &frame : frames)
+            {
+                sDrawFrame(draw, frame);
+            }
+        }
+    }
+    const auto t1 = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(t1 - t0).count();
+}
+
+// Play the frames like the firmware (sGifDecodeTask(), sDisplayGif()) and like the GIF spec says, returns the number
+// of frames that differ
+static int sPlay(std::vector<FRAME_t> &frames)
+{
+    static leddisplay_frame_t bufs[2], canvas, saved;
+    memset(bufs, 0, sizeof(bufs));
+    memset(&canvas, 0, sizeof(canvas));
+    GIF_RECT_t prev;
+    memset(&prev, 0, sizeof(prev));
+    int front = 0;
+    int nDiff = 0;
+    for (FRAME_t &frame : frames)
+    {
+        // Firmware
+        leddisplay_frame_t *back = &bufs[1 - front];
+        sGifPrepare(back, &bufs[front], &prev);
+        sGifDrawFrame = back;
+        memset(&sGifDec.curr, 0, sizeof(sGifDec.curr));
+        sDrawFrame(sGifDraw, frame);
+        prev = sGifDec.curr;
+        front = 1 - front;
+
+        // Reference: draw, compare, dispose
+        if (frame.draw.ucDisposalMethod == 3)
+        {
+            saved = canvas;
+        }
+        sGifDrawFrame = &canvas;
+        sDrawFrame(sGifDrawOld, frame);
+        if (memcmp(&canvas, &bufs[front], sizeof(canvas)) != 0)
+        {
+            nDiff++;
+        }
+        const GIF_RECT_t *rect = &sGifDec.curr;
+        for (int y = MAX(rect->y0, 0); y < MIN(rect->y1, LEDDISPLAY_HEIGHT); y++)
+        {
+            for (int x = MAX(rect->x0, 0); x < MIN(rect->x1, LEDDISPLAY_WIDTH); x++)
+            {
+                if (rect->disposal == 2)
+                {
+                    memcpy(canvas.yx[y][x], rect->bg, 3);
+                }
+                else if (rect->disposal == 3)
+                {
+                    memcpy(canvas.yx[y][x], saved.yx[y][x], 3);
+                }
+            }
+        }
+    }
+    return nDiff;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: %s <file.gif> ...\n", argv[0]);
+        return 1;
+    }
+
+    // Decode all GIFs
+    std::vector<std::vector<FRAME_t>> gifs;
+    uint64_t nFrames = 0, nLines = 0, nPixels = 0;
+    for (int ix = 1; ix < argc; ix++)
+    {
+        std::vector<FRAME_t> frames;
+        if (!sGifDecode(argv[ix], frames))
+        {
+            fprintf(stderr, "Skipping %s: bad GIF\n", argv[ix]);
+            continue;
+        }
+        for (const FRAME_t &frame : frames)
+        {
+            nFrames++;
+            nLines += frame.height;
+            nPixels += (uint64_t)frame.draw.iWidth * frame.height;
+        }
+        gifs.push_back(frames);
+    }
+
+    // Both callbacks must give the same canvas (and frame rectangles) after every frame
+    static leddisplay_frame_t canvasOld, canvasNew;
+    int nDiff = 0;
+    for (std::vector<FRAME_t> &frames : gifs)
+    {
+        for (FRAME_t &frame : frames)
+        {
+            sGifDrawFrame = &canvasOld;
+            sDrawFrame(sGifDrawOld, frame);
+            const GIF_RECT_t rectOld = sGifDec.curr;
+            sGifDrawFrame = &canvasNew;
+            sDrawFrame(sGifDraw, frame);
+            if ( (memcmp(&canvasOld, &canvasNew, sizeof(canvasOld)) != 0) ||
+                 (memcmp(&rectOld, &sGifDec.curr, sizeof(rectOld)) != 0) )
+            {
+                nDiff++;
+            }
+        }
+    }
+
+    // Disposal methods, with the GIFs and with generated frames
+    int nDispDiff = 0, nDispFrames = 0;
+    for (std::vector<FRAME_t> &frames : gifs)
+    {
+        nDispDiff += sPlay(frames);
+        nDispFrames += frames.size();
+    }
+    srand(1);
+    for (int ix = 0; ix < 100; ix++)
+    {
+        std::vector<FRAME_t> frames;
+        sGifGenerate(frames, 50);
+        nDispDiff += sPlay(frames);
+        nDispFrames += frames.size();
+    }
+
+    // Time the callbacks, enough runs for a second or so of the old one
+    int nRuns = 1;
+    while (sBench(sGifDrawOld, gifs, nRuns) < 0.2)
+    {
+        nRuns *= 2;
+    }
+    nRuns *= 5;
+    const double tOld = sBench(sGifDrawOld, gifs, nRuns);
+    const double tNew = sBench(sGifDraw, gifs, nRuns);
+
+    printf("%d GIFs, %llu frames, %llu lines, %llu pixels, %d runs\n", (int)gifs.size(), (unsigned long long)nFrames,
+        (unsigned long long)nLines, (unsigned long long)nPixels, nRuns);
+    printf("old: %8.2f ns/pixel %8.1f ns/line\n", tOld * 1e9 / nRuns / nPixels, tOld * 1e9 / nRuns / nLines);
+    printf("new: %8.2f ns/pixel %8.1f ns/line (%.1fx)\n", tNew * 1e9 / nRuns / nPixels, tNew * 1e9 / nRuns / nLines,
+        tOld / tNew);
+    printf("frames that differ: %d\n", nDiff);
+    printf("frames that differ with disposal: %d/%d\n", nDispDiff, nDispFrames);
+    return (nDiff == 0) && (nDispDiff == 0) ? 0 : 1;
+}
+
+// eof
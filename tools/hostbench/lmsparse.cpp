@@ -0,0 +1,401 @@
+/*!
+    \file
+    \brief flipflip's Album Art Display: host benchmark of the LMS CLI parser (lms.cpp)
+
+    - Copyright (c) 2020 Philippe Kehl (flipflip at oinkzwurgl dot org),
+      https://oinkzwurgl.org/projaeggd/album-art-display
+
+    Parses the LMS CLI lines in the given file (e.g. recorded with tools/lmscap.pl, lines starting with '#' are
+    ignored) with the tokenizer and parsers from lms.cpp (extracted into lmsparse.inc by the Makefile) and checks the
+    results against a straightforward reference (split at spaces, decode, split at the first ':'). It then times the
+    parsers against the original String based parsing (sLmsParam() below, one rescan of the line per tag).
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <cstdint>
+#include <chrono>
+#include <vector>
+#include <string>
+
+#define NUMOF(x) (sizeof(x) / sizeof(*(x)))
+
+// Tokenizer and parsers from lms.cpp
+#include "lmsparse.inc"
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+// Just enough of Arduino's String for sLmsParam()
+class String
+{
+    public:
+        String(const char *str = "") : s(str) {}
+        String(const std::string &str) : s(str) {}
+        int indexOf(const char *str, const int from = 0) const
+        {
+            const size_t ix = s.find(str, from);
+            return ix == std::string::npos ? -1 : (int)ix;
+        }
+        int indexOf(const char c, const int from = 0) const
+        {
+            const size_t ix = s.find(c, from);
+            return ix == std::string::npos ? -1 : (int)ix;
+        }
+        String substring(const int from, const int to) const { return String(s.substr(from, to - from)); }
+        String substring(const int from) const { return String(s.substr(from)); }
+        String operator+(const String &other) const { return String(s + other.s); }
+        int length(void) const { return (int)s.size(); }
+        const char *c_str(void) const { return s.c_str(); }
+        void remove(const int ix) { s.resize(ix); }
+        void replace(const char *from, const char *to)
+        {
+            const size_t lenFrom = strlen(from), lenTo = strlen(to);
+            for (size_t ix = s.find(from); ix != std::string::npos; ix = s.find(from, ix + lenTo))
+            {
+                s.replace(ix, lenFrom, to);
+            }
+        }
+    private:
+        std::string s;
+};
+
+// The original parameter extraction
+static String sLmsParam(const String &resp, const char *param, const bool decode = false)
+{
+    String res = "";
+    char search[50];
+    snprintf(search, sizeof(search), " %s%%3A", param); // " mode%3A"
+    const int ix0 = resp.indexOf(search);
+    if (ix0 > 0)
+    {
+        const int ix1 = resp.indexOf(' ', ix0 + 1);
+        res = resp.substring(ix0 + strlen(param) + 1 + 3, ix1 > ix0 ? ix1 : resp.length());
+        res.replace("%0A", "");
+        res.replace("%0D", "");
+    }
+    if (decode && (res.length() > 0))
+    {
+        char *str = (char *)res.c_str();
+        int iOut = 0;
+        for (int iIn = 0; str[iIn] != '\0'; iIn++)
+        {
+            if ( (str[iIn] == '%') && isxdigit(str[iIn + 1]) && isxdigit(str[iIn + 2]) )
+            {
+                const char hex[3] = { str[iIn + 1], str[iIn + 2], '\0' };
+                str[iOut++] = strtol(hex, NULL, 16);
+                iIn += 2;
+            }
+            else
+            {
+                str[iOut++] = str[iIn];
+            }
+        }
+        res.remove(iOut);
+    }
+    return res;
+}
+
+// What the firmware did with a line before (sLmsUpdateStatus(), and sLmsGetPlayers() for one "players <ix> 1"
+// response per player), returns the total length of the extracted values
+static int sLmsParseOld(const String &resp)
+{
+    int len = 0;
+    if (resp.indexOf(" status ") > 0)
+    {
+        len += sLmsParam(resp, "power").length();
+        len += sLmsParam(resp, "mode").length();
+        len += sLmsParam(resp, "player_name", true).length();
+        const int ixCurr = resp.indexOf(" playlist%20index%3A");
+        const int ixNext = ixCurr > 0 ? resp.indexOf(" playlist%20index%3A", ixCurr + 1) : -1;
+        const String curr = ixNext > 0 ? resp.substring(0, ixNext) : resp;
+        len += sLmsParam(curr, "title", true).length();
+        const String tracks[2] = { ixCurr > 0 ? curr.substring(ixCurr) : curr, ixNext > 0 ? resp.substring(ixNext) : "" };
+        for (int ix = 0; ix < 2; ix++)
+        {
+            len += sLmsParam(tracks[ix], "coverid").length();
+            if (sLmsParam(tracks[ix], "artwork_url").length() > 0)
+            {
+                len += sLmsParam(tracks[ix], "artwork_url", true).length();
+            }
+        }
+    }
+    else if (resp.indexOf("players ") == 0)
+    {
+        const int ixFirst = resp.indexOf(" playerindex%3A");
+        for (int ix0 = ixFirst; ix0 > 0; )
+        {
+            const int ix1 = resp.indexOf(" playerindex%3A", ix0 + 1);
+            const String player = resp.substring(0, ixFirst) + resp.substring(ix0, ix1 > 0 ? ix1 : resp.length());
+            len += sLmsParam(player, "count").length();
+            len += sLmsParam(player, "playerid").length();
+            len += sLmsParam(player, "modelname", true).length();
+            len += sLmsParam(player, "isplaying").length();
+            len += sLmsParam(player, "power").length();
+            ix0 = ix1;
+        }
+    }
+    return len;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+// Reference: terms split at spaces and decoded, tags split at the first ':'
+typedef struct TERM_s
+{
+    std::string term;
+    std::string tag;
+    std::string val;
+    bool        hasVal;
+} TERM_t;
+
+static std::vector<TERM_t> sTerms(const std::string &line)
+{
+    std::vector<TERM_t> terms;
+    size_t ix0 = 0;
+    while (ix0 < line.size())
+    {
+        size_t ix1 = line.find(' ', ix0);
+        if (ix1 == std::string::npos)
+        {
+            ix1 = line.size();
+        }
+        if (ix1 > ix0)
+        {
+            TERM_t term;
+            for (size_t ix = ix0; ix < ix1; ix++)
+            {
+                if ( (line[ix] == '%') && ((ix + 2) < ix1) && isxdigit(line[ix + 1]) && isxdigit(line[ix + 2]) )
+                {
+                    term.term += (char)strtol(line.substr(ix + 1, 2).c_str(), NULL, 16);
+                    ix += 2;
+                }
+                else if ( (line[ix] != '\r') && (line[ix] != '\n') )
+                {
+                    term.term += line[ix];
+                }
+            }
+            const size_t colon = term.term.find(':');
+            term.hasVal = colon != std::string::npos;
+            term.tag = term.hasVal ? term.term.substr(0, colon) : term.term;
+            term.val = term.hasVal ? term.term.substr(colon + 1) : "";
+            terms.push_back(term);
+        }
+        ix0 = ix1 + 1;
+    }
+    return terms;
+}
+
+static int sNumErr;
+
+static void sCheck(const int lineNr, const char *what, const std::string &ref, const char *val)
+{
+    if (ref != val)
+    {
+        fprintf(stderr, "line %d: %s: [%s] != [%s]\n", lineNr, what, val, ref.c_str());
+        sNumErr++;
+    }
+}
+
+static void sCheckLine(const int lineNr, const std::string &line)
+{
+    const std::vector<TERM_t> terms = sTerms(line);
+    std::vector<char> buf(line.begin(), line.end());
+    buf.push_back('\0');
+
+    // Status
+    LMS_STATUS_t status;
+    const bool isStatus = (terms.size() > 1) && (terms[1].term == "status");
+    if (sLmsParseStatus(buf.data(), &status) != isStatus)
+    {
+        fprintf(stderr, "line %d: status not detected\n", lineNr);
+        sNumErr++;
+    }
+    if (isStatus)
+    {
+        std::string ref[4] = { terms[0].term, "", "", "" };
+        std::string refTracks[2][3];
+        int nTracks = 0;
+        for (const TERM_t &term : terms)
+        {
+            if (!term.hasVal) { continue; }
+            if (term.tag == "playlist index") { nTracks++; }
+            else if (nTracks > 2) { }
+            else if (term.tag == "player_name") { ref[1] = term.val; }
+            else if (term.tag == "power") { ref[2] = term.val; }
+            else if (term.tag == "mode") { ref[3] = term.val; }
+            else if ( (nTracks > 0) && (term.tag == "title") ) { refTracks[nTracks - 1][0] = term.val; }
+            else if ( (nTracks > 0) && (term.tag == "coverid") ) { refTracks[nTracks - 1][1] = term.val; }
+            else if ( (nTracks > 0) && (term.tag == "artwork_url") ) { refTracks[nTracks - 1][2] = term.val; }
+        }
+        sCheck(lineNr, "playerId", ref[0], status.playerId);
+        sCheck(lineNr, "playerName", ref[1], status.playerName);
+        sCheck(lineNr, "power", ref[2], status.power);
+        sCheck(lineNr, "mode", ref[3], status.mode);
+        sCheck(lineNr, "nTracks", std::to_string(nTracks > 2 ? 2 : nTracks), std::to_string(status.nTracks).c_str());
+        for (int ix = 0; ix < status.nTracks; ix++)
+        {
+            sCheck(lineNr, "title", refTracks[ix][0], status.tracks[ix].title);
+            sCheck(lineNr, "coverId", refTracks[ix][1], status.tracks[ix].coverId);
+            sCheck(lineNr, "artworkUrl", refTracks[ix][2], status.tracks[ix].artworkUrl);
+        }
+    }
+
+    // Players
+    buf.assign(line.begin(), line.end());
+    buf.push_back('\0');
+    LMS_PLAYERS_t players;
+    const bool isPlayers = !terms.empty() && (terms[0].term == "players");
+    if (sLmsParsePlayers(buf.data(), &players) != isPlayers)
+    {
+        fprintf(stderr, "line %d: players not detected\n", lineNr);
+        sNumErr++;
+    }
+    if (isPlayers)
+    {
+        std::string refCount = "-1";
+        std::vector<std::vector<std::string>> refPlayers;
+        for (const TERM_t &term : terms)
+        {
+            if (!term.hasVal) { continue; }
+            if (term.tag == "count") { refCount = term.val; }
+            else if (term.tag == "playerindex") { refPlayers.push_back(std::vector<std::string>(4)); }
+            else if (refPlayers.empty()) { }
+            else if (term.tag == "playerid") { refPlayers.back()[0] = term.val; }
+            else if (term.tag == "modelname") { refPlayers.back()[1] = term.val; }
+            else if (term.tag == "power") { refPlayers.back()[2] = term.val; }
+            else if (term.tag == "isplaying") { refPlayers.back()[3] = term.val; }
+        }
+        sCheck(lineNr, "count", refCount, std::to_string(players.count).c_str());
+        sCheck(lineNr, "num", std::to_string(refPlayers.size()), std::to_string(players.num).c_str());
+        for (int ix = 0; (ix < players.num) && (ix < (int)refPlayers.size()); ix++)
+        {
+            sCheck(lineNr, "playerId", refPlayers[ix][0], players.players[ix].playerId);
+            sCheck(lineNr, "modelName", refPlayers[ix][1], players.players[ix].modelName);
+            sCheck(lineNr, "power", refPlayers[ix][2], players.players[ix].power);
+            sCheck(lineNr, "isPlaying", refPlayers[ix][3], players.players[ix].isPlaying);
+        }
+    }
+
+    // Client events
+    buf.assign(line.begin(), line.end());
+    buf.push_back('\0');
+    LMS_CLIENT_t client;
+    const bool isClient = (terms.size() > 2) && (terms[1].term == "client");
+    if (sLmsParseClient(buf.data(), &client) != isClient)
+    {
+        fprintf(stderr, "line %d: client not detected\n", lineNr);
+        sNumErr++;
+    }
+    if (isClient)
+    {
+        sCheck(lineNr, "playerId", terms[0].term, client.playerId);
+        sCheck(lineNr, "event", terms[2].term, client.event);
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+int main(int argc, char **argv)
+{
+    if (argc != 2)
+    {
+        fprintf(stderr, "Usage: %s <traffic.txt>\n", argv[0]);
+        return 1;
+    }
+    FILE *fh = fopen(argv[1], "r");
+    if (fh == NULL)
+    {
+        fprintf(stderr, "Cannot read %s\n", argv[1]);
+        return 1;
+    }
+    std::vector<std::string> lines;
+    std::vector<int> lineNrs;
+    static char buf[64 * 1024];
+    int lineNr = 0;
+    while (fgets(buf, sizeof(buf), fh) != NULL)
+    {
+        lineNr++;
+        std::string line = buf;
+        while (!line.empty() && ((line.back() == '\n') || (line.back() == '\r')))
+        {
+            line.pop_back();
+        }
+        if (line.empty() || (line[0] == '#'))
+        {
+            continue;
+        }
+        lines.push_back(line);
+        lineNrs.push_back(lineNr);
+    }
+    fclose(fh);
+
+    // Check
+    size_t nBytes = 0;
+    for (size_t ix = 0; ix < lines.size(); ix++)
+    {
+        sCheckLine(lineNrs[ix], lines[ix]);
+        nBytes += lines[ix].size();
+    }
+
+    // Time the old and the new parsing (the new one including the copy of the line into the line buffer)
+    std::vector<String> oldLines(lines.begin(), lines.end());
+    static char line[8192];
+    int nRuns = 1;
+    double tOld = 0.0, tNew = 0.0;
+    unsigned long sum = 0;
+    while (true)
+    {
+        const auto t0 = std::chrono::steady_clock::now();
+        for (int run = 0; run < nRuns; run++)
+        {
+            for (const String &resp : oldLines)
+            {
+                sum += sLmsParseOld(resp);
+            }
+        }
+        const auto t1 = std::chrono::steady_clock::now();
+        for (int run = 0; run < nRuns; run++)
+        {
+            for (const std::string &resp : lines)
+            {
+                const size_t len = resp.size() < (sizeof(line) - 1) ? resp.size() : (sizeof(line) - 1);
+                memcpy(line, resp.data(), len);
+                line[len] = '\0';
+                LMS_CLIENT_t client;
+                LMS_STATUS_t status;
+                LMS_PLAYERS_t players;
+                if (sLmsParseClient(line, &client))
+                {
+                    sum += strlen(client.event);
+                }
+                else if (sLmsParseStatus(line, &status))
+                {
+                    sum += status.nTracks;
+                }
+                else if (sLmsParsePlayers(line, &players))
+                {
+                    sum += players.num;
+                }
+            }
+        }
+        const auto t2 = std::chrono::steady_clock::now();
+        tOld = std::chrono::duration<double>(t1 - t0).count();
+        tNew = std::chrono::duration<double>(t2 - t1).count();
+        if (tOld > 1.0)
+        {
+            break;
+        }
+        nRuns *= 2;
+    }
+
+    const double nLines = (double)lines.size() * nRuns;
+    printf("%d lines, %d bytes, %d runs (%lu)\n", (int)lines.size(), (int)nBytes, nRuns, sum % 10);
+    printf("old: %8.0f ns/line\n", tOld * 1e9 / nLines);
+    printf("new: %8.0f ns/line (%.1fx)\n", tNew * 1e9 / nLines, tOld / tNew);
+    printf("errors: %d\n", sNumErr);
+    return sNumErr == 0 ? 0 : 1;
+}
+
+// eof
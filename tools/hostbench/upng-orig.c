@@ -0,0 +1,1383 @@
+/*
+ * flipflip's Album Art Display: the upng decoder as it was before the inflate rewrite (table-driven Huffman decoding),
+ * for comparison in the upng host benchmark (upngbench.cpp). This is src/upng.c from before that change, unmodified
+ * except for this comment and the renaming of the public functions below (so that it can be linked together with the
+ * current src/upng.c).
+ */
+#define upng_new_from_bytes  orig_upng_new_from_bytes
+#define upng_new_from_file   orig_upng_new_from_file
+#define upng_new_from_stream orig_upng_new_from_stream
+#define upng_free            orig_upng_free
+#define upng_header          orig_upng_header
+#define upng_decode          orig_upng_decode
+#define upng_decode_rows     orig_upng_decode_rows
+#define upng_get_error       orig_upng_get_error
+#define upng_get_error_line  orig_upng_get_error_line
+#define upng_get_width       orig_upng_get_width
+#define upng_get_height      orig_upng_get_height
+#define upng_get_bpp         orig_upng_get_bpp
+#define upng_get_bitdepth    orig_upng_get_bitdepth
+#define upng_get_components  orig_upng_get_components
+#define upng_get_pixelsize   orig_upng_get_pixelsize
+#define upng_get_format      orig_upng_get_format
+#define upng_get_buffer      orig_upng_get_buffer
+#define upng_get_size        orig_upng_get_size
+
+/*
+uPNG -- derived from LodePNG version 20100808
+
+Copyright (c) 2005-2010 Lode Vandevenne
+Copyright (c) 2010 Sean Middleditch
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+		1. The origin of this software must not be misrepresented; you must not
+		claim that you wrote the original software. If you use this software
+		in a product, an acknowledgment in the product documentation would be
+		appreciated but is not required.
+
+		2. Altered source versions must be plainly marked as such, and must not be
+		misrepresented as being the original software.
+
+		3. This notice may not be removed or altered from any source
+		distribution.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "upng.h"
+
+#define MAKE_BYTE(b) ((b) & 0xFF)
+#define MAKE_DWORD(a,b,c,d) ((MAKE_BYTE(a) << 24) | (MAKE_BYTE(b) << 16) | (MAKE_BYTE(c) << 8) | MAKE_BYTE(d))
+#define MAKE_DWORD_PTR(p) MAKE_DWORD((p)[0], (p)[1], (p)[2], (p)[3])
+
+#define CHUNK_IHDR MAKE_DWORD('I','H','D','R')
+#define CHUNK_IDAT MAKE_DWORD('I','D','A','T')
+#define CHUNK_IEND MAKE_DWORD('I','E','N','D')
+
+#define FIRST_LENGTH_CODE_INDEX 257
+#define LAST_LENGTH_CODE_INDEX 285
+
+#define NUM_DEFLATE_CODE_SYMBOLS 288	/*256 literals, the end code, some length codes, and 2 unused codes */
+#define NUM_DISTANCE_SYMBOLS 32	/*the distance codes have their own symbols, 30 used, 2 unused */
+#define NUM_CODE_LENGTH_CODES 19	/*the code length codes. 0-15: code lengths, 16: copy previous 3-6 times, 17: 3-10 zeros, 18: 11-138 zeros */
+#define MAX_SYMBOLS 288 /* largest number of symbols used by any tree type */
+
+#define DEFLATE_CODE_BITLEN 15
+#define DISTANCE_BITLEN 15
+#define CODE_LENGTH_BITLEN 7
+#define MAX_BIT_LENGTH 15 /* largest bitlen used by any tree type */
+
+#define DEFLATE_CODE_BUFFER_SIZE (NUM_DEFLATE_CODE_SYMBOLS * 2)
+#define DISTANCE_BUFFER_SIZE (NUM_DISTANCE_SYMBOLS * 2)
+#define CODE_LENGTH_BUFFER_SIZE (NUM_DISTANCE_SYMBOLS * 2)
+
+#define SET_ERROR(upng,code) do { (upng)->error = (code); (upng)->error_line = __LINE__; } while (0)
+
+#define upng_chunk_critical(type) (((type) & 0x20000000) == 0)
+
+typedef enum upng_state {
+	UPNG_ERROR		= -1,
+	UPNG_DECODED	= 0,
+	UPNG_HEADER		= 1,
+	UPNG_NEW		= 2
+} upng_state;
+
+typedef enum upng_color {
+	UPNG_LUM		= 0,
+	UPNG_RGB		= 2,
+	UPNG_LUMA		= 4,
+	UPNG_RGBA		= 6
+} upng_color;
+
+#define UPNG_INBUF_SIZE 512	/* size of the input buffer for reading from the source */
+
+typedef struct upng_source {
+	upng_read_fn			read;	/* read function */
+	void*					user;	/* read function user data */
+	const unsigned char*	buffer;	/* memory source (upng_new_from_bytes(), upng_new_from_file()) */
+	unsigned long			size;
+	unsigned long			pos;
+	char					owning;
+} upng_source;
+
+typedef struct upng_stream {
+	unsigned char	inbuf[UPNG_INBUF_SIZE];	/* input buffer */
+	unsigned		inpos;					/* next byte in input buffer */
+	unsigned		inlen;					/* number of bytes in input buffer */
+	unsigned long	chunk_left;				/* remaining bytes in current IDAT chunk */
+	char			in_idat;				/* currently in an IDAT chunk */
+	unsigned		bitbuf;					/* bit buffer */
+	unsigned		bitcnt;					/* number of bits in bit buffer */
+	unsigned char*	window;					/* sliding window (ring buffer) */
+	unsigned long	wmask;					/* window size - 1 */
+	unsigned long	wpos;					/* number of bytes inflated so far */
+	unsigned long	wtotal;					/* number of bytes to inflate (all scanlines incl. filter bytes) */
+	unsigned char*	line;					/* current scanline (filter byte + data) */
+	unsigned char*	prevline;				/* previous (unfiltered) scanline (filter byte + data) */
+	unsigned long	linebytes;				/* size of a scanline (without filter byte) */
+	unsigned long	linepos;				/* next byte in current scanline */
+	unsigned long	bytewidth;				/* bytes per pixel for unfiltering */
+	unsigned		y;						/* current scanline */
+	upng_row_fn		row;					/* row callback */
+	void*			row_user;				/* row callback user data */
+} upng_stream;
+
+struct upng_t {
+	unsigned		width;
+	unsigned		height;
+
+	upng_color		color_type;
+	unsigned		color_depth;
+	upng_format		format;
+
+	unsigned char*	buffer;
+	unsigned long	size;
+
+	upng_error		error;
+	unsigned		error_line;
+
+	upng_state		state;
+	upng_source		source;
+	upng_stream		stream;
+};
+
+typedef struct huffman_tree {
+	unsigned* tree2d;
+	unsigned maxbitlen;	/*maximum number of bits a single code can get */
+	unsigned numcodes;	/*number of symbols in the alphabet = number of codes */
+} huffman_tree;
+
+static const unsigned LENGTH_BASE[29] = {	/*the base lengths represented by codes 257-285 */
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59,
+	67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+
+static const unsigned LENGTH_EXTRA[29] = {	/*the extra bits used by codes 257-285 (added to base length) */
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5,
+	5, 5, 5, 0
+};
+
+static const unsigned DISTANCE_BASE[30] = {	/*the base backwards distances (the bits of distance codes appear after length codes and use their own huffman tree) */
+	1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513,
+	769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+
+static const unsigned DISTANCE_EXTRA[30] = {	/*the extra bits of backwards distances (added to base) */
+	0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10,
+	11, 11, 12, 12, 13, 13
+};
+
+static const unsigned CLCL[NUM_CODE_LENGTH_CODES]	/*the order in which "code length alphabet code lengths" are stored, out of this the huffman tree of the dynamic huffman tree lengths is generated */
+= { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+static const unsigned FIXED_DEFLATE_CODE_TREE[NUM_DEFLATE_CODE_SYMBOLS * 2] = {
+	289, 370, 290, 307, 546, 291, 561, 292, 293, 300, 294, 297, 295, 296, 0, 1,
+	2, 3, 298, 299, 4, 5, 6, 7, 301, 304, 302, 303, 8, 9, 10, 11, 305, 306, 12,
+	13, 14, 15, 308, 339, 309, 324, 310, 317, 311, 314, 312, 313, 16, 17, 18,
+	19, 315, 316, 20, 21, 22, 23, 318, 321, 319, 320, 24, 25, 26, 27, 322, 323,
+	28, 29, 30, 31, 325, 332, 326, 329, 327, 328, 32, 33, 34, 35, 330, 331, 36,
+	37, 38, 39, 333, 336, 334, 335, 40, 41, 42, 43, 337, 338, 44, 45, 46, 47,
+	340, 355, 341, 348, 342, 345, 343, 344, 48, 49, 50, 51, 346, 347, 52, 53,
+	54, 55, 349, 352, 350, 351, 56, 57, 58, 59, 353, 354, 60, 61, 62, 63, 356,
+	363, 357, 360, 358, 359, 64, 65, 66, 67, 361, 362, 68, 69, 70, 71, 364,
+	367, 365, 366, 72, 73, 74, 75, 368, 369, 76, 77, 78, 79, 371, 434, 372,
+	403, 373, 388, 374, 381, 375, 378, 376, 377, 80, 81, 82, 83, 379, 380, 84,
+	85, 86, 87, 382, 385, 383, 384, 88, 89, 90, 91, 386, 387, 92, 93, 94, 95,
+	389, 396, 390, 393, 391, 392, 96, 97, 98, 99, 394, 395, 100, 101, 102, 103,
+	397, 400, 398, 399, 104, 105, 106, 107, 401, 402, 108, 109, 110, 111, 404,
+	419, 405, 412, 406, 409, 407, 408, 112, 113, 114, 115, 410, 411, 116, 117,
+	118, 119, 413, 416, 414, 415, 120, 121, 122, 123, 417, 418, 124, 125, 126,
+	127, 420, 427, 421, 424, 422, 423, 128, 129, 130, 131, 425, 426, 132, 133,
+	134, 135, 428, 431, 429, 430, 136, 137, 138, 139, 432, 433, 140, 141, 142,
+	143, 435, 483, 436, 452, 568, 437, 438, 445, 439, 442, 440, 441, 144, 145,
+	146, 147, 443, 444, 148, 149, 150, 151, 446, 449, 447, 448, 152, 153, 154,
+	155, 450, 451, 156, 157, 158, 159, 453, 468, 454, 461, 455, 458, 456, 457,
+	160, 161, 162, 163, 459, 460, 164, 165, 166, 167, 462, 465, 463, 464, 168,
+	169, 170, 171, 466, 467, 172, 173, 174, 175, 469, 476, 470, 473, 471, 472,
+	176, 177, 178, 179, 474, 475, 180, 181, 182, 183, 477, 480, 478, 479, 184,
+	185, 186, 187, 481, 482, 188, 189, 190, 191, 484, 515, 485, 500, 486, 493,
+	487, 490, 488, 489, 192, 193, 194, 195, 491, 492, 196, 197, 198, 199, 494,
+	497, 495, 496, 200, 201, 202, 203, 498, 499, 204, 205, 206, 207, 501, 508,
+	502, 505, 503, 504, 208, 209, 210, 211, 506, 507, 212, 213, 214, 215, 509,
+	512, 510, 511, 216, 217, 218, 219, 513, 514, 220, 221, 222, 223, 516, 531,
+	517, 524, 518, 521, 519, 520, 224, 225, 226, 227, 522, 523, 228, 229, 230,
+	231, 525, 528, 526, 527, 232, 233, 234, 235, 529, 530, 236, 237, 238, 239,
+	532, 539, 533, 536, 534, 535, 240, 241, 242, 243, 537, 538, 244, 245, 246,
+	247, 540, 543, 541, 542, 248, 249, 250, 251, 544, 545, 252, 253, 254, 255,
+	547, 554, 548, 551, 549, 550, 256, 257, 258, 259, 552, 553, 260, 261, 262,
+	263, 555, 558, 556, 557, 264, 265, 266, 267, 559, 560, 268, 269, 270, 271,
+	562, 565, 563, 564, 272, 273, 274, 275, 566, 567, 276, 277, 278, 279, 569,
+	572, 570, 571, 280, 281, 282, 283, 573, 574, 284, 285, 286, 287, 0, 0
+};
+
+static const unsigned FIXED_DISTANCE_TREE[NUM_DISTANCE_SYMBOLS * 2] = {
+	33, 48, 34, 41, 35, 38, 36, 37, 0, 1, 2, 3, 39, 40, 4, 5, 6, 7, 42, 45, 43,
+	44, 8, 9, 10, 11, 46, 47, 12, 13, 14, 15, 49, 56, 50, 53, 51, 52, 16, 17,
+	18, 19, 54, 55, 20, 21, 22, 23, 57, 60, 58, 59, 24, 25, 26, 27, 61, 62, 28,
+	29, 30, 31, 0, 0
+};
+
+/* read bytes from the source into the input buffer, returns the next byte */
+static unsigned char read_source_byte(upng_t* upng)
+{
+	upng_stream *stream = &upng->stream;
+	if (stream->inpos >= stream->inlen) {
+		stream->inpos = 0;
+		stream->inlen = upng->source.read(upng->source.user, stream->inbuf, sizeof(stream->inbuf));
+		if (stream->inlen == 0) {
+			SET_ERROR(upng, UPNG_EMALFORMED);
+			return 0;
+		}
+	}
+	return stream->inbuf[stream->inpos++];
+}
+
+static unsigned long read_source_dword(upng_t* upng)
+{
+	unsigned long result = 0;
+	unsigned i;
+	for (i = 0; i < 4; i++) {
+		result = (result << 8) | read_source_byte(upng);
+	}
+	return result;
+}
+
+/* walk the chunks until the next IDAT chunk, skipping (ancillary) chunks */
+static void read_next_idat(upng_t* upng)
+{
+	upng_stream *stream = &upng->stream;
+
+	/* skip CRC of previous IDAT chunk */
+	if (stream->in_idat) {
+		read_source_dword(upng);
+		stream->in_idat = 0;
+	}
+
+	while (upng->error == UPNG_EOK) {
+		unsigned long length = read_source_dword(upng);
+		unsigned long type = read_source_dword(upng);
+		if (upng->error != UPNG_EOK) {
+			return;
+		}
+
+		if (length > INT_MAX) {
+			SET_ERROR(upng, UPNG_EMALFORMED);
+			return;
+		}
+
+		if (type == CHUNK_IDAT) {
+			stream->chunk_left = length;
+			stream->in_idat = 1;
+			return;
+		} else if (type == CHUNK_IEND) {
+			/* end of image data before end of compressed stream */
+			SET_ERROR(upng, UPNG_EMALFORMED);
+			return;
+		} else if (upng_chunk_critical(type)) {
+			SET_ERROR(upng, UPNG_EUNSUPPORTED);
+			return;
+		}
+
+		/* skip chunk data and CRC */
+		length += 4;
+		while ((length > 0) && (upng->error == UPNG_EOK)) {
+			read_source_byte(upng);
+			length--;
+		}
+	}
+}
+
+/* get next byte of the compressed data (the concatenated IDAT chunks payload) */
+static unsigned char read_byte(upng_t* upng)
+{
+	upng_stream *stream = &upng->stream;
+	while (stream->chunk_left == 0) {
+		if (upng->error != UPNG_EOK) {
+			return 0;
+		}
+		read_next_idat(upng);
+		if (stream->in_idat && (stream->chunk_left == 0)) {
+			continue; /* empty IDAT chunk */
+		}
+	}
+	stream->chunk_left--;
+	return read_source_byte(upng);
+}
+
+static unsigned char read_bit(upng_t* upng)
+{
+	upng_stream *stream = &upng->stream;
+	unsigned char result;
+	if (stream->bitcnt == 0) {
+		stream->bitbuf = read_byte(upng);
+		stream->bitcnt = 8;
+	}
+	result = (unsigned char)(stream->bitbuf & 1);
+	stream->bitbuf >>= 1;
+	stream->bitcnt--;
+	return result;
+}
+
+static unsigned read_bits(upng_t* upng, unsigned long nbits)
+{
+	unsigned result = 0, i;
+	for (i = 0; i < nbits; i++)
+		result |= ((unsigned)read_bit(upng)) << i;
+	return result;
+}
+
+/* the buffer must be numcodes*2 in size! */
+static void huffman_tree_init(huffman_tree* tree, unsigned* buffer, unsigned numcodes, unsigned maxbitlen)
+{
+	tree->tree2d = buffer;
+
+	tree->numcodes = numcodes;
+	tree->maxbitlen = maxbitlen;
+}
+
+/*given the code lengths (as stored in the PNG file), generate the tree as defined by Deflate. maxbitlen is the maximum bits that a code in the tree can have. return value is error.*/
+static void huffman_tree_create_lengths(upng_t* upng, huffman_tree* tree, const unsigned *bitlen)
+{
+	unsigned tree1d[MAX_SYMBOLS];
+	unsigned blcount[MAX_BIT_LENGTH+1];
+	unsigned nextcode[MAX_BIT_LENGTH+1];
+	unsigned bits, n, i;
+	unsigned nodefilled = 0;	/*up to which node it is filled */
+	unsigned treepos = 0;	/*position in the tree (1 of the numcodes columns) */
+
+	/* initialize local vectors */
+	memset(blcount, 0, sizeof(blcount));
+	memset(nextcode, 0, sizeof(nextcode));
+
+	/*step 1: count number of instances of each code length */
+	for (bits = 0; bits < tree->numcodes; bits++) {
+		blcount[bitlen[bits]]++;
+	}
+
+	/*step 2: generate the nextcode values */
+	for (bits = 1; bits <= tree->maxbitlen; bits++) {
+		nextcode[bits] = (nextcode[bits - 1] + blcount[bits - 1]) << 1;
+	}
+
+	/*step 3: generate all the codes */
+	for (n = 0; n < tree->numcodes; n++) {
+		if (bitlen[n] != 0) {
+			tree1d[n] = nextcode[bitlen[n]]++;
+		}
+	}
+
+	/*convert tree1d[] to tree2d[][]. In the 2D array, a value of 32767 means uninited, a value >= numcodes is an address to another bit, a value < numcodes is a code. The 2 rows are the 2 possible bit values (0 or 1), there are as many columns as codes - 1
+	   a good huffmann tree has N * 2 - 1 nodes, of which N - 1 are internal nodes. Here, the internal nodes are stored (what their 0 and 1 option point to). There is only memory for such good tree currently, if there are more nodes (due to too long length codes), error 55 will happen */
+	for (n = 0; n < tree->numcodes * 2; n++) {
+		tree->tree2d[n] = 32767;	/*32767 here means the tree2d isn't filled there yet */
+	}
+
+	for (n = 0; n < tree->numcodes; n++) {	/*the codes */
+		for (i = 0; i < bitlen[n]; i++) {	/*the bits for this code */
+			unsigned char bit = (unsigned char)((tree1d[n] >> (bitlen[n] - i - 1)) & 1);
+			/* check if oversubscribed */
+			if (treepos > tree->numcodes - 2) {
+				SET_ERROR(upng, UPNG_EMALFORMED);
+				return;
+			}
+
+			if (tree->tree2d[2 * treepos + bit] == 32767) {	/*not yet filled in */
+				if (i + 1 == bitlen[n]) {	/*last bit */
+					tree->tree2d[2 * treepos + bit] = n;	/*put the current code in it */
+					treepos = 0;
+				} else {	/*put address of the next step in here, first that address has to be found of course (it's just nodefilled + 1)... */
+					nodefilled++;
+					tree->tree2d[2 * treepos + bit] = nodefilled + tree->numcodes;	/*addresses encoded with numcodes added to it */
+					treepos = nodefilled;
+				}
+			} else {
+				treepos = tree->tree2d[2 * treepos + bit] - tree->numcodes;
+			}
+		}
+	}
+
+	for (n = 0; n < tree->numcodes * 2; n++) {
+		if (tree->tree2d[n] == 32767) {
+			tree->tree2d[n] = 0;	/*remove possible remaining 32767's */
+		}
+	}
+}
+
+static unsigned huffman_decode_symbol(upng_t *upng, const huffman_tree* codetree)
+{
+	unsigned treepos = 0, ct;
+	unsigned char bit;
+	for (;;) {
+		bit = read_bit(upng);
+
+		/* error: end of input reached without endcode */
+		if (upng->error != UPNG_EOK) {
+			return 0;
+		}
+
+		ct = codetree->tree2d[(treepos << 1) | bit];
+		if (ct < codetree->numcodes) {
+			return ct;
+		}
+
+		treepos = ct - codetree->numcodes;
+		if (treepos >= codetree->numcodes) {
+			SET_ERROR(upng, UPNG_EMALFORMED);
+			return 0;
+		}
+	}
+}
+
+/* get the tree of a deflated block with dynamic tree, the tree itself is also Huffman compressed with a known tree*/
+static void get_tree_inflate_dynamic(upng_t* upng, huffman_tree* codetree, huffman_tree* codetreeD, huffman_tree* codelengthcodetree)
+{
+	unsigned codelengthcode[NUM_CODE_LENGTH_CODES];
+	unsigned bitlen[NUM_DEFLATE_CODE_SYMBOLS];
+	unsigned bitlenD[NUM_DISTANCE_SYMBOLS];
+	unsigned n, hlit, hdist, hclen, i;
+
+	/* clear bitlen arrays (make sure that length values that aren't filled in will be 0, or a wrong tree will be generated) */
+	memset(bitlen, 0, sizeof(bitlen));
+	memset(bitlenD, 0, sizeof(bitlenD));
+
+	hlit = read_bits(upng, 5) + 257;	/*number of literal/length codes + 257. Unlike the spec, the value 257 is added to it here already */
+	hdist = read_bits(upng, 5) + 1;	/*number of distance codes. Unlike the spec, the value 1 is added to it here already */
+	hclen = read_bits(upng, 4) + 4;	/*number of code length codes. Unlike the spec, the value 4 is added to it here already */
+
+	for (i = 0; i < NUM_CODE_LENGTH_CODES; i++) {
+		if (i < hclen) {
+			codelengthcode[CLCL[i]] = read_bits(upng, 3);
+		} else {
+			codelengthcode[CLCL[i]] = 0;	/*if not, it must stay 0 */
+		}
+	}
+
+	/* bail now if we ran out of input */
+	if (upng->error != UPNG_EOK) {
+		return;
+	}
+
+	huffman_tree_create_lengths(upng, codelengthcodetree, codelengthcode);
+
+	/* bail now if we encountered an error earlier */
+	if (upng->error != UPNG_EOK) {
+		return;
+	}
+
+	/*now we can use this tree to read the lengths for the tree that this function will return */
+	i = 0;
+	while (i < hlit + hdist) {	/*i is the current symbol we're reading in the part that contains the code lengths of lit/len codes and dist codes */
+		unsigned code = huffman_decode_symbol(upng, codelengthcodetree);
+		if (upng->error != UPNG_EOK) {
+			break;
+		}
+
+		if (code <= 15) {	/*a length code */
+			if (i < hlit) {
+				bitlen[i] = code;
+			} else {
+				bitlenD[i - hlit] = code;
+			}
+			i++;
+		} else if (code == 16) {	/*repeat previous */
+			unsigned replength = 3;	/*read in the 2 bits that indicate repeat length (3-6) */
+			unsigned value;	/*set value to the previous code */
+
+			replength += read_bits(upng, 2);
+
+			/* there is no previous value */
+			if (i == 0) {
+				SET_ERROR(upng, UPNG_EMALFORMED);
+				break;
+			}
+
+			if ((i - 1) < hlit) {
+				value = bitlen[i - 1];
+			} else {
+				value = bitlenD[i - hlit - 1];
+			}
+
+			/*repeat this value in the next lengths */
+			for (n = 0; n < replength; n++) {
+				/* i is larger than the amount of codes */
+				if (i >= hlit + hdist) {
+					SET_ERROR(upng, UPNG_EMALFORMED);
+					break;
+				}
+
+				if (i < hlit) {
+					bitlen[i] = value;
+				} else {
+					bitlenD[i - hlit] = value;
+				}
+				i++;
+			}
+		} else if (code == 17) {	/*repeat "0" 3-10 times */
+			unsigned replength = 3;	/*read in the bits that indicate repeat length */
+
+			replength += read_bits(upng, 3);
+
+			/*repeat this value in the next lengths */
+			for (n = 0; n < replength; n++) {
+				/* error: i is larger than the amount of codes */
+				if (i >= hlit + hdist) {
+					SET_ERROR(upng, UPNG_EMALFORMED);
+					break;
+				}
+
+				if (i < hlit) {
+					bitlen[i] = 0;
+				} else {
+					bitlenD[i - hlit] = 0;
+				}
+				i++;
+			}
+		} else if (code == 18) {	/*repeat "0" 11-138 times */
+			unsigned replength = 11;	/*read in the bits that indicate repeat length */
+			/* error, bit pointer jumps past memory */
+
+			replength += read_bits(upng, 7);
+
+			/*repeat this value in the next lengths */
+			for (n = 0; n < replength; n++) {
+				/* i is larger than the amount of codes */
+				if (i >= hlit + hdist) {
+					SET_ERROR(upng, UPNG_EMALFORMED);
+					break;
+				}
+				if (i < hlit)
+					bitlen[i] = 0;
+				else
+					bitlenD[i - hlit] = 0;
+				i++;
+			}
+		} else {
+			/* somehow an unexisting code appeared. This can never happen. */
+			SET_ERROR(upng, UPNG_EMALFORMED);
+			break;
+		}
+	}
+
+	if (upng->error == UPNG_EOK && bitlen[256] == 0) {
+		SET_ERROR(upng, UPNG_EMALFORMED);
+	}
+
+	/*the length of the end code 256 must be larger than 0 */
+	/*now we've finally got hlit and hdist, so generate the code trees, and the function is done */
+	if (upng->error == UPNG_EOK) {
+		huffman_tree_create_lengths(upng, codetree, bitlen);
+	}
+	if (upng->error == UPNG_EOK) {
+		huffman_tree_create_lengths(upng, codetreeD, bitlenD);
+	}
+}
+
+/*Paeth predicter, used by PNG filter type 4*/
+static int paeth_predictor(int a, int b, int c)
+{
+	int p = a + b - c;
+	int pa = p > a ? p - a : a - p;
+	int pb = p > b ? p - b : b - p;
+	int pc = p > c ? p - c : c - p;
+
+	if (pa <= pb && pa <= pc)
+		return a;
+	else if (pb <= pc)
+		return b;
+	else
+		return c;
+}
+
+static void unfilter_scanline(upng_t* upng, unsigned char *recon, const unsigned char *scanline, const unsigned char *precon, unsigned long bytewidth, unsigned char filterType, unsigned long length)
+{
+	/*
+	   For PNG filter method 0
+	   unfilter a PNG image scanline by scanline. when the pixels are smaller than 1 byte, the filter works byte per byte (bytewidth = 1)
+	   precon is the previous unfiltered scanline, recon the result, scanline the current one
+	   the incoming scanlines do NOT include the filtertype byte, that one is given in the parameter filterType instead
+	   recon and scanline MAY be the same memory address! precon must be disjoint.
+	 */
+
+	unsigned long i;
+	switch (filterType) {
+	case 0:
+		for (i = 0; i < length; i++)
+			recon[i] = scanline[i];
+		break;
+	case 1:
+		for (i = 0; i < bytewidth; i++)
+			recon[i] = scanline[i];
+		for (i = bytewidth; i < length; i++)
+			recon[i] = scanline[i] + recon[i - bytewidth];
+		break;
+	case 2:
+		if (precon)
+			for (i = 0; i < length; i++)
+				recon[i] = scanline[i] + precon[i];
+		else
+			for (i = 0; i < length; i++)
+				recon[i] = scanline[i];
+		break;
+	case 3:
+		if (precon) {
+			for (i = 0; i < bytewidth; i++)
+				recon[i] = scanline[i] + precon[i] / 2;
+			for (i = bytewidth; i < length; i++)
+				recon[i] = scanline[i] + ((recon[i - bytewidth] + precon[i]) / 2);
+		} else {
+			for (i = 0; i < bytewidth; i++)
+				recon[i] = scanline[i];
+			for (i = bytewidth; i < length; i++)
+				recon[i] = scanline[i] + recon[i - bytewidth] / 2;
+		}
+		break;
+	case 4:
+		if (precon) {
+			for (i = 0; i < bytewidth; i++)
+				recon[i] = (unsigned char)(scanline[i] + paeth_predictor(0, precon[i], 0));
+			for (i = bytewidth; i < length; i++)
+				recon[i] = (unsigned char)(scanline[i] + paeth_predictor(recon[i - bytewidth], precon[i], precon[i - bytewidth]));
+		} else {
+			for (i = 0; i < bytewidth; i++)
+				recon[i] = scanline[i];
+			for (i = bytewidth; i < length; i++)
+				recon[i] = (unsigned char)(scanline[i] + paeth_predictor(recon[i - bytewidth], 0, 0));
+		}
+		break;
+	default:
+		SET_ERROR(upng, UPNG_EMALFORMED);
+		break;
+	}
+}
+
+/* store an inflated byte: append it to the sliding window and to the current scanline, and unfilter and output
+ * the scanline once it is complete */
+static void write_byte(upng_t* upng, unsigned char byte)
+{
+	upng_stream *stream = &upng->stream;
+
+	if (upng->error != UPNG_EOK) {
+		return;
+	}
+
+	/* more data than the image has */
+	if (stream->wpos >= stream->wtotal) {
+		SET_ERROR(upng, UPNG_EMALFORMED);
+		return;
+	}
+
+	stream->window[stream->wpos & stream->wmask] = byte;
+	stream->wpos++;
+
+	stream->line[stream->linepos++] = byte;
+	if (stream->linepos > stream->linebytes) {
+		unsigned char *line = stream->line;
+
+		/* the first byte is the filter type */
+		unfilter_scanline(upng, &line[1], &line[1], stream->y > 0 ? &stream->prevline[1] : NULL, stream->bytewidth, line[0], stream->linebytes);
+		if (upng->error != UPNG_EOK) {
+			return;
+		}
+
+		stream->row(stream->row_user, stream->y, &line[1], stream->linebytes);
+
+		stream->line = stream->prevline;
+		stream->prevline = line;
+		stream->linepos = 0;
+		stream->y++;
+	}
+}
+
+/*inflate a block with dynamic of fixed Huffman tree*/
+static void inflate_huffman(upng_t* upng, unsigned btype)
+{
+	upng_stream *stream = &upng->stream;
+	unsigned codetree_buffer[DEFLATE_CODE_BUFFER_SIZE];
+	unsigned codetreeD_buffer[DISTANCE_BUFFER_SIZE];
+	unsigned done = 0;
+
+	huffman_tree codetree;
+	huffman_tree codetreeD;
+
+	if (btype == 1) {
+		/* fixed trees */
+		huffman_tree_init(&codetree, (unsigned*)FIXED_DEFLATE_CODE_TREE, NUM_DEFLATE_CODE_SYMBOLS, DEFLATE_CODE_BITLEN);
+		huffman_tree_init(&codetreeD, (unsigned*)FIXED_DISTANCE_TREE, NUM_DISTANCE_SYMBOLS, DISTANCE_BITLEN);
+	} else if (btype == 2) {
+		/* dynamic trees */
+		unsigned codelengthcodetree_buffer[CODE_LENGTH_BUFFER_SIZE];
+		huffman_tree codelengthcodetree;
+
+		huffman_tree_init(&codetree, codetree_buffer, NUM_DEFLATE_CODE_SYMBOLS, DEFLATE_CODE_BITLEN);
+		huffman_tree_init(&codetreeD, codetreeD_buffer, NUM_DISTANCE_SYMBOLS, DISTANCE_BITLEN);
+		huffman_tree_init(&codelengthcodetree, codelengthcodetree_buffer, NUM_CODE_LENGTH_CODES, CODE_LENGTH_BITLEN);
+		get_tree_inflate_dynamic(upng, &codetree, &codetreeD, &codelengthcodetree);
+		if (upng->error != UPNG_EOK) {
+			return;
+		}
+	}
+
+	while (done == 0) {
+		unsigned code = huffman_decode_symbol(upng, &codetree);
+		if (upng->error != UPNG_EOK) {
+			return;
+		}
+
+		if (code == 256) {
+			/* end code */
+			done = 1;
+		} else if (code <= 255) {
+			/* literal symbol */
+			write_byte(upng, (unsigned char)(code));
+			if (upng->error != UPNG_EOK) {
+				return;
+			}
+		} else if (code >= FIRST_LENGTH_CODE_INDEX && code <= LAST_LENGTH_CODE_INDEX) {	/*length code */
+			/* part 1: get length base */
+			unsigned long length = LENGTH_BASE[code - FIRST_LENGTH_CODE_INDEX];
+			unsigned codeD, distance, numextrabitsD;
+			unsigned long forward, numextrabits;
+
+			/* part 2: get extra bits and add the value of that to length */
+			numextrabits = LENGTH_EXTRA[code - FIRST_LENGTH_CODE_INDEX];
+			length += read_bits(upng, numextrabits);
+
+			/*part 3: get distance code */
+			codeD = huffman_decode_symbol(upng, &codetreeD);
+			if (upng->error != UPNG_EOK) {
+				return;
+			}
+
+			/* invalid distance code (30-31 are never used) */
+			if (codeD > 29) {
+				SET_ERROR(upng, UPNG_EMALFORMED);
+				return;
+			}
+
+			distance = DISTANCE_BASE[codeD];
+
+			/*part 4: get extra bits from distance */
+			numextrabitsD = DISTANCE_EXTRA[codeD];
+			distance += read_bits(upng, numextrabitsD);
+			if (upng->error != UPNG_EOK) {
+				return;
+			}
+
+			/* distance goes back before the start of the data or beyond the window, or length goes past the end of the image */
+			if (distance > stream->wpos || distance > stream->wmask + 1 || stream->wpos + length > stream->wtotal) {
+				SET_ERROR(upng, UPNG_EMALFORMED);
+				return;
+			}
+
+			/*part 5: copy length bytes from distance bytes back in the window */
+			for (forward = 0; forward < length; forward++) {
+				write_byte(upng, stream->window[(stream->wpos - distance) & stream->wmask]);
+			}
+			if (upng->error != UPNG_EOK) {
+				return;
+			}
+		} else {
+			/* invalid length code (286-287 are never used) */
+			SET_ERROR(upng, UPNG_EMALFORMED);
+			return;
+		}
+	}
+}
+
+static void inflate_uncompressed(upng_t* upng)
+{
+	upng_stream *stream = &upng->stream;
+	unsigned len, nlen, n;
+
+	/* go to first boundary of byte */
+	stream->bitcnt = 0;
+
+	/* read len (2 bytes) and nlen (2 bytes) */
+	len = read_byte(upng);
+	len += 256 * read_byte(upng);
+	nlen = read_byte(upng);
+	nlen += 256 * read_byte(upng);
+	if (upng->error != UPNG_EOK) {
+		return;
+	}
+
+	/* check if 16-bit nlen is really the one's complement of len */
+	if (len + nlen != 65535) {
+		SET_ERROR(upng, UPNG_EMALFORMED);
+		return;
+	}
+
+	if (stream->wpos + len > stream->wtotal) {
+		SET_ERROR(upng, UPNG_EMALFORMED);
+		return;
+	}
+
+	/* read the literal data */
+	for (n = 0; (n < len) && (upng->error == UPNG_EOK); n++) {
+		write_byte(upng, read_byte(upng));
+	}
+}
+
+/*inflate the deflated data (cfr. deflate spec); return value is the error*/
+static upng_error uz_inflate_data(upng_t* upng)
+{
+	unsigned done = 0;
+
+	while (done == 0) {
+		unsigned btype;
+
+		/* read block control bits */
+		done = read_bit(upng);
+		btype = read_bit(upng);
+		btype |= read_bit(upng) << 1;
+		if (upng->error != UPNG_EOK) {
+			return upng->error;
+		}
+
+		/* process control type appropriateyly */
+		if (btype == 3) {
+			SET_ERROR(upng, UPNG_EMALFORMED);
+			return upng->error;
+		} else if (btype == 0) {
+			inflate_uncompressed(upng);	/*no compression */
+		} else {
+			inflate_huffman(upng, btype);	/*compression, btype 01 or 10 */
+		}
+
+		/* stop if an error has occured */
+		if (upng->error != UPNG_EOK) {
+			return upng->error;
+		}
+	}
+
+	return upng->error;
+}
+
+static upng_error uz_inflate(upng_t* upng)
+{
+	upng_stream *stream = &upng->stream;
+	unsigned char cmf, flg;
+	unsigned long wsize;
+	unsigned char *buffer;
+
+	/* read the two bytes zlib data header */
+	cmf = read_byte(upng);
+	flg = read_byte(upng);
+	if (upng->error != UPNG_EOK) {
+		return upng->error;
+	}
+
+	/* 256 * cmf + flg must be a multiple of 31, the FCHECK value is supposed to be made that way */
+	if ((cmf * 256 + flg) % 31 != 0) {
+		SET_ERROR(upng, UPNG_EMALFORMED);
+		return upng->error;
+	}
+
+	/*error: only compression method 8: inflate with sliding window of 32k is supported by the PNG spec */
+	if ((cmf & 15) != 8 || ((cmf >> 4) & 15) > 7) {
+		SET_ERROR(upng, UPNG_EMALFORMED);
+		return upng->error;
+	}
+
+	/* the specification of PNG says about the zlib stream: "The additional flags shall not specify a preset dictionary." */
+	if (((flg >> 5) & 1) != 0) {
+		SET_ERROR(upng, UPNG_EMALFORMED);
+		return upng->error;
+	}
+
+	/* window size is given by CINFO, but there's no need for a window larger than the whole inflated data */
+	wsize = 1UL << (((cmf >> 4) & 15) + 8);
+	while ((wsize > 256) && ((wsize / 2) >= stream->wtotal)) {
+		wsize /= 2;
+	}
+
+	/* allocate window and two scanlines */
+	buffer = (unsigned char*)malloc(wsize + (2 * (stream->linebytes + 1)));
+	if (buffer == NULL) {
+		SET_ERROR(upng, UPNG_ENOMEM);
+		return upng->error;
+	}
+	stream->window = buffer;
+	stream->wmask = wsize - 1;
+	stream->line = &buffer[wsize];
+	stream->prevline = &buffer[wsize + stream->linebytes + 1];
+
+	uz_inflate_data(upng);
+
+	/* the compressed data must have all scanlines */
+	if ((upng->error == UPNG_EOK) && (stream->y != upng->height)) {
+		SET_ERROR(upng, UPNG_EMALFORMED);
+	}
+
+	free(buffer);
+	stream->window = stream->line = stream->prevline = NULL;
+
+	return upng->error;
+}
+
+/* row callback for upng_decode(): copy the row into the image buffer, removing the padding bits of the scanlines (if
+ * any) so that the image is one continuous bitstream */
+static void decode_row(void* user, unsigned y, const unsigned char* row, unsigned long size)
+{
+	upng_t* upng = (upng_t*)user;
+	unsigned long linebits = upng->width * upng_get_bpp(upng);
+
+	if ((linebits % 8) == 0) {
+		memcpy(&upng->buffer[y * size], row, size);
+	} else {
+		unsigned long obp = y * linebits, ibp = 0;	/*bit pointers */
+		unsigned long x;
+		for (x = 0; x < linebits; x++) {
+			unsigned char bit = (unsigned char)((row[(ibp) >> 3] >> (7 - ((ibp) & 0x7))) & 1);
+			ibp++;
+
+			if (bit == 0)
+				upng->buffer[(obp) >> 3] &= (unsigned char)(~(1 << (7 - ((obp) & 0x7))));
+			else
+				upng->buffer[(obp) >> 3] |= (1 << (7 - ((obp) & 0x7)));
+			++obp;
+		}
+	}
+}
+
+static upng_format determine_format(upng_t* upng) {
+	switch (upng->color_type) {
+	case UPNG_LUM:
+		switch (upng->color_depth) {
+		case 1:
+			return UPNG_LUMINANCE1;
+		case 2:
+			return UPNG_LUMINANCE2;
+		case 4:
+			return UPNG_LUMINANCE4;
+		case 8:
+			return UPNG_LUMINANCE8;
+		default:
+			return UPNG_BADFORMAT;
+		}
+	case UPNG_RGB:
+		switch (upng->color_depth) {
+		case 8:
+			return UPNG_RGB8;
+		case 16:
+			return UPNG_RGB16;
+		default:
+			return UPNG_BADFORMAT;
+		}
+	case UPNG_LUMA:
+		switch (upng->color_depth) {
+		case 1:
+			return UPNG_LUMINANCE_ALPHA1;
+		case 2:
+			return UPNG_LUMINANCE_ALPHA2;
+		case 4:
+			return UPNG_LUMINANCE_ALPHA4;
+		case 8:
+			return UPNG_LUMINANCE_ALPHA8;
+		default:
+			return UPNG_BADFORMAT;
+		}
+	case UPNG_RGBA:
+		switch (upng->color_depth) {
+		case 8:
+			return UPNG_RGBA8;
+		case 16:
+			return UPNG_RGBA16;
+		default:
+			return UPNG_BADFORMAT;
+		}
+	default:
+		return UPNG_BADFORMAT;
+	}
+}
+
+static void upng_free_source(upng_t* upng)
+{
+	if (upng->source.owning != 0) {
+		free((void*)upng->source.buffer);
+	}
+
+	upng->source.buffer = NULL;
+	upng->source.size = 0;
+	upng->source.owning = 0;
+}
+
+/*read the information from the header and store it in the upng_Info. return value is error*/
+upng_error upng_header(upng_t* upng)
+{
+	unsigned char header[33];
+	unsigned i;
+
+	/* if we have an error state, bail now */
+	if (upng->error != UPNG_EOK) {
+		return upng->error;
+	}
+
+	/* if the state is not NEW (meaning we are ready to parse the header), stop now */
+	if (upng->state != UPNG_NEW) {
+		return upng->error;
+	}
+
+	/* read PNG signature (8 bytes) and IHDR chunk (length, type, 13 bytes data, CRC) */
+	for (i = 0; i < sizeof(header); i++) {
+		header[i] = read_source_byte(upng);
+	}
+	if (upng->error != UPNG_EOK) {
+		SET_ERROR(upng, UPNG_ENOTPNG);
+		return upng->error;
+	}
+
+	/* check that PNG header matches expected value */
+	if (header[0] != 137 || header[1] != 80 || header[2] != 78 || header[3] != 71 || header[4] != 13 || header[5] != 10 || header[6] != 26 || header[7] != 10) {
+		SET_ERROR(upng, UPNG_ENOTPNG);
+		return upng->error;
+	}
+
+	/* check that the first chunk is the IHDR chunk */
+	if (MAKE_DWORD_PTR(header + 12) != CHUNK_IHDR) {
+		SET_ERROR(upng, UPNG_EMALFORMED);
+		return upng->error;
+	}
+
+	/* read the values given in the header */
+	upng->width = MAKE_DWORD_PTR(header + 16);
+	upng->height = MAKE_DWORD_PTR(header + 20);
+	upng->color_depth = header[24];
+	upng->color_type = (upng_color)header[25];
+
+	/* determine our color format */
+	upng->format = determine_format(upng);
+	if (upng->format == UPNG_BADFORMAT) {
+		SET_ERROR(upng, UPNG_EUNFORMAT);
+		return upng->error;
+	}
+
+	/* check that the compression method (byte 27) is 0 (only allowed value in spec) */
+	if (header[26] != 0) {
+		SET_ERROR(upng, UPNG_EMALFORMED);
+		return upng->error;
+	}
+
+	/* check that the compression method (byte 27) is 0 (only allowed value in spec) */
+	if (header[27] != 0) {
+		SET_ERROR(upng, UPNG_EMALFORMED);
+		return upng->error;
+	}
+
+	/* check that the compression method (byte 27) is 0 (spec allows 1, but uPNG does not support it) */
+	if (header[28] != 0) {
+		SET_ERROR(upng, UPNG_EUNINTERLACED);
+		return upng->error;
+	}
+
+	upng->state = UPNG_HEADER;
+	return upng->error;
+}
+
+/*decode a PNG scanline by scanline, the rows passed to the callback are in the same color type as the PNG*/
+upng_error upng_decode_rows(upng_t* upng, upng_row_fn row, void* user)
+{
+	upng_stream *stream = &upng->stream;
+	unsigned bpp;
+
+	/* if we have an error state, bail now */
+	if (upng->error != UPNG_EOK) {
+		return upng->error;
+	}
+
+	/* parse the main header, if necessary */
+	upng_header(upng);
+	if (upng->error != UPNG_EOK) {
+		return upng->error;
+	}
+
+	/* if the state is not HEADER (meaning we are ready to decode the image), stop now */
+	if (upng->state != UPNG_HEADER) {
+		return upng->error;
+	}
+
+	bpp = upng_get_bpp(upng);
+	if (bpp == 0 || upng->width == 0 || upng->height == 0) {
+		SET_ERROR(upng, UPNG_EMALFORMED);
+		return upng->error;
+	}
+
+	/* prepare inflating and unfiltering, the compressed data starts in the next IDAT chunk */
+	stream->chunk_left = 0;
+	stream->in_idat = 0;
+	stream->bitbuf = 0;
+	stream->bitcnt = 0;
+	stream->bytewidth = (bpp + 7) / 8;	/*bytewidth is used for filtering, is 1 when bpp < 8, number of bytes per pixel otherwise */
+	stream->linebytes = (upng->width * bpp + 7) / 8;
+	stream->linepos = 0;
+	stream->wpos = 0;
+	stream->wtotal = upng->height * (stream->linebytes + 1);	/*the extra filterbyte added to each row */
+	stream->y = 0;
+	stream->row = row;
+	stream->row_user = user;
+
+	/* decompress and unfilter image data */
+	if (uz_inflate(upng) == UPNG_EOK) {
+		upng->state = UPNG_DECODED;
+	}
+
+	/* we are done with our input buffer; free it if we own it */
+	upng_free_source(upng);
+
+	return upng->error;
+}
+
+/*read a PNG, the result will be in the same color type as the PNG (hence "generic")*/
+upng_error upng_decode(upng_t* upng)
+{
+	/* if we have an error state, bail now */
+	if (upng->error != UPNG_EOK) {
+		return upng->error;
+	}
+
+	/* parse the main header, if necessary */
+	upng_header(upng);
+	if (upng->error != UPNG_EOK) {
+		return upng->error;
+	}
+
+	/* if the state is not HEADER (meaning we are ready to decode the image), stop now */
+	if (upng->state != UPNG_HEADER) {
+		return upng->error;
+	}
+
+	/* release old result, if any */
+	if (upng->buffer != 0) {
+		free(upng->buffer);
+		upng->buffer = 0;
+		upng->size = 0;
+	}
+
+	/* allocate final image buffer */
+	upng->size = (upng->height * upng->width * upng_get_bpp(upng) + 7) / 8;
+	upng->buffer = (unsigned char*)malloc(upng->size);
+	if (upng->buffer == NULL) {
+		upng->size = 0;
+		SET_ERROR(upng, UPNG_ENOMEM);
+		return upng->error;
+	}
+
+	/* decompress and unfilter scanlines into the image buffer */
+	upng_decode_rows(upng, decode_row, upng);
+
+	if (upng->error != UPNG_EOK) {
+		free(upng->buffer);
+		upng->buffer = NULL;
+		upng->size = 0;
+	}
+
+	return upng->error;
+}
+
+/* read function for memory sources */
+static unsigned long read_memory(void* user, unsigned char* buffer, unsigned long size)
+{
+	upng_source* source = (upng_source*)user;
+	unsigned long left = source->buffer != NULL ? source->size - source->pos : 0;
+	if (size > left) {
+		size = left;
+	}
+	memcpy(buffer, source->buffer + source->pos, size);
+	source->pos += size;
+	return size;
+}
+
+static upng_t* upng_new(void)
+{
+	upng_t* upng;
+
+	upng = (upng_t*)malloc(sizeof(upng_t));
+	if (upng == NULL) {
+		return NULL;
+	}
+
+	upng->buffer = NULL;
+	upng->size = 0;
+
+	upng->width = upng->height = 0;
+
+	upng->color_type = UPNG_RGBA;
+	upng->color_depth = 8;
+	upng->format = UPNG_RGBA8;
+
+	upng->state = UPNG_NEW;
+
+	upng->error = UPNG_EOK;
+	upng->error_line = 0;
+
+	upng->source.read = read_memory;
+	upng->source.user = &upng->source;
+	upng->source.buffer = NULL;
+	upng->source.size = 0;
+	upng->source.pos = 0;
+	upng->source.owning = 0;
+
+	memset(&upng->stream, 0, sizeof(upng->stream));
+
+	return upng;
+}
+
+upng_t* upng_new_from_bytes(const unsigned char* buffer, unsigned long size)
+{
+	upng_t* upng = upng_new();
+	if (upng == NULL) {
+		return NULL;
+	}
+
+	upng->source.buffer = buffer;
+	upng->source.size = size;
+	upng->source.owning = 0;
+
+	return upng;
+}
+
+upng_t* upng_new_from_stream(upng_read_fn read, void* user)
+{
+	upng_t* upng = upng_new();
+	if (upng == NULL) {
+		return NULL;
+	}
+
+	upng->source.read = read;
+	upng->source.user = user;
+
+	return upng;
+}
+
+upng_t* upng_new_from_file(const char *filename)
+{
+	upng_t* upng;
+	unsigned char *buffer;
+	FILE *file;
+	long size;
+
+	upng = upng_new();
+	if (upng == NULL) {
+		return NULL;
+	}
+
+	file = fopen(filename, "rb");
+	if (file == NULL) {
+		SET_ERROR(upng, UPNG_ENOTFOUND);
+		return upng;
+	}
+
+	/* get filesize */
+	fseek(file, 0, SEEK_END);
+	size = ftell(file);
+	rewind(file);
+
+	/* read contents of the file into the vector */
+	buffer = (unsigned char *)malloc((unsigned long)size);
+	if (buffer == NULL) {
+		fclose(file);
+		SET_ERROR(upng, UPNG_ENOMEM);
+		return upng;
+	}
+	fread(buffer, 1, (unsigned long)size, file);
+	fclose(file);
+
+	/* set the read buffer as our source buffer, with owning flag set */
+	upng->source.buffer = buffer;
+	upng->source.size = size;
+	upng->source.owning = 1;
+
+	return upng;
+}
+
+void upng_free(upng_t* upng)
+{
+	/* deallocate image buffer */
+	if (upng->buffer != NULL) {
+		free(upng->buffer);
+	}
+
+	/* deallocate source buffer, if necessary */
+	upng_free_source(upng);
+
+	/* deallocate struct itself */
+	free(upng);
+}
+
+upng_error upng_get_error(const upng_t* upng)
+{
+	return upng->error;
+}
+
+unsigned upng_get_error_line(const upng_t* upng)
+{
+	return upng->error_line;
+}
+
+unsigned upng_get_width(const upng_t* upng)
+{
+	return upng->width;
+}
+
+unsigned upng_get_height(const upng_t* upng)
+{
+	return upng->height;
+}
+
+unsigned upng_get_bpp(const upng_t* upng)
+{
+	return upng_get_bitdepth(upng) * upng_get_components(upng);
+}
+
+unsigned upng_get_components(const upng_t* upng)
+{
+	switch (upng->color_type) {
+	case UPNG_LUM:
+		return 1;
+	case UPNG_RGB:
+		return 3;
+	case UPNG_LUMA:
+		return 2;
+	case UPNG_RGBA:
+		return 4;
+	default:
+		return 0;
+	}
+}
+
+unsigned upng_get_bitdepth(const upng_t* upng)
+{
+	return upng->color_depth;
+}
+
+unsigned upng_get_pixelsize(const upng_t* upng)
+{
+	unsigned bits = upng_get_bitdepth(upng) * upng_get_components(upng);
+	bits += bits % 8;
+	return bits;
+}
+
+upng_format upng_get_format(const upng_t* upng)
+{
+	return upng->format;
+}
+
+const unsigned char* upng_get_buffer(const upng_t* upng)
+{
+	return upng->buffer;
+}
+
+unsigned upng_get_size(const upng_t* upng)
+{
+	return upng->size;
+}
@@ -0,0 +1,539 @@
+/*!
+    \file
+    \brief flipflip's Album Art Display: host benchmark of the PNG decoder (upng.c)
+
+    - Copyright (c) 2020 Philippe Kehl (flipflip at oinkzwurgl dot org),
+      https://oinkzwurgl.org/projaeggd/album-art-display
+
+    Decodes a corpus of PNGs with the current decoder (src/upng.c) and with the decoder from before the inflate rewrite
+    (upng-orig.c), checks that both give the same image, byte for byte, and times them.
+
+    The corpus is generated (zlib at different compression levels, strategies and window sizes, in the pixel formats
+    the original decoder supports, with all filter types), plus hand-made deflate streams with back-references that
+    reach back as far as the window allows (zlib never does that, but other encoders may), plus the PNGs given on the
+    command line (e.g. real cover art). For the generated PNGs the image data is also checked against the expected
+    image, and the current decoder is also run with an arena and upng_decode_rows(), as the firmware does.
+
+    Build with "make asan" to run the same with AddressSanitizer and UndefinedBehaviorSanitizer.
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <algorithm>
+
+#include <zlib.h>
+
+#define NUMOF(x) (sizeof(x) / sizeof(*(x)))
+
+extern "C" {
+#include "upng.h"
+
+// upng-orig.c
+upng_t        *orig_upng_new_from_bytes(const unsigned char *buffer, unsigned long size);
+void           orig_upng_free(upng_t *upng);
+upng_error     orig_upng_decode(upng_t *upng);
+unsigned       orig_upng_get_size(const upng_t *upng);
+const uint8_t *orig_upng_get_buffer(const upng_t *upng);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+typedef struct PNG_s
+{
+    std::string          name;
+    std::vector<uint8_t> png;
+    std::vector<uint8_t> image;     // expected image (unfiltered scanlines, as upng_decode() gives them), if known
+    unsigned             width;
+    unsigned             height;
+    unsigned             bpp;
+} PNG_t;
+
+static uint32_t sRandState = 0x12345678;
+
+static uint32_t sRand(void)
+{
+    sRandState ^= sRandState << 13;
+    sRandState ^= sRandState >> 17;
+    sRandState ^= sRandState << 5;
+    return sRandState;
+}
+
+static void sPut32(std::vector<uint8_t> &out, const uint32_t val)
+{
+    out.push_back(val >> 24);
+    out.push_back(val >> 16);
+    out.push_back(val >> 8);
+    out.push_back(val);
+}
+
+static void sPngChunk(std::vector<uint8_t> &png, const char *type, const uint8_t *data, const size_t size)
+{
+    sPut32(png, size);
+    const size_t offs = png.size();
+    png.insert(png.end(), type, type + 4);
+    png.insert(png.end(), data, data + size);
+    sPut32(png, crc32(0, &png[offs], png.size() - offs));
+}
+
+// PNG with the given zlib stream split into IDAT chunks of (at most) idatSize bytes
+static std::vector<uint8_t> sPngMake(const unsigned width, const unsigned height, const int depth, const int colorType,
+    const std::vector<uint8_t> &zdata, const size_t idatSize)
+{
+    static const uint8_t sig[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    std::vector<uint8_t> png(sig, sig + sizeof(sig));
+    std::vector<uint8_t> ihdr;
+    sPut32(ihdr, width);
+    sPut32(ihdr, height);
+    ihdr.push_back(depth);
+    ihdr.push_back(colorType);
+    ihdr.push_back(0); // compression
+    ihdr.push_back(0); // filter
+    ihdr.push_back(0); // interlace
+    sPngChunk(png, "IHDR", ihdr.data(), ihdr.size());
+    for (size_t offs = 0; offs < zdata.size(); offs += idatSize)
+    {
+        sPngChunk(png, "IDAT", &zdata[offs], std::min(idatSize, zdata.size() - offs));
+    }
+    sPngChunk(png, "IEND", NULL, 0);
+    return png;
+}
+
+static uint8_t sPaeth(const int a, const int b, const int c)
+{
+    const int p = a + b - c, pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    return (pa <= pb) && (pa <= pc) ? a : (pb <= pc ? b : c);
+}
+
+// Generated PNG: random content of the given kind, each row filtered with a random filter type, compressed by zlib
+static PNG_t sPngGenerate(const unsigned width, const unsigned height, const int depth, const int colorType,
+    const int kind, const int level, const int strategy, const int windowBits, const size_t idatSize)
+{
+    const int channels = colorType == 0 ? 1 : (colorType == 2 ? 3 : (colorType == 4 ? 2 : 4));
+    const unsigned bpp = channels * depth;
+    const size_t lineSize = ((size_t)width * bpp + 7) / 8;
+    const size_t pixelSize = (bpp + 7) / 8;
+
+    PNG_t png;
+    char name[100];
+    snprintf(name, sizeof(name), "gen %ux%u c%d/%d kind %d level %d strat %d wbits %d idat %u", width, height,
+        colorType, depth, kind, level, strategy, windowBits, (unsigned)idatSize);
+    png.name = name;
+    png.width = width;
+    png.height = height;
+    png.bpp = bpp;
+
+    // Image
+    png.image.resize(lineSize * height);
+    const uint8_t flat = sRand();
+    for (size_t ix = 0; ix < png.image.size(); ix++)
+    {
+        const size_t x = ix % lineSize, y = ix / lineSize;
+        uint8_t val = 0;
+        switch (kind)
+        {
+            case 0: val = sRand();                                                        break; // noise
+            case 1: val = flat;                                                           break; // flat
+            case 2: val = (x * 255 / lineSize) ^ (y * 3);                                 break; // gradient
+            case 3: val = ((x / 7) + (y / 5)) & 1 ? 0xaa : 0x17;                          break; // pattern
+            case 4: val = ix > lineSize ? png.image[ix - lineSize] + ((sRand() & 7) - 3) : sRand(); break; // "photo"
+        }
+        png.image[ix] = val;
+    }
+
+    // Filter
+    std::vector<uint8_t> raw;
+    for (unsigned y = 0; y < height; y++)
+    {
+        const int filter = sRand() % 5;
+        raw.push_back(filter);
+        const uint8_t *line = &png.image[y * lineSize];
+        const uint8_t *prev = y > 0 ? &png.image[(y - 1) * lineSize] : NULL;
+        for (size_t x = 0; x < lineSize; x++)
+        {
+            const int a = x >= pixelSize ? line[x - pixelSize] : 0;
+            const int b = prev != NULL ? prev[x] : 0;
+            const int c = (prev != NULL) && (x >= pixelSize) ? prev[x - pixelSize] : 0;
+            const int pred[] = { 0, a, b, (a + b) / 2, sPaeth(a, b, c) };
+            raw.push_back(line[x] - pred[filter]);
+        }
+    }
+
+    // Compress
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    deflateInit2(&zs, level, Z_DEFLATED, windowBits, 9, strategy);
+    std::vector<uint8_t> zdata(deflateBound(&zs, raw.size()));
+    zs.next_in = raw.data();
+    zs.avail_in = raw.size();
+    zs.next_out = zdata.data();
+    zs.avail_out = zdata.size();
+    deflate(&zs, Z_FINISH);
+    zdata.resize(zs.total_out);
+    deflateEnd(&zs);
+
+    png.png = sPngMake(width, height, depth, colorType, zdata, idatSize);
+    return png;
+}
+
+// Hand-made deflate stream (fixed Huffman codes), RGB8, filter type 0, with back-references up to the window size
+typedef struct BITS_s
+{
+    std::vector<uint8_t> out;
+    uint32_t acc;
+    int      n;
+} BITS_t;
+
+static void sBits(BITS_t &bits, const uint32_t val, const int n)
+{
+    bits.acc |= val << bits.n;
+    bits.n += n;
+    while (bits.n >= 8)
+    {
+        bits.out.push_back(bits.acc);
+        bits.acc >>= 8;
+        bits.n -= 8;
+    }
+}
+
+static void sHuff(BITS_t &bits, const uint32_t code, const int n) // Huffman codes go MSB first
+{
+    uint32_t rev = 0;
+    for (int ix = 0; ix < n; ix++)
+    {
+        rev |= ((code >> ix) & 1) << (n - 1 - ix);
+    }
+    sBits(bits, rev, n);
+}
+
+static void sLit(BITS_t &bits, const int sym)
+{
+    if (sym < 144)      { sHuff(bits, 0x30 + sym, 8); }
+    else if (sym < 256) { sHuff(bits, 0x190 + sym - 144, 9); }
+    else if (sym < 280) { sHuff(bits, sym - 256, 7); }
+    else                { sHuff(bits, 0xc0 + sym - 280, 8); }
+}
+
+static void sMatch(BITS_t &bits, const int len, const int dist)
+{
+    static const int lBase[] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99,
+        115, 131, 163, 195, 227, 258 };
+    static const int lExtra[] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5,
+        0 };
+    static const int dBase[] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025,
+        1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+    static const int dExtra[] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12,
+        12, 13, 13 };
+    int l = len == 258 ? 28 : 0;
+    while ( (l < 27) && (lBase[l + 1] <= len) )
+    {
+        l++;
+    }
+    sLit(bits, 257 + l);
+    sBits(bits, len - lBase[l], lExtra[l]);
+    int d = 0;
+    while ( (d < 29) && (dBase[d + 1] <= dist) )
+    {
+        d++;
+    }
+    sHuff(bits, d, 5);
+    sBits(bits, dist - dBase[d], dExtra[d]);
+}
+
+static PNG_t sPngFarRefs(const unsigned width, const unsigned height, const int cinfo)
+{
+    const size_t stride = width * 3 + 1;
+    const size_t total = stride * height;
+    const int wsize = 1 << (cinfo + 8);
+    const int dists[] = { wsize, wsize - 1, wsize - 3, (wsize / 2) + 7, (int)stride, (int)stride - 2, 1, 2, 5 };
+
+    BITS_t bits = { {}, 0, 0 };
+    sBits(bits, 1, 1); // last block
+    sBits(bits, 1, 2); // fixed Huffman codes
+    std::vector<uint8_t> raw;
+    while (raw.size() < total)
+    {
+        // Filter type 0 at the start of each row
+        if ((raw.size() % stride) == 0)
+        {
+            raw.push_back(0);
+            sLit(bits, 0);
+            continue;
+        }
+        const int dist = dists[sRand() % NUMOF(dists)];
+        int len = 3 + (sRand() % 256);
+        if ((raw.size() + len) > total)
+        {
+            len = total - raw.size();
+        }
+        // The back-reference must not put anything but 0 into a filter type byte
+        bool ok = (len >= 3) && (len <= dist) && (dist <= wsize) && (dist <= (int)raw.size()) && ((sRand() % 5) != 0);
+        for (int ix = 0; ok && (ix < len); ix++)
+        {
+            ok = (((raw.size() + ix) % stride) != 0) || (raw[raw.size() + ix - dist] == 0);
+        }
+        if (ok)
+        {
+            for (int ix = 0; ix < len; ix++)
+            {
+                raw.push_back(raw[raw.size() - dist]);
+            }
+            sMatch(bits, len, dist);
+        }
+        else
+        {
+            const uint8_t val = sRand();
+            raw.push_back(val);
+            sLit(bits, val);
+        }
+    }
+    sLit(bits, 256);
+    sBits(bits, 0, 7);
+
+    std::vector<uint8_t> zdata;
+    const int cmf = (cinfo << 4) | 8;
+    zdata.push_back(cmf);
+    zdata.push_back(31 - ((cmf * 256) % 31));
+    zdata.insert(zdata.end(), bits.out.begin(), bits.out.end());
+    sPut32(zdata, adler32(1, raw.data(), raw.size()));
+
+    PNG_t png;
+    char name[100];
+    snprintf(name, sizeof(name), "far %ux%u wsize %d", width, height, wsize);
+    png.name = name;
+    png.width = width;
+    png.height = height;
+    png.bpp = 24;
+    for (size_t ix = 0; ix < raw.size(); ix++)
+    {
+        if ((ix % stride) != 0)
+        {
+            png.image.push_back(raw[ix]);
+        }
+    }
+    png.png = sPngMake(width, height, 8, 2, zdata, 1 + (sRand() % 2000));
+    return png;
+}
+
+static bool sPngLoad(const char *file, PNG_t &png)
+{
+    FILE *fh = fopen(file, "rb");
+    if (fh == NULL)
+    {
+        return false;
+    }
+    uint8_t buf[4096];
+    size_t num;
+    while ((num = fread(buf, 1, sizeof(buf), fh)) > 0)
+    {
+        png.png.insert(png.png.end(), buf, buf + num);
+    }
+    fclose(fh);
+    png.name = file;
+    png.width = png.height = png.bpp = 0;
+    return png.png.size() > 0;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+typedef struct ROWS_s
+{
+    std::vector<uint8_t> image;
+} ROWS_t;
+
+static void sRow(void *user, unsigned y, const unsigned char *row, unsigned long size)
+{
+    (void)y;
+    ROWS_t *rows = (ROWS_t *)user;
+    rows->image.insert(rows->image.end(), row, row + size);
+}
+
+typedef struct READ_s
+{
+    const std::vector<uint8_t> *png;
+    size_t offs;
+} READ_t;
+
+static unsigned long sRead(void *user, unsigned char *buffer, unsigned long size)
+{
+    READ_t *rd = (READ_t *)user;
+    const unsigned long num = std::min((size_t)size, rd->png->size() - rd->offs);
+    memcpy(buffer, &rd->png->at(0) + rd->offs, num);
+    rd->offs += num;
+    return num;
+}
+
+static int sNumErr;
+
+static void sError(const PNG_t &png, const char *what)
+{
+    fprintf(stderr, "%s: %s\n", png.name.c_str(), what);
+    sNumErr++;
+}
+
+// Decode with both decoders and compare, returns true if the PNG can be used for the timing
+static bool sCheck(const PNG_t &png)
+{
+    upng_t *upngOrig = orig_upng_new_from_bytes(png.png.data(), png.png.size());
+    const upng_error errOrig = orig_upng_decode(upngOrig);
+    upng_t *upng = upng_new_from_bytes(png.png.data(), png.png.size());
+    const upng_error err = upng_decode(upng);
+
+    bool ok = true;
+    if (err != errOrig)
+    {
+        char str[100];
+        snprintf(str, sizeof(str), "error %d != %d", err, errOrig);
+        sError(png, str);
+        ok = false;
+    }
+    else if ( (err == UPNG_EOK) && ((upng_get_size(upng) != orig_upng_get_size(upngOrig)) ||
+              (memcmp(upng_get_buffer(upng), orig_upng_get_buffer(upngOrig), upng_get_size(upng)) != 0)) )
+    {
+        sError(png, "image differs");
+        ok = false;
+    }
+    if ( (err == UPNG_EOK) && !png.image.empty() && ((upng_get_size(upng) != png.image.size()) ||
+         (memcmp(upng_get_buffer(upng), png.image.data(), png.image.size()) != 0)) )
+    {
+        sError(png, "image wrong");
+        ok = false;
+    }
+    orig_upng_free(upngOrig);
+
+    // Decode rows from an arena, like the firmware
+    if ( (err == UPNG_EOK) && (png.width > 0) )
+    {
+        std::vector<uint8_t> arena(upng_get_arena_size(png.width, png.height, png.bpp));
+        READ_t rd = { &png.png, 0 };
+        ROWS_t rows;
+        upng_t *upngRows = upng_new_from_stream_arena(sRead, &rd, arena.data(), arena.size());
+        if ( (upngRows == NULL) || (upng_header(upngRows) != UPNG_EOK) ||
+             (upng_decode_rows(upngRows, sRow, &rows) != UPNG_EOK) )
+        {
+            sError(png, "decode rows failed");
+        }
+        else if ( (rows.image.size() != upng_get_size(upng)) ||
+                  (memcmp(rows.image.data(), upng_get_buffer(upng), rows.image.size()) != 0) )
+        {
+            sError(png, "rows differ");
+        }
+        if (upngRows != NULL)
+        {
+            upng_free(upngRows);
+        }
+    }
+    upng_free(upng);
+
+    return ok && (err == UPNG_EOK);
+}
+
+static double sBench(const bool orig, const std::vector<PNG_t *> &pngs, const int nRuns)
+{
+    const auto t0 = std::chrono::steady_clock::now();
+    for (int run = 0; run < nRuns; run++)
+    {
+        for (const PNG_t *png : pngs)
+        {
+            if (orig)
+            {
+                upng_t *upng = orig_upng_new_from_bytes(png->png.data(), png->png.size());
+                orig_upng_decode(upng);
+                orig_upng_free(upng);
+            }
+            else
+            {
+                upng_t *upng = upng_new_from_bytes(png->png.data(), png->png.size());
+                upng_decode(upng);
+                upng_free(upng);
+            }
+        }
+    }
+    const auto t1 = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(t1 - t0).count();
+}
+
+int main(int argc, char **argv)
+{
+    // Corpus
+    std::vector<PNG_t> corpus;
+    static const struct { int colorType; int depth; } formats[] =
+    {
+        { 0, 1 }, { 0, 2 }, { 0, 4 }, { 0, 8 }, { 2, 8 }, { 2, 16 }, { 4, 8 }, { 6, 8 }, { 6, 16 },
+    };
+    static const struct { int level; int strategy; } zopts[] =
+    {
+        { 0, Z_DEFAULT_STRATEGY }, { 1, Z_DEFAULT_STRATEGY }, { 6, Z_DEFAULT_STRATEGY }, { 9, Z_DEFAULT_STRATEGY },
+        { 6, Z_FILTERED }, { 6, Z_HUFFMAN_ONLY }, { 6, Z_RLE }, { 9, Z_FIXED },
+    };
+    static const unsigned sizes[][2] = { { 1, 1 }, { 8, 3 }, { 64, 64 }, { 200, 150 }, { 256, 256 } };
+    for (const auto &format : formats)
+    {
+        for (const auto &zopt : zopts)
+        {
+            for (const auto &size : sizes)
+            {
+                const unsigned width = format.depth < 8 ? ((size[0] + 7) & ~7) : size[0]; // no padding bits
+                const int kind = sRand() % 5;
+                const int windowBits = 9 + (sRand() % 7);
+                const size_t idatSize = (sRand() % 3) == 0 ? 1 + (sRand() % 100) : 8192;
+                corpus.push_back(sPngGenerate(width, size[1], format.depth, format.colorType, kind,
+                    zopt.level, zopt.strategy, windowBits, idatSize));
+            }
+        }
+    }
+    for (int cinfo = 0; cinfo <= 7; cinfo++)
+    {
+        corpus.push_back(sPngFarRefs(64, 64, cinfo));
+        corpus.push_back(sPngFarRefs(251, 97, cinfo));
+    }
+    for (int ix = 1; ix < argc; ix++)
+    {
+        PNG_t png;
+        if (!sPngLoad(argv[ix], png))
+        {
+            fprintf(stderr, "Skipping %s: cannot read\n", argv[ix]);
+            continue;
+        }
+        corpus.push_back(png);
+    }
+
+    // Both decoders must give the same image
+    std::vector<PNG_t *> pngs;
+    uint64_t nBytes = 0, nImage = 0;
+    for (PNG_t &png : corpus)
+    {
+        if (sCheck(png))
+        {
+            pngs.push_back(&png);
+            nBytes += png.png.size();
+            upng_t *upng = upng_new_from_bytes(png.png.data(), png.png.size());
+            upng_decode(upng);
+            nImage += upng_get_size(upng);
+            upng_free(upng);
+        }
+    }
+
+    // Time the decoders, enough runs for a second or so of the original one
+    int nRuns = 1;
+    while (sBench(true, pngs, nRuns) < 0.2)
+    {
+        nRuns *= 2;
+    }
+    nRuns *= 5;
+    const double tOrig = sBench(true, pngs, nRuns);
+    const double tNew = sBench(false, pngs, nRuns);
+
+    printf("%d PNGs (%d decoded), %llu bytes PNG, %llu bytes image, %d runs\n", (int)corpus.size(), (int)pngs.size(),
+        (unsigned long long)nBytes, (unsigned long long)nImage, nRuns);
+    printf("old: %8.2f ms %8.1f MB/s\n", tOrig * 1e3 / nRuns, nImage * 1e-6 * nRuns / tOrig);
+    printf("new: %8.2f ms %8.1f MB/s (%.1fx)\n", tNew * 1e3 / nRuns, nImage * 1e-6 * nRuns / tNew, tOrig / tNew);
+    printf("errors: %d\n", sNumErr);
+    return sNumErr == 0 ? 0 : 1;
+}
+
+// eof
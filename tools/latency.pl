@@ -0,0 +1,64 @@
+#!/usr/bin/perl -w
+####################################################################################################
+#
+# flipflip's Album Art Display: track change to cover art latency from the debug output
+#
+# Copyright (c) 2020 Philippe Kehl <flipflip at oinkzwurgl dot org>
+# https://oinkzwurgl.org/projaeggd/album-art-display
+#
+####################################################################################################
+#
+# Reads the debug output (e.g. saved from tools/debug.pl) and prints the time from each LMS status
+# update with a new title ("lms: update ...") to the cover art being on display. This uses the debug
+# lines that both the current and the original firmware print, so that the latency can be compared
+# between the two:
+#
+# - current firmware:  "display: coverart on display (latency ...)", after the frame update
+# - original firmware: "display: cover art ok, ...", printed right before it stops the noise, waits
+#                      75 ms (NOISE_INT * 3 / 2) and updates the frame, so 75 ms are added
+#
+# Usage: tools/latency.pl debug.log [...]
+#
+####################################################################################################
+
+use strict;
+use warnings;
+
+my %title = ();  # last title per player
+my $t0 = undef;  # time of the title change [s]
+my @latencies = ();
+
+while (my $line = <>)
+{
+    $line =~ s{\x1b\[[^m]*m}{}g; # colours from debug.pl
+    next unless ($line =~ m{(\d+\.\d{3}) [A-Z]: (.*)});
+    my ($t, $msg) = ($1, $2);
+
+    if ($msg =~ m{^lms: update (\d+): power=(\S*) mode=(\S*) name=.* title=(.*?)(?: coverart=.*|)$})
+    {
+        my ($ix, $power, $mode, $newTitle) = ($1, $2, $3, $4);
+        if ( ($mode eq 'play') && ($newTitle ne '') && (($title{$ix} // '') ne $newTitle) )
+        {
+            $t0 = $t;
+        }
+        $title{$ix} = $newTitle;
+    }
+    elsif (defined $t0 && ($msg =~ m{^display: (coverart on display|cover art ok)}))
+    {
+        my $dt = ($t - $t0) * 1e3 + ($1 eq 'cover art ok' ? 75 : 0);
+        printf("%.3f %6.0f ms\n", $t0, $dt);
+        push(@latencies, $dt);
+        $t0 = undef;
+    }
+}
+
+if ($#latencies > -1)
+{
+    my @sorted = sort { $a <=> $b } @latencies;
+    my $sum = 0;
+    $sum += $_ for (@sorted);
+    printf("%d track changes: min %.0f ms, median %.0f ms, mean %.0f ms, max %.0f ms\n", $#sorted + 1,
+        $sorted[0], $sorted[$#sorted / 2], $sum / ($#sorted + 1), $sorted[$#sorted]);
+}
+
+# eof
@@ -0,0 +1,83 @@
+#!/usr/bin/perl -w
+####################################################################################################
+#
+# flipflip's Album Art Display: record LMS CLI traffic
+#
+# Copyright (c) 2020 Philippe Kehl <flipflip at oinkzwurgl dot org>
+# https://oinkzwurgl.org/projaeggd/album-art-display
+#
+####################################################################################################
+#
+# Connects to the LMS CLI and sends the same queries as the firmware (see lms.cpp): "subscribe
+# client", "players 0 10" and a "status - 2 tags:cK subscribe:0" for each player, and again "players
+# 0 10" when a new player shows up. It then prints all lines the LMS sends (responses and
+# notifications) for the given time. The output can be used as input for the LMS CLI parser
+# benchmark (tools/hostbench/lms-traffic.txt).
+#
+# Usage: tools/lmscap.pl 10.1.1.17 9090 300 > tools/hostbench/lms-traffic.txt
+#
+####################################################################################################
+
+use strict;
+use warnings;
+
+use IO::Socket::INET;
+use IO::Select;
+use Time::HiRes qw(time);
+
+my ($host, $port, $duration) = @ARGV;
+unless ($host)
+{
+    die("Usage: $0 <host> [<port> [<duration>]]\n");
+}
+$port     ||= 9090;
+$duration ||= 60; # [s]
+
+my $sock = IO::Socket::INET->new(PeerAddr => $host, PeerPort => $port, Proto => 'tcp')
+    || die("Cannot connect to $host:$port: $!\n");
+$sock->autoflush(1);
+my $sel = IO::Select->new($sock);
+
+print($sock "subscribe client\n");
+print($sock "players 0 10\n");
+
+my $buf = '';
+my %subscribed = ();
+my $t0 = time();
+printf("# LMS CLI traffic from %s:%u, %s\n", $host, $port, scalar(localtime()));
+while ((time() - $t0) < $duration)
+{
+    next unless ($sel->can_read(0.5));
+    my $num = sysread($sock, $buf, 4096, length($buf));
+    die("Connection closed\n") unless ($num);
+    while ($buf =~ s{^([^\n]*)\n}{})
+    {
+        my $line = $1;
+        $line =~ s{\r$}{};
+        print("$line\n");
+
+        # Subscribe to the status of the players (new ones, too)
+        my @ids = ();
+        if ($line =~ m{^players })
+        {
+            @ids = $line =~ m{ playerid%3A(\S+)}g;
+        }
+        elsif ($line =~ m{^(\S+) client (new|reconnect)})
+        {
+            @ids = ($1);
+        }
+        my @new = grep { !$subscribed{$_} } @ids;
+        foreach my $id (@new)
+        {
+            print($sock "$id status - 2 tags:cK subscribe:0\n");
+            $subscribed{$id} = 1;
+        }
+        if (@new && ($line !~ m{^players }))
+        {
+            print($sock "players 0 10\n");
+        }
+    }
+}
+close($sock);
+
+# eof
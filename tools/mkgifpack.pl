@@ -0,0 +1,127 @@
+#!/usr/bin/perl -w
+####################################################################################################
+#
+# flipflip's Album Art Display: make GIF asset pack
+#
+# Copyright (c) 2020 Philippe Kehl <flipflip at oinkzwurgl dot org>
+# https://oinkzwurgl.org/projaeggd/album-art-display
+#
+####################################################################################################
+#
+# Creates a flat, read-only image of all GIF files in a directory, to be flashed into the SPIFFS
+# partition instead of a SPIFFS image. The firmware maps it into the address space (see gifs.cpp).
+#
+# Format (all values little-endian):
+#
+#   header (32 bytes):  magic "AADP", version (u32), number of entries (u32), total size (u32),
+#                       entry size (u32), blob alignment (u32), 8 bytes reserved
+#   entries (48 bytes): name (24 bytes, NUL-terminated, e.g. "/foo.gif"), offset (u32), size (u32),
+#                       canvas width (u16), height (u16), number of frames (u16), min. delay [ms] (u16),
+#                       total duration [ms] (u32), total frame area [pixels] (u32)
+#   blobs:              the GIF files, each aligned
+#
+# Entries are sorted by name (byte-wise, like strcmp()). The entries double as the GIF catalogue,
+# so that the firmware does not have to open (and parse) the GIFs to know about them.
+#
+####################################################################################################
+
+use strict;
+use warnings;
+
+use FindBin;
+use lib $FindBin::Bin;
+use Ffi::Gif;
+
+my $MAGIC      = 'AADP';
+my $VERSION    = 2;
+my $HEADERSIZE = 32;
+my $ENTRYSIZE  = 48;
+my $NAMESIZE   = 24;
+my $ALIGN      = 32;
+
+my ($dir, $out, $maxSize) = @ARGV;
+unless ($dir && $out)
+{
+    die("Usage: $0 <dir> <out.bin> [<max.size>]\n");
+}
+
+# find GIFs
+opendir(my $dh, $dir) || die("Cannot read $dir: $!");
+my @files = sort { $a cmp $b } grep { m{\.gif$} && -f "$dir/$_" } readdir($dh);
+closedir($dh);
+
+# entries (names as SPIFFS would have them)
+my @entries = ();
+foreach my $file (@files)
+{
+    my $name = "/$file";
+    if (length($name) >= $NAMESIZE)
+    {
+        print(STDERR "Skipping $file: name too long\n");
+        next;
+    }
+    my $data = slurp("$dir/$file");
+    my $info = Ffi::Gif::parse($data);
+    unless ($info)
+    {
+        print(STDERR "Skipping $file: bad GIF\n");
+        next;
+    }
+    push(@entries, { name => $name, data => $data, info => $info });
+}
+
+# layout
+my $offs = align($HEADERSIZE + ($#entries + 1) * $ENTRYSIZE);
+foreach my $entry (@entries)
+{
+    $entry->{offset} = $offs;
+    $entry->{size} = length($entry->{data});
+    $offs = align($offs + $entry->{size});
+}
+my $totalSize = $offs;
+if ($maxSize && ($totalSize > $maxSize))
+{
+    die(sprintf("Pack too large: %u > %u\n", $totalSize, $maxSize));
+}
+
+# generate
+my $bin = pack('a4 V V V V V x8', $MAGIC, $VERSION, $#entries + 1, $totalSize, $ENTRYSIZE, $ALIGN);
+foreach my $entry (@entries)
+{
+    my $info = $entry->{info};
+    $bin .= pack("a$NAMESIZE V V v v v v V V", $entry->{name}, $entry->{offset}, $entry->{size},
+        $info->{width}, $info->{height}, $info->{frames}, $info->{minDelay} > 0xffff ? 0xffff : $info->{minDelay},
+        $info->{duration}, $info->{area});
+}
+foreach my $entry (@entries)
+{
+    $bin .= "\0" x ($entry->{offset} - length($bin));
+    $bin .= $entry->{data};
+}
+$bin .= "\0" x ($totalSize - length($bin));
+
+open(OUT, '>', $out) || die("Cannot write $out: $!");
+binmode(OUT);
+print(OUT $bin);
+close(OUT);
+
+printf(STDERR "Wrote %s: %u gifs, %u bytes\n", $out, $#entries + 1, $totalSize);
+
+sub align
+{
+    my ($offs) = @_;
+    return ($offs + $ALIGN - 1) & ~($ALIGN - 1);
+}
+
+sub slurp
+{
+    my ($file) = @_;
+    local $/;
+    open(F, '<', $file) || die("Cannot read $file: $!");
+    binmode(F);
+    my $c = <F>;
+    close(F);
+    return $c;
+}
+
+# eof
@@ -0,0 +1,115 @@
+#!/usr/bin/perl -w
+####################################################################################################
+#
+# flipflip's Album Art Display: optimise GIFs for the display
+#
+# Copyright (c) 2020 Philippe Kehl <flipflip at oinkzwurgl dot org>
+# https://oinkzwurgl.org/projaeggd/album-art-display
+#
+####################################################################################################
+#
+# Pre-bakes GIFs for the panel: resizes them to the panel size, reduces the palettes, crops the
+# frames to the changed rectangles (ImageMagick's -layers Optimize) and clamps the frame delays to
+# what the firmware can show (see GIF_MIN_FRAME_DUR and GIF_MAX_FRAME_DUR in display.cpp). It
+# reports the size and decoding cost (sum of all frame areas) before and after.
+#
+# The brightness correction (sLumLut in leddisplay.cpp) is not applied here, as the display driver
+# already applies it to every pixel.
+#
+# Needs ImageMagick (convert).
+#
+# Usage: tools/optgifs.pl data data-opt 64x64 && rm -rf data && mv data-opt data
+#
+####################################################################################################
+
+use strict;
+use warnings;
+
+use FindBin;
+use lib $FindBin::Bin;
+use Ffi::Gif;
+
+my ($inDir, $outDir, $size, $colours, $minDelay, $maxDelay) = @ARGV;
+unless ($inDir && $outDir)
+{
+    die("Usage: $0 <indir> <outdir> [<width>x<height> [<colours> [<min.delay> [<max.delay>]]]]\n");
+}
+$size     ||= '64x64';
+$colours  ||= 128;
+$minDelay ||= 5;    # [ms] GIF_MIN_FRAME_DUR (stored in 1/100 s, so effectively 10 ms)
+$maxDelay ||= 1000; # [ms] GIF_MAX_FRAME_DUR
+die("Bad size $size\n") unless ($size =~ m{^\d+x\d+$});
+
+opendir(my $dh, $inDir) || die("Cannot read $inDir: $!");
+my @files = sort { $a cmp $b } grep { m{\.gif$} && -f "$inDir/$_" } readdir($dh);
+closedir($dh);
+mkdir($outDir) unless (-d $outDir);
+
+printf("%-24s %8s %8s %6s %9s %9s %7s %7s\n", 'file', 'size', 'size\'', 'frames', 'area', 'area\'', 'dur', 'dur\'');
+my %total = ( size => 0, size2 => 0, area => 0, area2 => 0 );
+foreach my $file (@files)
+{
+    my $inFile = "$inDir/$file";
+    my $outFile = "$outDir/$file";
+    my $data = slurp($inFile);
+    my $info = Ffi::Gif::parse($data);
+    unless ($info)
+    {
+        print(STDERR "Skipping $file: bad GIF\n");
+        next;
+    }
+
+    # resize (fit and centre), reduce palette, crop frames
+    my @cmd = ('convert', $inFile, '-coalesce',
+        '-resize', $size, '-background', 'black', '-gravity', 'center', '-extent', $size,
+        '+dither', '-colors', $colours, '-layers', 'Optimize', $outFile);
+    if (system(@cmd) != 0)
+    {
+        print(STDERR "Skipping $file: convert failed\n");
+        unlink($outFile);
+        next;
+    }
+
+    # clamp frame delays (GIF delays are in 1/100 s)
+    my $data2 = slurp($outFile);
+    my $info2 = Ffi::Gif::parse($data2) || die("Bad output $outFile\n");
+    foreach my $offs (@{$info2->{gces}})
+    {
+        my $delay = 10 * unpack('v', substr($data2, $offs, 2));
+        $delay = $minDelay if ($delay < $minDelay);
+        $delay = $maxDelay if ($delay > $maxDelay);
+        substr($data2, $offs, 2) = pack('v', int(($delay + 5) / 10));
+    }
+    $info2 = Ffi::Gif::parse($data2);
+    spew($outFile, $data2);
+
+    printf("%-24s %8u %8u %6u %9u %9u %7u %7u\n", $file, length($data), length($data2), $info2->{frames},
+        $info->{area}, $info2->{area}, $info->{duration}, $info2->{duration});
+    $total{size}  += length($data);
+    $total{size2} += length($data2);
+    $total{area}  += $info->{area};
+    $total{area2} += $info2->{area};
+}
+printf("%-24s %8u %8u %6s %9u %9u\n", 'total', $total{size}, $total{size2}, '', $total{area}, $total{area2});
+
+sub slurp
+{
+    my ($file) = @_;
+    local $/;
+    open(F, '<', $file) || die("Cannot read $file: $!");
+    binmode(F);
+    my $c = <F>;
+    close(F);
+    return $c;
+}
+
+sub spew
+{
+    my ($file, $c) = @_;
+    open(F, '>', $file) || die("Cannot write $file: $!");
+    binmode(F);
+    print(F $c);
+    close(F);
+}
+
+# eof